@@ -1,9 +1,23 @@
+import os
+
 import ide
 from ide_clang import pyvimclang
 
 
 TRIGGERS = r"((::)|(\.)|(->))$"
 
+# Milliseconds to wait for a file being parsed before giving up completion.
+PARSE_TIMEOUT = 200
+
+# Maximum number of completions passed to neovim.
+MAX_COMPLETIONS = 200
+
+SOURCE_EXTENSIONS = (".c", ".cc", ".cpp", ".cxx")
+
+# Directories searched for compile_commands.json, relative to the working
+# directory.
+COMPILATION_DATABASE_DIRS = (".", "build")
+
 
 class ClangIde(ide.Plugin):
 
@@ -13,23 +27,131 @@ class ClangIde(ide.Plugin):
         super().__init__(nvim)
         self.ide = pyvimclang.Ide(nvim.eval("g:ide_clang_libclang"))
         self.triggers = TRIGGERS
+        # File names of buffers attached with nvim_buf_attach by buffer
+        # number, their line edits come as nvim_buf_lines_event.
+        self.attached = {}
+        # Files which buffers are attached and mirrored by line edits, their
+        # content is not sent on completion.
+        self.mirrored = set()
+        cache_dir = nvim.eval("get(g:, 'ide_clang_cache_dir', '')")
+        if cache_dir:
+            self.ide.set_cache_dir(cache_dir)
+        compdb_dir = nvim.eval(
+            "get(g:, 'ide_clang_compilation_database', '')")
+        compdb_dir = compdb_dir or self.find_compilation_database(os.getcwd())
+        if compdb_dir:
+            self.ide.set_compilation_database(compdb_dir)
+        # The project index is saved to the file once indexing is done, so
+        # the next session can navigate before indexing the project again.
+        self.index_file = nvim.eval("get(g:, 'ide_clang_index_file', '')")
+        self.index_saved = True
+        if self.index_file:
+            self.ide.load_index(self.index_file)
+        if nvim.eval("get(g:, 'ide_clang_index_project', 0)"):
+            self.ide.index(self.find_sources(os.getcwd()))
+            self.index_saved = False
+
+    @staticmethod
+    def find_compilation_database(root):
+        for d in COMPILATION_DATABASE_DIRS:
+            path = os.path.abspath(os.path.join(root, d))
+            if os.path.isfile(os.path.join(path, "compile_commands.json")):
+                return path
+        return None
+
+    @staticmethod
+    def find_sources(root):
+        sources = []
+        for dirpath, dirnames, filenames in os.walk(root):
+            dirnames[:] = [d for d in dirnames if not d.startswith(".")]
+            sources.extend(
+                os.path.join(dirpath, f)
+                for f in filenames if f.endswith(SOURCE_EXTENSIONS))
+        return sources
 
     def on_file_open(self, filename):
         self.ide.on_file_open(filename)
-        self.nvim.command(":echo 'parsed'")
+        self.attach(filename)
+
+    def attach(self, filename):
+        # The first nvim_buf_lines_event carries the whole buffer, which
+        # starts the mirror.
+        for buffer in self.nvim.buffers:
+            if buffer.name == filename:
+                if (buffer.number not in self.attached
+                        and buffer.api.attach(True, {})):
+                    self.attached[buffer.number] = filename
+                return
+
+    # Buffer update notifications of attached buffers, nvim_buf_lines_event
+    # and nvim_buf_detach_event.
+    def on_buf_lines_event(
+            self, buffer, changedtick, first, last, lines, more):
+        filename = self.attached.get(buffer.number)
+        if filename:
+            self.on_lines(filename, first, last, lines)
+
+    def on_buf_detach_event(self, buffer):
+        filename = self.attached.pop(buffer.number, None)
+        self.mirrored.discard(filename)
+
+    def on_file_change(self, filename, content):
+        self.ide.on_file_change(filename, content)
+
+    def on_lines(self, filename, first, last, lines):
+        # Line edits from nvim_buf_attach, a mirror out of sync is dropped
+        # until the whole buffer is sent again.
+        if first == 0 and last == -1:
+            self.ide.on_file_change(filename, "\n".join(lines) + "\n")
+            self.mirrored.add(filename)
+        elif self.ide.on_lines_change(filename, first, last, lines):
+            self.mirrored.add(filename)
+        else:
+            self.mirrored.discard(filename)
+
+    def save_index(self):
+        if (self.index_file and not self.index_saved
+                and not self.ide.index_pending()):
+            self.index_saved = self.ide.save_index(self.index_file)
 
     def on_file_save(self, filename):
-        self.ide.on_file_save(self, filename)
+        # Indexed sources including the file are indexed again.
+        self.ide.on_file_save(filename)
+        self.index_saved = False
+        self.save_index()
 
     def on_file_close(self, filename):
+        # Unloaded buffers are detached by nvim.
+        for number, attached in list(self.attached.items()):
+            if attached == filename:
+                del self.attached[number]
+        self.mirrored.discard(filename)
         self.ide.on_file_close(filename)
 
     def find_completions(self, filename, line, column, content):
-        return self.ide.find_completions(
+        completions = self.ide.find_completions(
             filename,
             line,
             column,
-            content)
+            None if filename in self.mirrored else content,
+            PARSE_TIMEOUT,
+            None,
+            MAX_COMPLETIONS)
+        if self.ide.status(filename) == pyvimclang.STATUS_PARSING:
+            self.nvim.command(":echo 'parsing {}'".format(filename))
+        return completions.to_list()
+
+    def find_definition(self, filename, line, column):
+        return self.ide.find_definition(filename, line, column)
+
+    def find_declaration(self, filename, line, column):
+        return self.ide.find_declaration(filename, line, column)
+
+    def find_assingments(self, filename, line, column):
+        return self.ide.find_assingments(filename, line, column)
+
+    def find_references(self, filename, line, column):
+        return self.ide.find_references(filename, line, column)
 
 
 IDE_PLUGIN = ClangIde
@@ -0,0 +1,92 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_INITIAL_CAPACITY 4096
+
+struct arena
+{
+    char* data;
+    size_t size;
+    size_t capacity;
+};
+
+arena_t* arena_alloc(void)
+{
+    arena_t* arena = (arena_t*)malloc(sizeof(arena_t));
+    arena->data = NULL;
+    arena->size = 0;
+    arena->capacity = 0;
+    return arena;
+}
+
+void arena_free(arena_t* arena)
+{
+    free(arena->data);
+    free(arena);
+}
+
+void arena_reset(arena_t* arena)
+{
+    arena->size = 0;
+}
+
+static void reserve(arena_t* arena, size_t size)
+{
+    if (arena->size + size <= arena->capacity)
+    {
+        return;
+    }
+
+    size_t capacity =
+        arena->capacity ? arena->capacity : ARENA_INITIAL_CAPACITY;
+    while (capacity < arena->size + size)
+    {
+        capacity *= 2;
+    }
+
+    arena->data = (char*)realloc(arena->data, capacity);
+    arena->capacity = capacity;
+}
+
+unsigned arena_begin(arena_t* arena)
+{
+    return (unsigned)arena->size;
+}
+
+void arena_append(arena_t* arena, const char* data, size_t size)
+{
+    // Data of an empty arena is NULL, which memcpy must not get.
+    if (size == 0)
+    {
+        return;
+    }
+
+    reserve(arena, size);
+    memcpy(arena->data + arena->size, data, size);
+    arena->size += size;
+}
+
+void arena_end(arena_t* arena)
+{
+    reserve(arena, 1);
+    arena->data[arena->size++] = '\0';
+}
+
+unsigned arena_strdup(arena_t* arena, const char* string)
+{
+    unsigned offset = arena_begin(arena);
+    arena_append(arena, string, strlen(string) + 1);
+    return offset;
+}
+
+const char* arena_get(const arena_t* arena, unsigned offset)
+{
+    return arena->data + offset;
+}
+
+size_t arena_size(const arena_t* arena)
+{
+    return arena->size;
+}
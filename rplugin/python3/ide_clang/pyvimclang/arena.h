@@ -0,0 +1,78 @@
+/**
+ * Growable buffer of zero terminated strings addressed by offsets.
+ *
+ * Strings are stored with their exact length one after another, so a whole
+ * set of strings is kept in a single allocation and dropped at once. Offsets
+ * stay valid while the buffer grows, pointers do not.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct arena arena_t;
+
+/**
+ * Allocate a new empty arena.
+ * @return the new arena allocated.
+ */
+arena_t* arena_alloc(void);
+
+/**
+ * Deallocate the arena provided and all its strings.
+ * @param arena arena to be deallocated.
+ */
+void arena_free(arena_t* arena);
+
+/**
+ * Drop all the strings of the arena provided keeping its memory for reuse.
+ * @param arena arena to be reset.
+ */
+void arena_reset(arena_t* arena);
+
+/**
+ * Start a new string at the end of the arena.
+ * @param  arena arena where the string is built.
+ * @return       offset of the new string.
+ */
+unsigned arena_begin(arena_t* arena);
+
+/**
+ * Append characters to the string being built.
+ * @param arena arena where the string is built.
+ * @param data  characters to append, may be NULL if size is 0.
+ * @param size  number of characters to append.
+ */
+void arena_append(arena_t* arena, const char* data, size_t size);
+
+/**
+ * Terminate the string being built.
+ * @param arena arena where the string is built.
+ */
+void arena_end(arena_t* arena);
+
+/**
+ * Copy a zero terminated string into the arena.
+ * @param  arena  arena where the string is stored.
+ * @param  string the string to copy.
+ * @return        offset of the copy.
+ */
+unsigned arena_strdup(arena_t* arena, const char* string);
+
+/**
+ * Get the string starting at the offset provided, the pointer is valid until
+ * the arena is modified.
+ * @param  arena  arena where the string is stored.
+ * @param  offset offset of the string.
+ * @return        the string.
+ */
+const char* arena_get(const arena_t* arena, unsigned offset);
+
+/**
+ * Get number of bytes used by the strings of the arena provided.
+ * @param  arena the arena.
+ * @return       number of bytes used.
+ */
+size_t arena_size(const arena_t* arena);
+
+#endif // !ARENA_H
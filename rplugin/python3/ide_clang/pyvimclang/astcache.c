@@ -0,0 +1,223 @@
+#include "astcache.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define AST_EXT ".ast"
+#define DEPS_EXT ".deps"
+#define TMP_EXT ".tmp"
+
+struct astcache
+{
+    libclang_t* libclang;
+    char* dir;
+};
+
+typedef struct
+{
+    astcache_t* cache;
+    FILE* deps;
+    bool failed;
+} deps_writer_t;
+
+static uint64_t fnv1a(uint64_t hash, const char* string)
+{
+    // Hash the terminating zero as well so "ab", "c" differs from "a", "bc".
+    const char* p = string;
+    do
+    {
+        hash ^= (unsigned char)*p;
+        hash *= 1099511628211ULL;
+    } while (*p++ != '\0');
+
+    return hash;
+}
+
+static void entry_path(
+    astcache_t* cache,
+    const char* filename,
+    const char* const* flags,
+    unsigned nflags,
+    const char* ext,
+    char path[PATH_MAX])
+{
+    uint64_t hash = fnv1a(14695981039346656037ULL, filename);
+    for (unsigned i = 0; i < nflags; ++i)
+    {
+        hash = fnv1a(hash, flags[i]);
+    }
+
+    snprintf(
+        path,
+        PATH_MAX,
+        "%s/%016llx%s",
+        cache->dir,
+        (unsigned long long)hash,
+        ext);
+}
+
+astcache_t* astcache_alloc(libclang_t* libclang, const char* dir)
+{
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+    {
+        return NULL;
+    }
+
+    astcache_t* cache = (astcache_t*)malloc(sizeof(astcache_t));
+    cache->libclang = libclang;
+    cache->dir = strdup(dir);
+
+    return cache;
+}
+
+void astcache_free(astcache_t* cache)
+{
+    free(cache->dir);
+    free(cache);
+}
+
+// Check every dependency line "<mtime> <size> <path>" against the file system.
+static bool deps_valid(const char* deps_path)
+{
+    FILE* deps = fopen(deps_path, "r");
+    if (!deps)
+    {
+        return false;
+    }
+
+    bool valid = true;
+    char line[PATH_MAX + 64];
+    while (valid && fgets(line, sizeof(line), deps))
+    {
+        long long mtime;
+        long long size;
+        int offset;
+        if (sscanf(line, "%lld %lld %n", &mtime, &size, &offset) != 2)
+        {
+            valid = false;
+            break;
+        }
+
+        char* path = line + offset;
+        path[strcspn(path, "\n")] = '\0';
+
+        struct stat st;
+        valid = stat(path, &st) == 0
+            && (long long)st.st_mtime == mtime
+            && (long long)st.st_size == size;
+    }
+
+    fclose(deps);
+
+    return valid;
+}
+
+CXTranslationUnit astcache_load(
+    astcache_t* cache,
+    CXIndex index,
+    const char* filename,
+    const char* const* flags,
+    unsigned nflags)
+{
+    char deps_path[PATH_MAX];
+    entry_path(cache, filename, flags, nflags, DEPS_EXT, deps_path);
+
+    if (!deps_valid(deps_path))
+    {
+        return NULL;
+    }
+
+    char ast_path[PATH_MAX];
+    entry_path(cache, filename, flags, nflags, AST_EXT, ast_path);
+
+    CXTranslationUnit tu = NULL;
+    if (cache->libclang->create_tu2(index, ast_path, &tu) != CXError_Success)
+    {
+        return NULL;
+    }
+
+    return tu;
+}
+
+static void write_dependency(
+    CXFile file,
+    CXSourceLocation* stack,
+    unsigned stack_size,
+    CXClientData data)
+{
+    deps_writer_t* writer = (deps_writer_t*)data;
+    libclang_t* libclang = writer->cache->libclang;
+
+    CXString name = libclang->get_file_name(file);
+    const char* path = libclang->get_string(name);
+
+    struct stat st;
+    if (path && stat(path, &st) == 0)
+    {
+        fprintf(
+            writer->deps,
+            "%lld %lld %s\n",
+            (long long)st.st_mtime,
+            (long long)st.st_size,
+            path);
+    }
+    else
+    {
+        writer->failed = true;
+    }
+
+    libclang->dispose_string(name);
+}
+
+bool astcache_save(
+    astcache_t* cache,
+    CXTranslationUnit tu,
+    const char* filename,
+    const char* const* flags,
+    unsigned nflags)
+{
+    char ast_path[PATH_MAX];
+    char deps_path[PATH_MAX];
+    char tmp_path[PATH_MAX + sizeof(TMP_EXT)];
+
+    entry_path(cache, filename, flags, nflags, AST_EXT, ast_path);
+    entry_path(cache, filename, flags, nflags, DEPS_EXT, deps_path);
+
+    // Drop the old dependency list first, so a concurrent load never pairs it
+    // with the new AST file.
+    remove(deps_path);
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s%s", ast_path, TMP_EXT);
+    unsigned options = cache->libclang->default_save_options(tu);
+    if (cache->libclang->save_tu(tu, tmp_path, options) != CXSaveError_None
+        || rename(tmp_path, ast_path) != 0)
+    {
+        remove(tmp_path);
+        return false;
+    }
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s%s", deps_path, TMP_EXT);
+    deps_writer_t writer = {.cache = cache, .deps = NULL, .failed = false};
+    writer.deps = fopen(tmp_path, "w");
+    if (!writer.deps)
+    {
+        return false;
+    }
+
+    cache->libclang->get_inclusions(tu, &write_dependency, &writer);
+
+    if (fclose(writer.deps) != 0
+        || writer.failed
+        || rename(tmp_path, deps_path) != 0)
+    {
+        remove(tmp_path);
+        return false;
+    }
+
+    return true;
+}
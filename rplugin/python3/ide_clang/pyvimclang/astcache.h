@@ -0,0 +1,69 @@
+/**
+ * Persistent cache of translation units saved as AST files.
+ *
+ * An entry is addressed by a hash of the source file name and the compiler
+ * flags. Next to the AST file a dependency list keeps modification time and
+ * size of the source file and of every header it includes, an entry is only
+ * loaded if none of them changed.
+ */
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+
+#include <stdbool.h>
+
+#include <clang-c/Index.h>
+
+#include "libclang.h"
+
+typedef struct astcache astcache_t;
+
+/**
+ * Allocate a cache stored in the directory provided, the directory is
+ * created if it does not exist.
+ * @param  libclang libclang functions.
+ * @param  dir      cache directory.
+ * @return          the new cache allocated or NULL if the directory cannot
+ *                  be created.
+ */
+astcache_t* astcache_alloc(libclang_t* libclang, const char* dir);
+
+/**
+ * Deallocate the cache provided, cached files are kept.
+ * @param cache cache to be deallocated.
+ */
+void astcache_free(astcache_t* cache);
+
+/**
+ * Load the translation unit of the file provided if it is cached and not
+ * stale.
+ * @param  cache    the cache.
+ * @param  index    index the translation unit is loaded into.
+ * @param  filename source file name.
+ * @param  flags    compiler flags used to parse the file.
+ * @param  nflags   number of compiler flags.
+ * @return          the translation unit loaded or NULL.
+ */
+CXTranslationUnit astcache_load(
+    astcache_t* cache,
+    CXIndex index,
+    const char* filename,
+    const char* const* flags,
+    unsigned nflags);
+
+/**
+ * Save the translation unit of the file provided with its dependencies.
+ * @param  cache    the cache.
+ * @param  tu       parsed translation unit.
+ * @param  filename source file name.
+ * @param  flags    compiler flags used to parse the file.
+ * @param  nflags   number of compiler flags.
+ * @return          true if the translation unit was saved otherwise false.
+ */
+bool astcache_save(
+    astcache_t* cache,
+    CXTranslationUnit tu,
+    const char* filename,
+    const char* const* flags,
+    unsigned nflags);
+
+#endif // !ASTCACHE_H
@@ -0,0 +1,136 @@
+#include "cmap.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define STRIPE_BITS 6
+#define STRIPES (1 << STRIPE_BITS)
+#define CACHE_LINE 64
+
+// Stripes are cache line aligned, so locking one stripe does not slow down
+// threads working with its neighbours.
+typedef struct
+{
+    _Alignas(CACHE_LINE) pthread_rwlock_t lock;
+    hashmap_t* map;
+} stripe_t;
+
+struct cmap
+{
+    stripe_t stripes[STRIPES];
+    hash_t hash;
+};
+
+// Hashmaps use the low bits of the hash, stripes use the high ones.
+static stripe_t* find_stripe(cmap_t* map, const void* key)
+{
+    return &map->stripes[map->hash(key) >> (64 - STRIPE_BITS)];
+}
+
+cmap_t* cmap_alloc(hash_t hash, equals_t equals)
+{
+    void* memory;
+    if (posix_memalign(&memory, CACHE_LINE, sizeof(cmap_t)) != 0)
+    {
+        return NULL;
+    }
+
+    cmap_t* map = (cmap_t*)memory;
+    map->hash = hash;
+    for (unsigned i = 0; i < STRIPES; ++i)
+    {
+        pthread_rwlock_init(&map->stripes[i].lock, NULL);
+        map->stripes[i].map = hashmap_alloc(hash, equals);
+    }
+
+    return map;
+}
+
+void cmap_free(cmap_t* map)
+{
+    for (unsigned i = 0; i < STRIPES; ++i)
+    {
+        hashmap_free(map->stripes[i].map);
+        pthread_rwlock_destroy(&map->stripes[i].lock);
+    }
+
+    free(map);
+}
+
+void cmap_set(cmap_t* map, const void* key, void* data)
+{
+    stripe_t* stripe = find_stripe(map, key);
+
+    pthread_rwlock_wrlock(&stripe->lock);
+    hashmap_set(stripe->map, key, data);
+    pthread_rwlock_unlock(&stripe->lock);
+}
+
+bool cmap_get(cmap_t* map, const void* key, void** data)
+{
+    stripe_t* stripe = find_stripe(map, key);
+
+    pthread_rwlock_rdlock(&stripe->lock);
+    bool found = hashmap_get(stripe->map, key, data);
+    pthread_rwlock_unlock(&stripe->lock);
+
+    return found;
+}
+
+bool cmap_get_with(
+    cmap_t* map,
+    const void* key,
+    void* ctx,
+    void (*action)(void*, const void*, void*))
+{
+    stripe_t* stripe = find_stripe(map, key);
+
+    pthread_rwlock_rdlock(&stripe->lock);
+    void* data;
+    bool found = hashmap_get(stripe->map, key, &data);
+    if (found)
+    {
+        (*action)(ctx, key, data);
+    }
+    pthread_rwlock_unlock(&stripe->lock);
+
+    return found;
+}
+
+bool cmap_remove(cmap_t* map, const void* key)
+{
+    stripe_t* stripe = find_stripe(map, key);
+
+    pthread_rwlock_wrlock(&stripe->lock);
+    bool removed = hashmap_remove(stripe->map, key);
+    pthread_rwlock_unlock(&stripe->lock);
+
+    return removed;
+}
+
+size_t cmap_size(cmap_t* map)
+{
+    size_t size = 0;
+    for (unsigned i = 0; i < STRIPES; ++i)
+    {
+        pthread_rwlock_rdlock(&map->stripes[i].lock);
+        size += hashmap_size(map->stripes[i].map);
+        pthread_rwlock_unlock(&map->stripes[i].lock);
+    }
+
+    return size;
+}
+
+void cmap_each(
+    cmap_t* map,
+    void* ctx,
+    void (*action)(void*, const void*, void*))
+{
+    for (unsigned i = 0; i < STRIPES; ++i)
+    {
+        pthread_rwlock_rdlock(&map->stripes[i].lock);
+        hashmap_each(map->stripes[i].map, ctx, action);
+        pthread_rwlock_unlock(&map->stripes[i].lock);
+    }
+}
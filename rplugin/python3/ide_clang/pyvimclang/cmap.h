@@ -0,0 +1,94 @@
+/**
+ * Thread safe hashmap made of lock striped hashmaps.
+ *
+ * Keys are spread over stripes by hash, each stripe is a hashmap guarded by
+ * its own read-write lock, so lookups run in parallel and writers only block
+ * the keys of one stripe. The map does not own keys and data, callers keep
+ * them alive while they are in the map; use cmap_get_with to take a
+ * reference to data atomically with the lookup.
+ */
+#ifndef CMAP_H
+#define CMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "hashmap.h"
+
+typedef struct cmap cmap_t;
+
+/**
+ * Allocate a new concurrent hashmap.
+ * @param  hash   hash function.
+ * @param  equals equality function.
+ * @return        the new map allocated.
+ */
+cmap_t* cmap_alloc(hash_t hash, equals_t equals);
+
+/**
+ * Deallocate the map provided, no other thread should use it.
+ * @param map map to be deallocated.
+ */
+void cmap_free(cmap_t* map);
+
+/**
+ * Insert data with the key provided in the map.
+ * @param map  map to be updated.
+ * @param key  the key associated with the data.
+ * @param data the data to be inserted.
+ */
+void cmap_set(cmap_t* map, const void* key, void* data);
+
+/**
+ * Get the data with the key provided.
+ * @param  map  map where the check should be performed.
+ * @param  key  the key with which the data desired is associated.
+ * @param  data the data desired.
+ * @return      true if the key provided was found otherwise false.
+ */
+bool cmap_get(cmap_t* map, const void* key, void** data);
+
+/**
+ * Find the data with the key provided and apply the action to it while the
+ * key cannot be removed.
+ * @param  map    map where the check should be performed.
+ * @param  key    the key with which the data desired is associated.
+ * @param  ctx    closure context.
+ * @param  action the action to apply to the data found.
+ * @return        true if the key provided was found otherwise false.
+ */
+bool cmap_get_with(
+    cmap_t* map,
+    const void* key,
+    void* ctx,
+    void (*action)(void*, const void*, void*));
+
+/**
+ * Remove the key provided and data associated with it from the map.
+ * @param  map map to be updated.
+ * @param  key key to be removed.
+ * @return     true if the key was removed otherwise false.
+ */
+bool cmap_remove(cmap_t* map, const void* key);
+
+/**
+ * Get size of the map provided, the size can change right after the call.
+ * @param  map the map.
+ * @return     size of the map provided.
+ */
+size_t cmap_size(cmap_t* map);
+
+/**
+ * Apply the action provided to each item in the map. Stripes are visited one
+ * by one, so items set or removed by other threads meanwhile may or may not
+ * be visited. The action must not modify the map.
+ * @param map    the map to iterate.
+ * @param ctx    closure context.
+ * @param action the action to apply to items of the map.
+ */
+void cmap_each(
+    cmap_t* map,
+    void* ctx,
+    void (*action)(void*, const void*, void*));
+
+#endif // !CMAP_H
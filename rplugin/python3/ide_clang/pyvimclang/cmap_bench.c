@@ -0,0 +1,176 @@
+/**
+ * Contention benchmark of the concurrent hashmap against a hashmap guarded by
+ * a single mutex, with a read mostly mix of operations on string keys.
+ *
+ * Build:
+ *   gcc -O2 -pthread -I. -o cmap_bench cmap_bench.c cmap.c hashmap.c hash.c
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cmap.h"
+
+#define KEYS 100000
+#define KEY_SIZE 96
+#define OPERATIONS_PER_THREAD 1000000
+// Percent of operations which are sets or removes.
+#define WRITE_PERCENT 10
+
+static const unsigned THREADS[] = {1, 2, 4, 8, 16, 32};
+
+typedef struct
+{
+    cmap_t* cmap;
+    hashmap_t* map;
+    pthread_mutex_t* lock;
+    const char* keys;
+    unsigned seed;
+} worker_t;
+
+static double now_s(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static unsigned next_random(unsigned* seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static void* run_cmap(void* ctx)
+{
+    worker_t* worker = (worker_t*)ctx;
+    for (unsigned i = 0; i < OPERATIONS_PER_THREAD; ++i)
+    {
+        unsigned r = next_random(&worker->seed);
+        const char* key = worker->keys + (r % KEYS) * KEY_SIZE;
+        void* data;
+
+        if (r % 100 >= WRITE_PERCENT)
+        {
+            cmap_get(worker->cmap, key, &data);
+        }
+        else if (r & 1)
+        {
+            cmap_set(worker->cmap, key, (void*)key);
+        }
+        else
+        {
+            cmap_remove(worker->cmap, key);
+        }
+    }
+    return NULL;
+}
+
+static void* run_locked(void* ctx)
+{
+    worker_t* worker = (worker_t*)ctx;
+    for (unsigned i = 0; i < OPERATIONS_PER_THREAD; ++i)
+    {
+        unsigned r = next_random(&worker->seed);
+        const char* key = worker->keys + (r % KEYS) * KEY_SIZE;
+        void* data;
+
+        pthread_mutex_lock(worker->lock);
+        if (r % 100 >= WRITE_PERCENT)
+        {
+            hashmap_get(worker->map, key, &data);
+        }
+        else if (r & 1)
+        {
+            hashmap_set(worker->map, key, (void*)key);
+        }
+        else
+        {
+            hashmap_remove(worker->map, key);
+        }
+        pthread_mutex_unlock(worker->lock);
+    }
+    return NULL;
+}
+
+// Run the workers on nthreads threads, returns millions of operations per
+// second.
+static double measure(
+    void* (*run)(void*),
+    worker_t* prototype,
+    unsigned nthreads)
+{
+    pthread_t threads[32];
+    worker_t workers[32];
+
+    double begin = now_s();
+    for (unsigned i = 0; i < nthreads; ++i)
+    {
+        workers[i] = *prototype;
+        workers[i].seed = i + 1;
+        pthread_create(&threads[i], NULL, run, &workers[i]);
+    }
+    for (unsigned i = 0; i < nthreads; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = now_s() - begin;
+
+    return (double)nthreads * OPERATIONS_PER_THREAD / elapsed / 1e6;
+}
+
+int main(int argc, char* argv[])
+{
+    char* keys = (char*)malloc(KEYS * KEY_SIZE);
+    for (unsigned i = 0; i < KEYS; ++i)
+    {
+        snprintf(
+            keys + i * KEY_SIZE,
+            KEY_SIZE,
+            "/home/user/projects/monorepo/src/module%u/source%u.cpp",
+            i % 97,
+            i);
+    }
+
+    cmap_t* cmap = cmap_alloc(&string_hash, &string_equals);
+    hashmap_t* map = hashmap_alloc(&string_hash, &string_equals);
+    pthread_mutex_t lock;
+    pthread_mutex_init(&lock, NULL);
+
+    for (unsigned i = 0; i < KEYS; ++i)
+    {
+        cmap_set(cmap, keys + i * KEY_SIZE, keys + i * KEY_SIZE);
+        hashmap_set(map, keys + i * KEY_SIZE, keys + i * KEY_SIZE);
+    }
+
+    worker_t prototype = {
+        .cmap = cmap,
+        .map = map,
+        .lock = &lock,
+        .keys = keys,
+        .seed = 0};
+
+    printf(
+        "%8s %12s %12s  (Mops/s, %d%% writes)\n",
+        "threads",
+        "cmap",
+        "mutex",
+        WRITE_PERCENT);
+
+    for (unsigned i = 0; i < sizeof(THREADS) / sizeof(THREADS[0]); ++i)
+    {
+        printf(
+            "%8u %12.2f %12.2f\n",
+            THREADS[i],
+            measure(&run_cmap, &prototype, THREADS[i]),
+            measure(&run_locked, &prototype, THREADS[i]));
+    }
+
+    cmap_free(cmap);
+    hashmap_free(map);
+    pthread_mutex_destroy(&lock);
+    free(keys);
+
+    return 0;
+}
@@ -0,0 +1,410 @@
+#include "compdb.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "hashmap.h"
+
+#define DATABASE_NAME "compile_commands.json"
+
+static const char* const SOURCE_EXTENSIONS[] = {
+    ".c", ".cc", ".cpp", ".cxx", ".m", ".mm"};
+
+static const char* const CXX_EXTENSIONS[] = {".cc", ".cpp", ".cxx", ".mm"};
+
+typedef struct
+{
+    char** flags;
+    unsigned nflags;
+} entry_t;
+
+struct compdb
+{
+    libclang_t* libclang;
+    char* path;
+    char* dir;
+    struct timespec mtime;
+    CXCompilationDatabase db;
+    // Files with their flags, files without flags have no entry flags.
+    hashmap_t* entries;
+    // Every source of the database, read on the first header lookup.
+    char** sources;
+    unsigned nsources;
+    bool sources_read;
+    pthread_mutex_t lock;
+};
+
+static char** copy_flags(char** flags, unsigned nflags)
+{
+    char** copy = (char**)malloc(sizeof(char*) * (nflags + 1));
+    for (unsigned i = 0; i < nflags; ++i)
+    {
+        copy[i] = strdup(flags[i]);
+    }
+    return copy;
+}
+
+void compdb_free_flags(char** flags, unsigned nflags)
+{
+    for (unsigned i = 0; i < nflags; ++i)
+    {
+        free(flags[i]);
+    }
+    free(flags);
+}
+
+static void free_entry(void* ctx, const void* filename, void* data)
+{
+    entry_t* entry = (entry_t*)data;
+    compdb_free_flags(entry->flags, entry->nflags);
+    free((void*)filename);
+    free(entry);
+}
+
+static void clear(compdb_t* db)
+{
+    hashmap_each(db->entries, NULL, &free_entry);
+    hashmap_free(db->entries);
+    db->entries = hashmap_alloc(&string_hash, &string_equals);
+
+    compdb_free_flags(db->sources, db->nsources);
+    db->sources = NULL;
+    db->nsources = 0;
+    db->sources_read = false;
+
+    if (db->db)
+    {
+        db->libclang->compilation_database_dispose(db->db);
+        db->db = NULL;
+    }
+}
+
+static bool read_mtime(const char* path, struct timespec* mtime)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        return false;
+    }
+
+    *mtime = st.st_mtim;
+    return true;
+}
+
+// Load the database again if the file changed since it was loaded.
+static void reload(compdb_t* db)
+{
+    struct timespec mtime = {0, 0};
+    read_mtime(db->path, &mtime);
+
+    if (mtime.tv_sec == db->mtime.tv_sec
+        && mtime.tv_nsec == db->mtime.tv_nsec)
+    {
+        return;
+    }
+
+    clear(db);
+    db->mtime = mtime;
+
+    CXCompilationDatabase_Error error;
+    db->db = db->libclang->compilation_database_from_directory(
+        db->dir, &error);
+    if (error != CXCompilationDatabase_NoError)
+    {
+        db->db = NULL;
+    }
+}
+
+compdb_t* compdb_alloc(libclang_t* libclang, const char* dir)
+{
+    compdb_t* db = (compdb_t*)malloc(sizeof(compdb_t));
+    db->libclang = libclang;
+    db->dir = strdup(dir);
+    db->path = (char*)malloc(strlen(dir) + sizeof("/" DATABASE_NAME));
+    sprintf(db->path, "%s/%s", dir, DATABASE_NAME);
+    db->mtime = (struct timespec){0, 0};
+    db->db = NULL;
+    db->entries = hashmap_alloc(&string_hash, &string_equals);
+    db->sources = NULL;
+    db->nsources = 0;
+    db->sources_read = false;
+    pthread_mutex_init(&db->lock, NULL);
+
+    reload(db);
+    if (!db->db)
+    {
+        compdb_free(db);
+        return NULL;
+    }
+
+    return db;
+}
+
+void compdb_free(compdb_t* db)
+{
+    clear(db);
+    hashmap_free(db->entries);
+    pthread_mutex_destroy(&db->lock);
+    free(db->path);
+    free(db->dir);
+    free(db);
+}
+
+static char* get_string(libclang_t* libclang, CXString string)
+{
+    const char* cstring = libclang->get_string(string);
+    char* copy = strdup(cstring ? cstring : "");
+    libclang->dispose_string(string);
+    return copy;
+}
+
+static bool has_extension(
+    const char* filename,
+    const char* const* extensions,
+    unsigned nextensions)
+{
+    const char* dot = strrchr(filename, '.');
+    for (unsigned i = 0; dot && i < nextensions; ++i)
+    {
+        if (strcmp(dot, extensions[i]) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Check if the argument names the source file of the command.
+static bool is_source_arg(
+    const char* arg,
+    const char* directory,
+    const char* source)
+{
+    if (strcmp(arg, source) == 0)
+    {
+        return true;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", directory, arg);
+    return arg[0] != '/' && strcmp(path, source) == 0;
+}
+
+// Convert the compile command to flags for libclang.
+static entry_t* read_command(compdb_t* db, CXCompileCommand command)
+{
+    libclang_t* libclang = db->libclang;
+    char* directory = get_string(
+        libclang, libclang->compile_command_get_directory(command));
+    char* source = get_string(
+        libclang, libclang->compile_command_get_filename(command));
+    unsigned nargs = libclang->compile_command_get_num_args(command);
+
+    entry_t* entry = (entry_t*)malloc(sizeof(entry_t));
+    entry->flags = (char**)malloc(sizeof(char*) * (nargs + 1));
+    entry->nflags = 0;
+
+    // The first argument is the compiler.
+    for (unsigned i = 1; i < nargs; ++i)
+    {
+        char* arg =
+            get_string(libclang, libclang->compile_command_get_arg(command, i));
+
+        // Only inputs follow "--", like in commands libclang interpolates
+        // for headers, and flags appended after it would be inputs too.
+        if (strcmp(arg, "--") == 0)
+        {
+            free(arg);
+            break;
+        }
+
+        if (strcmp(arg, "-o") == 0 && i + 1 < nargs)
+        {
+            ++i;
+            free(arg);
+        }
+        else if (strcmp(arg, "-c") == 0
+            || is_source_arg(arg, directory, source))
+        {
+            free(arg);
+        }
+        else
+        {
+            entry->flags[entry->nflags++] = arg;
+        }
+    }
+
+    // Relative include paths are relative to the command directory.
+    char* working_directory =
+        (char*)malloc(strlen(directory) + sizeof("-working-directory="));
+    sprintf(working_directory, "-working-directory=%s", directory);
+    entry->flags[entry->nflags++] = working_directory;
+
+    free(source);
+    free(directory);
+
+    return entry;
+}
+
+static entry_t* find_command(compdb_t* db, const char* filename)
+{
+    CXCompileCommands commands =
+        db->libclang->compilation_database_get_commands(db->db, filename);
+    if (!commands)
+    {
+        return NULL;
+    }
+
+    entry_t* entry = NULL;
+    if (db->libclang->compile_commands_get_size(commands) > 0)
+    {
+        entry = read_command(
+            db, db->libclang->compile_commands_get_command(commands, 0));
+    }
+
+    db->libclang->compile_commands_dispose(commands);
+
+    return entry;
+}
+
+static void read_sources(compdb_t* db)
+{
+    db->sources_read = true;
+
+    CXCompileCommands commands =
+        db->libclang->compilation_database_get_all_commands(db->db);
+    if (!commands)
+    {
+        return;
+    }
+
+    unsigned size = db->libclang->compile_commands_get_size(commands);
+    db->sources = (char**)malloc(sizeof(char*) * (size + 1));
+    for (unsigned i = 0; i < size; ++i)
+    {
+        CXCompileCommand command =
+            db->libclang->compile_commands_get_command(commands, i);
+        db->sources[db->nsources++] = get_string(
+            db->libclang,
+            db->libclang->compile_command_get_filename(command));
+    }
+
+    db->libclang->compile_commands_dispose(commands);
+}
+
+// Number of leading path components the paths have in common.
+static unsigned common_components(const char* a, const char* b)
+{
+    unsigned common = 0;
+    for (; *a && *a == *b; ++a, ++b)
+    {
+        common += *a == '/';
+    }
+    return common;
+}
+
+// Find a source which flags fit the header: a source with the same name
+// next to it, otherwise the source sharing the longest directory prefix.
+static const char* find_header_source(compdb_t* db, const char* header)
+{
+    if (!db->sources_read)
+    {
+        read_sources(db);
+    }
+
+    const char* dot = strrchr(header, '.');
+    size_t stem = dot ? (size_t)(dot - header) : strlen(header);
+
+    const char* best = NULL;
+    unsigned best_common = 0;
+    for (unsigned i = 0; i < db->nsources; ++i)
+    {
+        const char* source = db->sources[i];
+        const char* source_dot = strrchr(source, '.');
+        if (source_dot
+            && (size_t)(source_dot - source) == stem
+            && strncmp(source, header, stem) == 0)
+        {
+            return source;
+        }
+
+        unsigned common = common_components(source, header);
+        if (common > best_common)
+        {
+            best = source;
+            best_common = common;
+        }
+    }
+
+    return best;
+}
+
+// Used for headers libclang has no command for, newer versions interpolate
+// commands of headers themselves.
+static entry_t* infer_header_flags(compdb_t* db, const char* header)
+{
+    const char* source = find_header_source(db, header);
+    entry_t* entry = source ? find_command(db, source) : NULL;
+
+    // Headers ending with .h are parsed as C unless told otherwise.
+    if (entry && has_extension(source, CXX_EXTENSIONS, 4))
+    {
+        entry->flags = (char**)realloc(
+            entry->flags, sizeof(char*) * (entry->nflags + 2));
+        memmove(entry->flags + 2, entry->flags, sizeof(char*) * entry->nflags);
+        entry->flags[0] = strdup("-x");
+        entry->flags[1] = strdup("c++");
+        entry->nflags += 2;
+    }
+
+    return entry;
+}
+
+bool compdb_get_flags(
+    compdb_t* db,
+    const char* filename,
+    char*** flags,
+    unsigned* nflags)
+{
+    pthread_mutex_lock(&db->lock);
+
+    reload(db);
+
+    void* found;
+    entry_t* entry = NULL;
+    if (hashmap_get(db->entries, filename, &found))
+    {
+        entry = (entry_t*)found;
+    }
+    else if (db->db)
+    {
+        entry = find_command(db, filename);
+        if (!entry && !has_extension(filename, SOURCE_EXTENSIONS, 6))
+        {
+            entry = infer_header_flags(db, filename);
+        }
+
+        if (!entry)
+        {
+            entry = (entry_t*)malloc(sizeof(entry_t));
+            entry->flags = NULL;
+            entry->nflags = 0;
+        }
+        hashmap_set(db->entries, strdup(filename), entry);
+    }
+
+    bool result = entry && entry->flags;
+    if (result)
+    {
+        *flags = copy_flags(entry->flags, entry->nflags);
+        *nflags = entry->nflags;
+    }
+
+    pthread_mutex_unlock(&db->lock);
+
+    return result;
+}
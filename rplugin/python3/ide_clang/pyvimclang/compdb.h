@@ -0,0 +1,54 @@
+/**
+ * Per file compiler flags from a compile_commands.json compilation database.
+ *
+ * Flags are looked up once per file and cached. Headers without their own
+ * entry borrow flags of a source with the same name or of the nearest source
+ * in the database. The database is loaded again when its modification time
+ * changes. All the functions are thread safe.
+ */
+#ifndef COMPDB_H
+#define COMPDB_H
+
+#include <stdbool.h>
+
+#include "libclang.h"
+
+typedef struct compdb compdb_t;
+
+/**
+ * Load the compilation database from the directory provided.
+ * @param  libclang libclang functions.
+ * @param  dir      directory containing compile_commands.json.
+ * @return          the database or NULL if it cannot be loaded.
+ */
+compdb_t* compdb_alloc(libclang_t* libclang, const char* dir);
+
+/**
+ * Deallocate the database provided.
+ * @param db database to be deallocated.
+ */
+void compdb_free(compdb_t* db);
+
+/**
+ * Get compiler flags of the file provided. The compiler, the source file and
+ * output arguments of the compile command are dropped.
+ * @param  db       database to search.
+ * @param  filename absolute path of the file.
+ * @param  flags    the flags found, to be freed with compdb_free_flags.
+ * @param  nflags   number of the flags found.
+ * @return          true if flags were found otherwise false.
+ */
+bool compdb_get_flags(
+    compdb_t* db,
+    const char* filename,
+    char*** flags,
+    unsigned* nflags);
+
+/**
+ * Deallocate flags provided by compdb_get_flags.
+ * @param flags  the flags.
+ * @param nflags number of the flags.
+ */
+void compdb_free_flags(char** flags, unsigned nflags);
+
+#endif // !COMPDB_H
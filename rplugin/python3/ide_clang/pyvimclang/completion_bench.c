@@ -0,0 +1,400 @@
+/**
+ * Benchmark of converting completion results to the abbreviation and word
+ * shown, with the cursor and chunk kinds dispatched through hashmaps and
+ * chunk handlers as before, and through the static tables ide.c uses.
+ *
+ * Results are synthetic, libclang calls are replaced with reading arrays, so
+ * only the dispatch and the copying are measured.
+ *
+ * Build:
+ *   gcc -O2 -I. -o completion_bench completion_bench.c arena.c hashmap.c \
+ *       hash.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <clang-c/Index.h>
+
+#include "arena.h"
+#include "hashmap.h"
+
+#define RESULTS 1000000
+#define CHUNKS_PER_RESULT 6
+// Arenas are reset after this number of results, as a completion request
+// converts at most a few thousands of results.
+#define RESULTS_PER_REQUEST 4096
+
+enum
+{
+    CHUNK_WORD = 1,
+    CHUNK_ABBR = 2,
+    CHUNK_SPACE = 4
+};
+
+static const char KIND_CHARS[] = {
+    [CXCursor_StructDecl] = 't',
+    [CXCursor_UnionDecl] = 't',
+    [CXCursor_EnumConstantDecl] = 't',
+    [CXCursor_EnumDecl] = 't',
+    [CXCursor_TypedefDecl] = 't',
+    [CXCursor_ClassTemplate] = 't',
+    [CXCursor_ClassDecl] = 't',
+    [CXCursor_ConversionFunction] = 'f',
+    [CXCursor_FunctionTemplate] = 'f',
+    [CXCursor_FunctionDecl] = 'f',
+    [CXCursor_Constructor] = 'm',
+    [CXCursor_Destructor] = 'm',
+    [CXCursor_CXXMethod] = 'm',
+    [CXCursor_FieldDecl] = 'm',
+    [CXCursor_VarDecl] = 'v',
+    [CXCursor_TemplateTypeParameter] = 'p',
+    [CXCursor_ParmDecl] = 's',
+    [CXCursor_PreprocessingDirective] = 'D',
+    [CXCursor_MacroDefinition] = 'M'};
+
+static const char* const KIND_NAMES[] = {
+    [CXCursor_StructDecl] = "struct ",
+    [CXCursor_UnionDecl] = "union ",
+    [CXCursor_EnumConstantDecl] = "enum ",
+    [CXCursor_EnumDecl] = "enum ",
+    [CXCursor_TypedefDecl] = "typedef ",
+    [CXCursor_ClassTemplate] = "class ",
+    [CXCursor_ClassDecl] = "class "};
+
+static const unsigned char CHUNK_TARGETS[] = {
+    [CXCompletionChunk_TypedText] = CHUNK_WORD | CHUNK_ABBR,
+    [CXCompletionChunk_Text] = CHUNK_WORD | CHUNK_ABBR,
+    [CXCompletionChunk_ResultType] = CHUNK_ABBR | CHUNK_SPACE,
+    [CXCompletionChunk_Placeholder] = CHUNK_ABBR,
+    [CXCompletionChunk_LeftParen] = CHUNK_ABBR,
+    [CXCompletionChunk_RightParen] = CHUNK_ABBR,
+    [CXCompletionChunk_LeftBracket] = CHUNK_ABBR,
+    [CXCompletionChunk_RightBracket] = CHUNK_ABBR,
+    [CXCompletionChunk_LeftBrace] = CHUNK_ABBR,
+    [CXCompletionChunk_RightBrace] = CHUNK_ABBR,
+    [CXCompletionChunk_LeftAngle] = CHUNK_ABBR,
+    [CXCompletionChunk_RightAngle] = CHUNK_ABBR,
+    [CXCompletionChunk_Comma] = CHUNK_ABBR,
+    [CXCompletionChunk_Colon] = CHUNK_ABBR,
+    [CXCompletionChunk_SemiColon] = CHUNK_ABBR,
+    [CXCompletionChunk_Equal] = CHUNK_ABBR,
+    [CXCompletionChunk_HorizontalSpace] = CHUNK_ABBR,
+    [CXCompletionChunk_VerticalSpace] = CHUNK_ABBR};
+
+#define TABLE_SIZE(table) (sizeof(table) / sizeof(table[0]))
+
+// Cursor kinds of results, unmapped kinds are included as well.
+static const unsigned CURSOR_KINDS[] = {
+    CXCursor_FunctionDecl,
+    CXCursor_CXXMethod,
+    CXCursor_FieldDecl,
+    CXCursor_VarDecl,
+    CXCursor_ClassDecl,
+    CXCursor_TypedefDecl,
+    CXCursor_MacroDefinition,
+    CXCursor_ParmDecl,
+    CXCursor_NotImplemented,
+    CXCursor_Namespace};
+
+static const unsigned CHUNK_KINDS[] = {
+    CXCompletionChunk_TypedText,
+    CXCompletionChunk_ResultType,
+    CXCompletionChunk_Placeholder,
+    CXCompletionChunk_LeftParen,
+    CXCompletionChunk_RightParen,
+    CXCompletionChunk_Comma,
+    CXCompletionChunk_Informative,
+    CXCompletionChunk_Optional};
+
+typedef struct
+{
+    unsigned cursor_kind;
+    unsigned chunk_kinds[CHUNKS_PER_RESULT];
+    const char* chunk_texts[CHUNKS_PER_RESULT];
+} result_t;
+
+typedef void (*complete_chunk_t)(arena_t*, arena_t*, const char*);
+
+typedef struct
+{
+    hashmap_t* kind_chars;
+    hashmap_t* kind_names;
+    hashmap_t* completion_chunks;
+} maps_t;
+
+static double now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static unsigned next_random(unsigned* seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static uint64_t unsigned_hash(const void* value)
+{
+    return (uint64_t)(size_t)value;
+}
+
+static bool unsigned_equals(const void* a, const void* b)
+{
+    return a == b;
+}
+
+static void append(arena_t* arena, const char* part)
+{
+    arena_append(arena, part, strlen(part));
+}
+
+static void complete_text(arena_t* abbr, arena_t* word, const char* part)
+{
+    append(word, part);
+    append(abbr, part);
+}
+
+static void complete_result_type(
+    arena_t* abbr,
+    arena_t* word,
+    const char* part)
+{
+    append(abbr, part);
+    append(abbr, " ");
+}
+
+static void complete_symbol(arena_t* abbr, arena_t* word, const char* part)
+{
+    append(abbr, part);
+}
+
+static void init_maps(maps_t* maps)
+{
+    maps->kind_chars = hashmap_alloc(&unsigned_hash, &unsigned_equals);
+    maps->kind_names = hashmap_alloc(&unsigned_hash, &unsigned_equals);
+    maps->completion_chunks =
+        hashmap_alloc(&unsigned_hash, &unsigned_equals);
+
+    for (size_t kind = 0; kind < TABLE_SIZE(KIND_CHARS); ++kind)
+    {
+        if (KIND_CHARS[kind])
+        {
+            hashmap_set(
+                maps->kind_chars, (void*)kind, (void*)(size_t)KIND_CHARS[kind]);
+        }
+    }
+
+    for (size_t kind = 0; kind < TABLE_SIZE(KIND_NAMES); ++kind)
+    {
+        if (KIND_NAMES[kind])
+        {
+            hashmap_set(maps->kind_names, (void*)kind, (void*)KIND_NAMES[kind]);
+        }
+    }
+
+    for (size_t kind = 0; kind < TABLE_SIZE(CHUNK_TARGETS); ++kind)
+    {
+        complete_chunk_t handler = &complete_symbol;
+        if (CHUNK_TARGETS[kind] & CHUNK_WORD)
+        {
+            handler = &complete_text;
+        }
+        else if (CHUNK_TARGETS[kind] & CHUNK_SPACE)
+        {
+            handler = &complete_result_type;
+        }
+
+        if (CHUNK_TARGETS[kind])
+        {
+            hashmap_set(maps->completion_chunks, (void*)kind, handler);
+        }
+    }
+}
+
+static void free_maps(maps_t* maps)
+{
+    hashmap_free(maps->completion_chunks);
+    hashmap_free(maps->kind_names);
+    hashmap_free(maps->kind_chars);
+}
+
+static char convert_maps(
+    const maps_t* maps,
+    const result_t* result,
+    arena_t* abbr,
+    arena_t* word)
+{
+    char kind = '\0';
+    void* kind_char;
+    if (hashmap_get(maps->kind_chars, (void*)(size_t)result->cursor_kind,
+        &kind_char))
+    {
+        kind = (char)(size_t)kind_char;
+    }
+
+    arena_begin(abbr);
+    void* kind_name;
+    if (hashmap_get(maps->kind_names, (void*)(size_t)result->cursor_kind,
+        &kind_name))
+    {
+        append(abbr, (const char*)kind_name);
+    }
+
+    arena_begin(word);
+    for (unsigned i = 0; i < CHUNKS_PER_RESULT; ++i)
+    {
+        void* chunk_fn;
+        if (hashmap_get(maps->completion_chunks,
+            (void*)(size_t)result->chunk_kinds[i], &chunk_fn))
+        {
+            (*(complete_chunk_t)chunk_fn)(abbr, word, result->chunk_texts[i]);
+        }
+    }
+    arena_end(word);
+    arena_end(abbr);
+
+    return kind;
+}
+
+static char convert_tables(
+    const result_t* result,
+    arena_t* abbr,
+    arena_t* word)
+{
+    unsigned cursor_kind = result->cursor_kind;
+    char kind =
+        cursor_kind < TABLE_SIZE(KIND_CHARS) ? KIND_CHARS[cursor_kind] : '\0';
+
+    arena_begin(abbr);
+    if (cursor_kind < TABLE_SIZE(KIND_NAMES) && KIND_NAMES[cursor_kind])
+    {
+        append(abbr, KIND_NAMES[cursor_kind]);
+    }
+
+    arena_begin(word);
+    for (unsigned i = 0; i < CHUNKS_PER_RESULT; ++i)
+    {
+        unsigned chunk_kind = result->chunk_kinds[i];
+        unsigned targets = chunk_kind < TABLE_SIZE(CHUNK_TARGETS)
+            ? CHUNK_TARGETS[chunk_kind]
+            : 0;
+
+        if (!targets)
+        {
+            continue;
+        }
+
+        const char* part = result->chunk_texts[i];
+        size_t part_size = strlen(part);
+        if (targets & CHUNK_WORD)
+        {
+            arena_append(word, part, part_size);
+        }
+        if (targets & CHUNK_ABBR)
+        {
+            arena_append(abbr, part, part_size);
+        }
+        if (targets & CHUNK_SPACE)
+        {
+            arena_append(abbr, " ", 1);
+        }
+    }
+    arena_end(word);
+    arena_end(abbr);
+
+    return kind;
+}
+
+static result_t* make_results(void)
+{
+    static const char* const TEXTS[] = {
+        "get_value", "int", "size_t index", "(", ")", ", ", "const", ""};
+
+    result_t* results = (result_t*)malloc(RESULTS * sizeof(result_t));
+    unsigned seed = 1;
+    for (size_t i = 0; i < RESULTS; ++i)
+    {
+        results[i].cursor_kind =
+            CURSOR_KINDS[next_random(&seed) % TABLE_SIZE(CURSOR_KINDS)];
+        for (unsigned j = 0; j < CHUNKS_PER_RESULT; ++j)
+        {
+            unsigned chunk = next_random(&seed) % TABLE_SIZE(CHUNK_KINDS);
+            results[i].chunk_kinds[j] = CHUNK_KINDS[chunk];
+            results[i].chunk_texts[j] = TEXTS[chunk];
+        }
+    }
+    return results;
+}
+
+int main(int argc, char* argv[])
+{
+    result_t* results = make_results();
+    arena_t* abbr = arena_alloc();
+    arena_t* word = arena_alloc();
+
+    maps_t maps;
+    init_maps(&maps);
+
+    // Both conversions must produce the same text.
+    size_t maps_size = 0;
+    size_t tables_size = 0;
+    unsigned maps_kinds = 0;
+    unsigned tables_kinds = 0;
+
+    double begin = now_ns();
+    for (size_t i = 0; i < RESULTS; ++i)
+    {
+        if (i % RESULTS_PER_REQUEST == 0)
+        {
+            maps_size += arena_size(abbr) + arena_size(word);
+            arena_reset(abbr);
+            arena_reset(word);
+        }
+        maps_kinds += convert_maps(&maps, &results[i], abbr, word);
+    }
+    double maps_ns = now_ns() - begin;
+    maps_size += arena_size(abbr) + arena_size(word);
+    arena_reset(abbr);
+    arena_reset(word);
+
+    begin = now_ns();
+    for (size_t i = 0; i < RESULTS; ++i)
+    {
+        if (i % RESULTS_PER_REQUEST == 0)
+        {
+            tables_size += arena_size(abbr) + arena_size(word);
+            arena_reset(abbr);
+            arena_reset(word);
+        }
+        tables_kinds += convert_tables(&results[i], abbr, word);
+    }
+    double tables_ns = now_ns() - begin;
+    tables_size += arena_size(abbr) + arena_size(word);
+
+    if (maps_size != tables_size || maps_kinds != tables_kinds)
+    {
+        fprintf(
+            stderr,
+            "conversions differ: %zu %zu bytes\n",
+            maps_size,
+            tables_size);
+    }
+
+    printf(
+        "%zu results, %d chunks each (ns/result)\n",
+        (size_t)RESULTS,
+        CHUNKS_PER_RESULT);
+    printf("%-8s %10.1f\n", "maps", maps_ns / RESULTS);
+    printf("%-8s %10.1f\n", "tables", tables_ns / RESULTS);
+
+    free_maps(&maps);
+    arena_free(word);
+    arena_free(abbr);
+    free(results);
+
+    return 0;
+}
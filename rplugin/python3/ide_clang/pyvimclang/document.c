@@ -0,0 +1,173 @@
+#include "document.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_CAPACITY 64
+
+typedef struct
+{
+    char* data;
+    size_t size;
+} line_t;
+
+struct document
+{
+    line_t* lines;
+    unsigned count;
+    unsigned capacity;
+    // Size of the text including '\n' of every line.
+    size_t size;
+    // Text built since the last edit, the document holds a reference to it.
+    document_text_t* text;
+};
+
+static line_t copy_line(const char* data, size_t size)
+{
+    line_t line = {.data = (char*)malloc(size + 1), .size = size};
+    memcpy(line.data, data, size);
+    line.data[size] = '\0';
+    return line;
+}
+
+static void reserve(document_t* document, unsigned count)
+{
+    if (count <= document->capacity)
+    {
+        return;
+    }
+
+    while (document->capacity < count)
+    {
+        document->capacity *= 2;
+    }
+    document->lines = (line_t*)realloc(
+        document->lines, sizeof(line_t) * document->capacity);
+}
+
+static void drop_text(document_t* document)
+{
+    if (document->text)
+    {
+        document_text_release(document->text);
+        document->text = NULL;
+    }
+}
+
+document_t* document_alloc(const char* content, size_t size)
+{
+    document_t* document = (document_t*)malloc(sizeof(document_t));
+    document->count = 0;
+    document->capacity = MIN_CAPACITY;
+    document->lines = (line_t*)malloc(sizeof(line_t) * document->capacity);
+    document->size = 0;
+    document->text = NULL;
+
+    const char* end = content + size;
+    for (const char* begin = content; begin < end;)
+    {
+        const char* eol = (const char*)memchr(begin, '\n', end - begin);
+        size_t line_size = (eol ? eol : end) - begin;
+
+        reserve(document, document->count + 1);
+        document->lines[document->count++] = copy_line(begin, line_size);
+        document->size += line_size + 1;
+
+        begin += line_size + 1;
+    }
+
+    return document;
+}
+
+void document_free(document_t* document)
+{
+    drop_text(document);
+    for (unsigned i = 0; i < document->count; ++i)
+    {
+        free(document->lines[i].data);
+    }
+    free(document->lines);
+    free(document);
+}
+
+bool document_set_lines(
+    document_t* document,
+    long first,
+    long last,
+    const char* const* lines,
+    unsigned nlines)
+{
+    long count = (long)document->count;
+    first = first < 0 ? count + 1 + first : first;
+    last = last < 0 ? count + 1 + last : last;
+    if (first < 0 || first > last || last > count)
+    {
+        return false;
+    }
+
+    drop_text(document);
+
+    for (long i = first; i < last; ++i)
+    {
+        document->size -= document->lines[i].size + 1;
+        free(document->lines[i].data);
+    }
+
+    unsigned new_count = document->count - (unsigned)(last - first) + nlines;
+    reserve(document, new_count);
+    memmove(
+        document->lines + first + nlines,
+        document->lines + last,
+        sizeof(line_t) * (document->count - last));
+    document->count = new_count;
+
+    for (unsigned i = 0; i < nlines; ++i)
+    {
+        line_t line = copy_line(lines[i], strlen(lines[i]));
+        document->size += line.size + 1;
+        document->lines[first + i] = line;
+    }
+
+    return true;
+}
+
+unsigned document_line_count(const document_t* document)
+{
+    return document->count;
+}
+
+document_text_t* document_text(document_t* document)
+{
+    if (!document->text)
+    {
+        // The text is stored right after its header.
+        document_text_t* text = (document_text_t*)malloc(
+            sizeof(document_text_t) + document->size + 1);
+        char* data = (char*)(text + 1);
+
+        char* out = data;
+        for (unsigned i = 0; i < document->count; ++i)
+        {
+            memcpy(out, document->lines[i].data, document->lines[i].size);
+            out += document->lines[i].size;
+            *out++ = '\n';
+        }
+        *out = '\0';
+
+        text->data = data;
+        text->size = document->size;
+        text->refs = 1;
+        document->text = text;
+    }
+
+    __atomic_add_fetch(&document->text->refs, 1, __ATOMIC_RELAXED);
+    return document->text;
+}
+
+void document_text_release(document_text_t* text)
+{
+    if (__atomic_sub_fetch(&text->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        free(text);
+    }
+}
@@ -0,0 +1,76 @@
+/**
+ * Mirror of an editor buffer updated by ranged line edits.
+ *
+ * Lines are stored separately, so an edit copies only the lines it changes.
+ * The contiguous text libclang needs is built on request and shared until the
+ * next edit. Documents are not thread safe, texts taken from them are.
+ */
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct document document_t;
+
+// Contiguous text of a document, every line is terminated by '\n'.
+typedef struct
+{
+    const char* data;
+    size_t size;
+    unsigned refs;
+} document_text_t;
+
+/**
+ * Allocate a new document with the content provided.
+ * @param  content document content.
+ * @param  size    content size in bytes.
+ * @return         the new document allocated.
+ */
+document_t* document_alloc(const char* content, size_t size);
+
+/**
+ * Deallocate the document provided, texts taken from it stay valid until
+ * released.
+ * @param document document to be deallocated.
+ */
+void document_free(document_t* document);
+
+/**
+ * Replace lines of the document like nvim_buf_set_lines. Negative indices
+ * count from the end, -1 is the index past the last line.
+ * @param  document the document.
+ * @param  first    index of the first line replaced.
+ * @param  last     index past the last line replaced.
+ * @param  lines    new lines without '\n'.
+ * @param  nlines   number of new lines.
+ * @return          true if the range is valid otherwise false.
+ */
+bool document_set_lines(
+    document_t* document,
+    long first,
+    long last,
+    const char* const* lines,
+    unsigned nlines);
+
+/**
+ * Get number of lines of the document provided.
+ * @param  document the document.
+ * @return          number of lines.
+ */
+unsigned document_line_count(const document_t* document);
+
+/**
+ * Get contiguous text of the document and take a reference to it.
+ * @param  document the document.
+ * @return          the text to be released with document_text_release.
+ */
+document_text_t* document_text(document_t* document);
+
+/**
+ * Release a reference to the text provided.
+ * @param text the text.
+ */
+void document_text_release(document_text_t* text);
+
+#endif // !DOCUMENT_H
@@ -0,0 +1,196 @@
+#include "filestate.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "hashmap.h"
+
+typedef struct
+{
+    char* filename;
+    file_state_t state;
+    // Size of the file hashed, a file of another size is read again even if
+    // its modification time is the same.
+    long long size;
+} cached_state_t;
+
+struct filestates
+{
+    pthread_mutex_t lock;
+    hashmap_t* states;
+};
+
+filestates_t* filestates_alloc(void)
+{
+    filestates_t* states = (filestates_t*)malloc(sizeof(filestates_t));
+    pthread_mutex_init(&states->lock, NULL);
+    states->states = hashmap_alloc(&string_hash, &string_equals);
+    return states;
+}
+
+static void free_state(void* ctx, const void* filename, void* data)
+{
+    cached_state_t* cached = (cached_state_t*)data;
+    free(cached->filename);
+    free(cached);
+}
+
+void filestates_free(filestates_t* states)
+{
+    hashmap_each(states->states, NULL, &free_state);
+    hashmap_free(states->states);
+    pthread_mutex_destroy(&states->lock);
+    free(states);
+}
+
+static bool stat_file(
+    const char* filename,
+    file_state_t* state,
+    long long* size)
+{
+    struct stat st;
+    if (stat(filename, &st) != 0)
+    {
+        return false;
+    }
+
+    state->device = (uint64_t)st.st_dev;
+    state->inode = (uint64_t)st.st_ino;
+    state->mtime =
+        (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    state->hash = 0;
+    *size = (long long)st.st_size;
+
+    return true;
+}
+
+static bool hash_file(const char* filename, uint64_t* hash)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    size_t capacity = 65536;
+    size_t size = 0;
+    char* content = (char*)malloc(capacity);
+    for (size_t read;
+        (read = fread(content + size, 1, capacity - size, file)) > 0;)
+    {
+        size += read;
+        if (size == capacity)
+        {
+            capacity *= 2;
+            content = (char*)realloc(content, capacity);
+        }
+    }
+
+    bool hashed = !ferror(file);
+    fclose(file);
+
+    // 0 means an unknown hash.
+    *hash = bytes_hash(content, size);
+    *hash = *hash ? *hash : 1;
+    free(content);
+
+    return hashed;
+}
+
+bool filestates_get(
+    filestates_t* states,
+    const char* filename,
+    file_state_t* state)
+{
+    long long size;
+    if (!stat_file(filename, state, &size))
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&states->lock);
+    void* found;
+    if (hashmap_get(states->states, filename, &found))
+    {
+        cached_state_t* cached = (cached_state_t*)found;
+        if (cached->state.device == state->device
+            && cached->state.inode == state->inode
+            && cached->state.mtime == state->mtime
+            && cached->size == size)
+        {
+            state->hash = cached->state.hash;
+        }
+    }
+    pthread_mutex_unlock(&states->lock);
+
+    if (state->hash)
+    {
+        return true;
+    }
+
+    // Files are hashed without the lock, so several threads can hash the
+    // same file at once, which is rare and harmless.
+    if (!hash_file(filename, &state->hash))
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&states->lock);
+    if (hashmap_get(states->states, filename, &found))
+    {
+        cached_state_t* cached = (cached_state_t*)found;
+        cached->state = *state;
+        cached->size = size;
+    }
+    else
+    {
+        cached_state_t* cached =
+            (cached_state_t*)malloc(sizeof(cached_state_t));
+        cached->filename = strdup(filename);
+        cached->state = *state;
+        cached->size = size;
+        hashmap_set(states->states, cached->filename, cached);
+    }
+    pthread_mutex_unlock(&states->lock);
+
+    return true;
+}
+
+bool filestates_changed(
+    filestates_t* states,
+    const char* filename,
+    const file_state_t* recorded)
+{
+    if (recorded->hash == 0)
+    {
+        return true;
+    }
+
+    file_state_t state;
+    long long size;
+    if (!stat_file(filename, &state, &size))
+    {
+        return true;
+    }
+
+    if (state.device == recorded->device
+        && state.inode == recorded->inode
+        && state.mtime == recorded->mtime)
+    {
+        return false;
+    }
+
+    return !filestates_get(states, filename, &state)
+        || state.hash != recorded->hash;
+}
+
+char* filestates_canonical_name(const char* filename)
+{
+    char path[PATH_MAX];
+    return strdup(realpath(filename, path) ? path : filename);
+}
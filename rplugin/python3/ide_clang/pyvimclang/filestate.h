@@ -0,0 +1,77 @@
+/**
+ * States of files on disk, used to tell if a file changed since it was
+ * indexed.
+ *
+ * A state is the unique ID of the file, its modification time and a hash of
+ * its content. A file with the same ID and modification time is unchanged
+ * without reading it, otherwise the content hash decides, so files rewritten
+ * with the same content, as git checkout does, are unchanged as well. Hashes
+ * are cached while files stay the same, so a header included by many
+ * sources is read once.
+ */
+#ifndef FILESTATE_H
+#define FILESTATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint64_t device;
+    uint64_t inode;
+    // Modification time in nanoseconds.
+    int64_t mtime;
+    // Hash of the content, 0 if unknown.
+    uint64_t hash;
+} file_state_t;
+
+typedef struct filestates filestates_t;
+
+/**
+ * Allocate a new empty cache of file states, the cache is thread safe.
+ * @return the new cache allocated.
+ */
+filestates_t* filestates_alloc(void);
+
+/**
+ * Deallocate the cache provided.
+ * @param states cache to be deallocated.
+ */
+void filestates_free(filestates_t* states);
+
+/**
+ * Get the current state of the file, the file is read if it changed since
+ * its state was cached.
+ * @param  states   the cache.
+ * @param  filename file name.
+ * @param  state    the state of the file.
+ * @return          true if the file can be read otherwise false.
+ */
+bool filestates_get(
+    filestates_t* states,
+    const char* filename,
+    file_state_t* state);
+
+/**
+ * Check if the file changed since the state recorded.
+ * @param  states   the cache.
+ * @param  filename file name.
+ * @param  recorded state of the file recorded before.
+ * @return          true if the file changed or cannot be read otherwise
+ *                  false.
+ */
+bool filestates_changed(
+    filestates_t* states,
+    const char* filename,
+    const file_state_t* recorded);
+
+/**
+ * Get the canonical name of the file, without symbolic links and "." or ".."
+ * components, so different names of the same file compare equal.
+ * @param  filename file name.
+ * @return          the canonical name to be freed, a copy of the name if it
+ *                  cannot be resolved.
+ */
+char* filestates_canonical_name(const char* filename);
+
+#endif // !FILESTATE_H
@@ -0,0 +1,124 @@
+#include "fuzzy.h"
+
+#include <stdbool.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define SCORE_MATCH 16
+#define SCORE_PREFIX 32
+#define SCORE_BOUNDARY 24
+#define SCORE_CONSECUTIVE 16
+#define SCORE_CASE 1
+#define PENALTY_GAP_MAX 16
+
+static char to_lower(char c)
+{
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static char to_upper(char c)
+{
+    return c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c;
+}
+
+static bool is_boundary(const char* text, unsigned i)
+{
+    char prev = text[i - 1];
+    char curr = text[i];
+    return prev == '_'
+        || (curr >= 'A' && curr <= 'Z' && prev >= 'a' && prev <= 'z');
+}
+
+// Find the first position of the character provided in either case, 16 bytes
+// are compared at once when SSE2 is available.
+static int find_char(const char* text, unsigned from, unsigned size, char c)
+{
+    char lower = to_lower(c);
+    char upper = to_upper(c);
+
+#ifdef __SSE2__
+    __m128i lowers = _mm_set1_epi8(lower);
+    __m128i uppers = _mm_set1_epi8(upper);
+
+    for (; from + 16 <= size; from += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(text + from));
+        int mask = _mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(chunk, lowers),
+            _mm_cmpeq_epi8(chunk, uppers)));
+
+        if (mask)
+        {
+            return (int)from + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; from < size; ++from)
+    {
+        if (text[from] == lower || text[from] == upper)
+        {
+            return (int)from;
+        }
+    }
+
+    return -1;
+}
+
+int fuzzy_match(
+    const char* query,
+    unsigned query_size,
+    const char* text,
+    unsigned text_size)
+{
+    if (query_size > text_size)
+    {
+        return FUZZY_NO_MATCH;
+    }
+
+    int score = 0;
+    unsigned from = 0;
+
+    for (unsigned i = 0; i < query_size; ++i)
+    {
+        int found = find_char(text, from, text_size, query[i]);
+        if (found < 0)
+        {
+            return FUZZY_NO_MATCH;
+        }
+
+        unsigned pos = (unsigned)found;
+        unsigned gap = pos - from;
+
+        score += SCORE_MATCH;
+
+        if (pos == 0)
+        {
+            score += SCORE_PREFIX;
+        }
+        else if (is_boundary(text, pos))
+        {
+            score += SCORE_BOUNDARY;
+        }
+
+        if (i > 0 && gap == 0)
+        {
+            score += SCORE_CONSECUTIVE;
+        }
+        else
+        {
+            score -= gap < PENALTY_GAP_MAX ? (int)gap : PENALTY_GAP_MAX;
+        }
+
+        if (text[pos] == query[i])
+        {
+            score += SCORE_CASE;
+        }
+
+        from = pos + 1;
+    }
+
+    return score > 0 ? score : 0;
+}
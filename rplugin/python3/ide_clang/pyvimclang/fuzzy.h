@@ -0,0 +1,27 @@
+/**
+ * Case insensitive fuzzy (subsequence) matching of completion candidates.
+ */
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#define FUZZY_NO_MATCH -1
+
+/**
+ * Match the query provided against the text as a case insensitive
+ * subsequence and score the match. Matches at the start of the text, at word
+ * boundaries ('_', camelCase) and consecutive matches score higher, gaps
+ * score lower.
+ * @param  query      query to match.
+ * @param  query_size query length.
+ * @param  text       candidate text.
+ * @param  text_size  candidate text length.
+ * @return            non negative score if the text matches the query
+ *                    otherwise FUZZY_NO_MATCH.
+ */
+int fuzzy_match(
+    const char* query,
+    unsigned query_size,
+    const char* text,
+    unsigned text_size);
+
+#endif // !FUZZY_H
@@ -0,0 +1,137 @@
+#include "hash.h"
+
+#include <string.h>
+
+// wyhash final version 4 secret.
+static const uint64_t SECRET[4] = {
+    0x2d358dccaa6c78a5ULL,
+    0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL,
+    0x4d5a2da51de1aa47ULL};
+
+// 128 bit product of a and b, low half in a and high half in b.
+static void mum(uint64_t* a, uint64_t* b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32;
+    uint64_t hb = *b >> 32;
+    uint64_t la = (uint32_t)*a;
+    uint64_t lb = (uint32_t)*b;
+    uint64_t rh = ha * hb;
+    uint64_t rm0 = ha * lb;
+    uint64_t rm1 = hb * la;
+    uint64_t rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static uint64_t mix(uint64_t a, uint64_t b)
+{
+    mum(&a, &b);
+    return a ^ b;
+}
+
+static uint64_t read64(const unsigned char* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t read32(const unsigned char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t read_small(const unsigned char* p, size_t k)
+{
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+static uint64_t wyhash(const void* key, size_t len, uint64_t seed)
+{
+    const unsigned char* p = (const unsigned char*)key;
+    uint64_t a;
+    uint64_t b;
+
+    seed ^= mix(seed ^ SECRET[0], SECRET[1]);
+
+    if (len <= 16)
+    {
+        if (len >= 4)
+        {
+            size_t shift = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + shift);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - shift);
+        }
+        else if (len > 0)
+        {
+            a = read_small(p, len);
+            b = 0;
+        }
+        else
+        {
+            a = b = 0;
+        }
+    }
+    else
+    {
+        size_t i = len;
+        if (i > 48)
+        {
+            uint64_t see1 = seed;
+            uint64_t see2 = seed;
+            do
+            {
+                seed = mix(read64(p) ^ SECRET[1], read64(p + 8) ^ seed);
+                see1 = mix(read64(p + 16) ^ SECRET[2], read64(p + 24) ^ see1);
+                see2 = mix(read64(p + 32) ^ SECRET[3], read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+
+        while (i > 16)
+        {
+            seed = mix(read64(p) ^ SECRET[1], read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+
+    a ^= SECRET[1];
+    b ^= seed;
+    mum(&a, &b);
+
+    return mix(a ^ SECRET[0] ^ len, b ^ SECRET[1]);
+}
+
+uint64_t string_hash(const void* string)
+{
+    return wyhash(string, strlen((const char*)string), 0);
+}
+
+uint64_t bytes_hash(const void* data, size_t size)
+{
+    return wyhash(data, size, 0);
+}
+
+bool string_equals(const void* a, const void* b)
+{
+    return strcmp(a, b) == 0;
+}
@@ -0,0 +1,35 @@
+/**
+ * Hash and equality functions for common hashmap keys.
+ */
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Hash function for null terminated string keys, wyhash is used so strings
+ * sharing a long prefix still get well spread hashes.
+ * @param  string the string.
+ * @return        hash of the string.
+ */
+uint64_t string_hash(const void* string);
+
+/**
+ * Hash of the bytes provided, computed with wyhash as well.
+ * @param  data the bytes.
+ * @param  size number of bytes.
+ * @return      hash of the bytes.
+ */
+uint64_t bytes_hash(const void* data, size_t size);
+
+/**
+ * Equality function for null terminated string keys.
+ * @param  a first string.
+ * @param  b second string.
+ * @return   true if the strings are equal otherwise false.
+ */
+bool string_equals(const void* a, const void* b);
+
+#endif // !HASH_H
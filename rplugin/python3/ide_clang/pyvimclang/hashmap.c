@@ -1,165 +1,392 @@
 #include "hashmap.h"
 
-#define SET_INITIAL_SIZE 4
-#define SET_INCREASE_FACTOR 2
-#define SET_DECREASE_FACTOR 2
+#include <stdint.h>
+#include <string.h>
 
-typedef struct bucket
-{
-    const void* key;
-    void* data;
-    struct bucket* next;
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-} bucket_t;
+#define GROUP_SIZE 16
+#define MIN_CAPACITY GROUP_SIZE
+// Number of slots of the old table migrated by every set and remove while
+// the map is resized.
+#define MIGRATE_SLOTS 64
 
-struct hashmap
+// Control byte of a slot: EMPTY, DELETED or the 7 low bits of the key hash
+// for a slot in use.
+#define CTRL_EMPTY ((int8_t)-128)
+#define CTRL_DELETED ((int8_t)-2)
+
+typedef struct
 {
-    bucket_t** buckets;
-    size_t length;
+    // Slots are split into groups of GROUP_SIZE, capacity is a power of 2.
+    int8_t* ctrl;
+    uint64_t* hashes;
+    const void** keys;
+    void** values;
+    size_t capacity;
     size_t size;
+    // Number of slots which can be filled before the table is rebuilt, the
+    // load factor is kept below 7/8.
+    size_t growth_left;
+} table_t;
+
+// A resize allocates the new table and moves entries of the old one a few
+// slots per set and remove, so no single call rehashes the whole map.
+// Lookups check both tables until the migration completes.
+struct hashmap
+{
+    table_t table;
+    table_t old;
+    size_t migrated;
     hash_t hash;
     equals_t equals;
 };
 
-hashmap_t* hashmap_alloc(hash_t hash, equals_t equals)
+static int8_t h2(uint64_t hash)
 {
-    hashmap_t* map = (hashmap_t*)malloc(sizeof(hashmap_t));
-    map->length = SET_INITIAL_SIZE;
-    map->size = 0;
-    map->hash = hash;
-    map->equals = equals;
-    map->buckets = (bucket_t**)calloc(map->length, sizeof(bucket_t*));
-    return map;
+    return (int8_t)(hash & 0x7F);
 }
 
-void hashmap_free(hashmap_t* map)
+static size_t max_load(size_t capacity)
+{
+    return capacity - capacity / 8;
+}
+
+// Bit i is set if ctrl[i] of the group equals the value provided.
+static unsigned match(const int8_t* group, int8_t value)
 {
-    for (size_t i = 0; i < map->length; ++i)
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return (unsigned)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(ctrl, _mm_set1_epi8(value)));
+#else
+    unsigned mask = 0;
+    for (unsigned i = 0; i < GROUP_SIZE; ++i)
     {
-        bucket_t* bucket = map->buckets[i];
+        mask |= (unsigned)(group[i] == value) << i;
+    }
+    return mask;
+#endif
+}
 
-        while (bucket != NULL)
-        {
-            bucket_t* removing = bucket;
-            bucket = bucket->next;
-            free(removing);
-        }
+// Bit i is set if the slot i of the group is empty or deleted.
+static unsigned match_free(const int8_t* group)
+{
+#ifdef __SSE2__
+    // Only EMPTY and DELETED have the sign bit set.
+    return (unsigned)_mm_movemask_epi8(
+        _mm_loadu_si128((const __m128i*)group));
+#else
+    unsigned mask = 0;
+    for (unsigned i = 0; i < GROUP_SIZE; ++i)
+    {
+        mask |= (unsigned)(group[i] < 0) << i;
     }
+    return mask;
+#endif
+}
 
-    free(map->buckets);
-    free(map);
+static unsigned first_bit(unsigned mask)
+{
+    return (unsigned)__builtin_ctz(mask);
+}
+
+static void table_init(table_t* table, size_t capacity)
+{
+    table->capacity = capacity;
+    table->size = 0;
+    table->growth_left = max_load(capacity);
+    table->ctrl = (int8_t*)malloc(capacity);
+    memset(table->ctrl, CTRL_EMPTY, capacity);
+    table->hashes = (uint64_t*)malloc(sizeof(uint64_t) * capacity);
+    table->keys = (const void**)malloc(sizeof(void*) * capacity);
+    table->values = (void**)malloc(sizeof(void*) * capacity);
 }
 
-static void hashmap_resize(hashmap_t* map, size_t new_length)
+static void table_free(table_t* table)
 {
-    size_t old_length = map->length;
-    bucket_t** old_buckets = map->buckets;
+    free(table->ctrl);
+    free(table->hashes);
+    free(table->keys);
+    free(table->values);
+    table->ctrl = NULL;
+    table->capacity = 0;
+    table->size = 0;
+}
 
-    map->size = 0;
-    map->length = new_length;
-    map->buckets = (bucket_t**)calloc(map->length, sizeof(bucket_t*));
+// Groups are probed quadratically: group, group + 1, group + 3, ...
+static size_t table_find(
+    table_t* table,
+    equals_t equals,
+    const void* key,
+    uint64_t hash)
+{
+    size_t mask = table->capacity / GROUP_SIZE - 1;
+    size_t group = (hash >> 7) & mask;
+    int8_t tag = h2(hash);
 
-    for (size_t i = 0; i < old_length; ++i)
+    for (size_t step = 1;; ++step)
     {
-        bucket_t* bucket = old_buckets[i];
+        const int8_t* ctrl = table->ctrl + group * GROUP_SIZE;
 
-        while (bucket != NULL)
+        for (unsigned m = match(ctrl, tag); m; m &= m - 1)
         {
-            hashmap_set(map, bucket->key, bucket->data);
-            bucket = bucket->next;
+            size_t slot = group * GROUP_SIZE + first_bit(m);
+            if (table->hashes[slot] == hash && equals(table->keys[slot], key))
+            {
+                return slot;
+            }
         }
+
+        if (match(ctrl, CTRL_EMPTY))
+        {
+            return table->capacity;
+        }
+
+        group = (group + step) & mask;
+    }
+}
+
+// Insert a key known to be missing, the table should have growth left.
+static void table_insert(
+    table_t* table,
+    uint64_t hash,
+    const void* key,
+    void* data)
+{
+    size_t mask = table->capacity / GROUP_SIZE - 1;
+    size_t group = (hash >> 7) & mask;
+
+    unsigned m;
+    for (size_t step = 1;
+        !(m = match_free(table->ctrl + group * GROUP_SIZE));
+        ++step)
+    {
+        group = (group + step) & mask;
     }
 
-    free(old_buckets);
+    size_t slot = group * GROUP_SIZE + first_bit(m);
+    if (table->ctrl[slot] == CTRL_EMPTY)
+    {
+        --table->growth_left;
+    }
+
+    table->ctrl[slot] = h2(hash);
+    table->hashes[slot] = hash;
+    table->keys[slot] = key;
+    table->values[slot] = data;
+    ++table->size;
+}
+
+static void table_erase(table_t* table, size_t slot)
+{
+    // Probes stop at a group with an empty slot and never pass it, so the
+    // slot can become empty again instead of a tombstone.
+    int8_t* group = table->ctrl + slot / GROUP_SIZE * GROUP_SIZE;
+    if (match(group, CTRL_EMPTY))
+    {
+        table->ctrl[slot] = CTRL_EMPTY;
+        ++table->growth_left;
+    }
+    else
+    {
+        table->ctrl[slot] = CTRL_DELETED;
+    }
+    --table->size;
+}
+
+static bool is_migrating(hashmap_t* map)
+{
+    return map->old.capacity != 0;
 }
 
-static bucket_t** hashmap_find(hashmap_t* map, const void* key)
+// Move entries of the next slots of the old table to the new one.
+static void migrate(hashmap_t* map, size_t nslots)
 {
-    bucket_t** bucket = &(map->buckets[map->hash(key) % map->length]);
+    table_t* old = &map->old;
+    size_t end = map->migrated + nslots < old->capacity
+        ? map->migrated + nslots
+        : old->capacity;
 
-    while (*bucket != NULL && !map->equals((*bucket)->key, key))
+    for (size_t i = map->migrated; i < end; ++i)
     {
-        bucket = &((*bucket)->next);
+        if (old->ctrl[i] >= 0)
+        {
+            table_insert(
+                &map->table, old->hashes[i], old->keys[i], old->values[i]);
+            old->ctrl[i] = CTRL_DELETED;
+            --old->size;
+        }
     }
 
-    return bucket;
+    map->migrated = end;
+    if (end == old->capacity)
+    {
+        table_free(old);
+    }
 }
 
-void hashmap_set(hashmap_t* map, const void* key, void* data)
+// Start moving entries to a new table with the capacity provided, a
+// migration in progress is completed first.
+static void start_resize(hashmap_t* map, size_t capacity)
+{
+    if (is_migrating(map))
+    {
+        migrate(map, map->old.capacity);
+    }
+
+    map->old = map->table;
+    map->migrated = 0;
+    table_init(&map->table, capacity);
+}
+
+hashmap_t* hashmap_alloc(hash_t hash, equals_t equals)
 {
-    if (map->size == map->length / SET_INCREASE_FACTOR)
+    hashmap_t* map = (hashmap_t*)malloc(sizeof(hashmap_t));
+    map->hash = hash;
+    map->equals = equals;
+    table_init(&map->table, MIN_CAPACITY);
+    map->old.ctrl = NULL;
+    map->old.capacity = 0;
+    map->old.size = 0;
+    map->migrated = 0;
+    return map;
+}
+
+void hashmap_free(hashmap_t* map)
+{
+    table_free(&map->table);
+    if (is_migrating(map))
     {
-        hashmap_resize(map, map->length * SET_INCREASE_FACTOR);
+        table_free(&map->old);
     }
+    free(map);
+}
 
-    bucket_t** bucket = hashmap_find(map, key);
+void hashmap_set(hashmap_t* map, const void* key, void* data)
+{
+    uint64_t hash = map->hash(key);
+    table_t* table = &map->table;
 
-    if (*bucket == NULL)
+    size_t slot = table_find(table, map->equals, key, hash);
+    if (slot != table->capacity)
     {
-        *bucket = (bucket_t*)malloc(sizeof(bucket_t));
-        (*bucket)->key = key;
-        (*bucket)->data = data;
-        (*bucket)->next = NULL;
-        ++map->size;
+        table->values[slot] = data;
+        return;
     }
-    else
+
+    if (is_migrating(map))
     {
-        (*bucket)->data = data;
+        // The key keeps its original pointer when it moves to the new table.
+        slot = table_find(&map->old, map->equals, key, hash);
+        if (slot != map->old.capacity)
+        {
+            key = map->old.keys[slot];
+            table_erase(&map->old, slot);
+        }
+        migrate(map, MIGRATE_SLOTS);
     }
+
+    if (table->growth_left == 0)
+    {
+        size_t size = table->size + map->old.size;
+        // Rebuild at the same size if the table is mostly deleted slots.
+        start_resize(
+            map,
+            size * 2 < max_load(table->capacity)
+                ? table->capacity
+                : table->capacity * 2);
+        migrate(map, MIGRATE_SLOTS);
+    }
+
+    table_insert(table, hash, key, data);
 }
 
 bool hashmap_get(hashmap_t* map, const void* key, void** data)
 {
-    bool result = false;
-    bucket_t** bucket = hashmap_find(map, key);
+    uint64_t hash = map->hash(key);
 
-    if (*bucket != NULL)
+    table_t* table = &map->table;
+    size_t slot = table_find(table, map->equals, key, hash);
+
+    if (slot == table->capacity && is_migrating(map))
+    {
+        table = &map->old;
+        slot = table_find(table, map->equals, key, hash);
+    }
+
+    if (slot == table->capacity)
     {
-        *data = (*bucket)->data;
-        result = true;
+        return false;
     }
 
-    return result;
+    *data = table->values[slot];
+    return true;
 }
 
 bool hashmap_remove(hashmap_t* map, const void* key)
 {
-    if (map->size == map->length / SET_DECREASE_FACTOR)
+    uint64_t hash = map->hash(key);
+
+    table_t* table = &map->table;
+    size_t slot = table_find(table, map->equals, key, hash);
+
+    if (slot == table->capacity && is_migrating(map))
     {
-        hashmap_resize(map, map->length / SET_DECREASE_FACTOR);
+        table = &map->old;
+        slot = table_find(table, map->equals, key, hash);
     }
 
-    bucket_t** bucket = hashmap_find(map, key);
+    if (slot == table->capacity)
+    {
+        return false;
+    }
 
-    bool result = false;
+    table_erase(table, slot);
 
-    if (*bucket != NULL)
+    if (is_migrating(map))
+    {
+        migrate(map, MIGRATE_SLOTS);
+    }
+    // The map grows at 7/8 load and shrinks below 1/8, so alternating sets
+    // and removes around a size never resize back and forth.
+    else if (map->table.capacity > MIN_CAPACITY
+        && map->table.size < map->table.capacity / 8)
     {
-        bucket_t* removing = *bucket;
-        *bucket = (*bucket)->next;
-        free(removing);
-        --map->size;
-        result = true;
+        start_resize(map, map->table.capacity / 2);
+        migrate(map, MIGRATE_SLOTS);
     }
 
-    return result;
+    return true;
 }
 
 size_t hashmap_size(hashmap_t* map)
 {
-    return map->size;
+    return map->table.size + map->old.size;
 }
 
-void hashmap_each(hashmap_t* map, void* ctx,
-                  void (*action)(void*, const void*, void*))
+static void table_each(
+    table_t* table,
+    void* ctx,
+    void (*action)(void*, const void*, void*))
 {
-    for (size_t i = 0; i < map->length; ++i)
+    for (size_t i = 0; i < table->capacity; ++i)
     {
-        bucket_t* bucket = map->buckets[i];
-        while (bucket)
+        if (table->ctrl[i] >= 0)
         {
-            (*action)(ctx, bucket->key, bucket->data);
-            bucket = bucket->next;
+            (*action)(ctx, table->keys[i], table->values[i]);
         }
     }
 }
+
+void hashmap_each(hashmap_t* map, void* ctx,
+                  void (*action)(void*, const void*, void*))
+{
+    table_each(&map->table, ctx, action);
+    if (is_migrating(map))
+    {
+        table_each(&map->old, ctx, action);
+    }
+}
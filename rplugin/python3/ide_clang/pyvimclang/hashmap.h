@@ -1,6 +1,9 @@
 /**
- * Simple buckets based hashmap implementation.
+ * Hashmap with open addressing.
  *
+ * hashmap.c probes groups of 16 slots at once with SSE2 in the manner of
+ * Swiss tables, hashmap_chained.c is the former buckets based implementation
+ * kept as a reference for hashmap_bench.c.
  *
  * May 31 2017 Vladimir Bogretsov <bogrecov@gmail.com>
  */
@@ -8,15 +11,19 @@
 #define hashmap_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
-typedef int (*hash_t)(const void*);
+#include "hash.h"
+
+typedef uint64_t (*hash_t)(const void*);
 typedef bool (*equals_t)(const void*, const void*);
 
 typedef struct hashmap hashmap_t;
 
 /**
- * Allocate a new hashmap.
+ * Allocate a new hashmap. Hashes of keys are computed once and kept with the
+ * keys, all the 64 bits are used so the hash function should spread them.
  * @param  hash   hash function.
  * @param  equals equality function.
  * @return        the new hashmap allocated.
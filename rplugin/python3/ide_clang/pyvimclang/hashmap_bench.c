@@ -0,0 +1,144 @@
+/**
+ * Benchmark of hashmap operations on path like string keys.
+ *
+ * Build against the open addressing and the chained implementations to
+ * compare them:
+ *   gcc -O2 -I. -o hashmap_bench hashmap_bench.c hashmap.c hash.c
+ *   gcc -O2 -I. -o hashmap_bench_chained hashmap_bench.c hashmap_chained.c \
+ *       hash.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hashmap.h"
+
+#define KEY_SIZE 96
+// Small maps are filled several times, so every measurement runs at least
+// this number of operations.
+#define MIN_OPERATIONS 2000000
+
+static const size_t SIZES[] = {10, 100, 1000, 10000, 100000, 1000000};
+
+static double now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+// Keys share a long prefix like paths in a big source tree.
+static char* make_keys(size_t n, const char* kind)
+{
+    char* keys = (char*)malloc(n * KEY_SIZE);
+    for (size_t i = 0; i < n; ++i)
+    {
+        snprintf(
+            keys + i * KEY_SIZE,
+            KEY_SIZE,
+            "/home/user/projects/monorepo/src/module%zu/%s%zu.cpp",
+            i % 97,
+            kind,
+            i);
+    }
+    return keys;
+}
+
+static void run(size_t n)
+{
+    char* keys = make_keys(n, "source");
+    char* missing = make_keys(n, "header");
+    size_t rounds = n < MIN_OPERATIONS ? MIN_OPERATIONS / n : 1;
+
+    double set_ns = 0;
+    double hit_ns = 0;
+    double miss_ns = 0;
+    double remove_ns = 0;
+    double max_set_ns = 0;
+    size_t found = 0;
+
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        hashmap_t* map = hashmap_alloc(&string_hash, &string_equals);
+
+        double begin = now_ns();
+        for (size_t i = 0; i < n; ++i)
+        {
+            hashmap_set(map, keys + i * KEY_SIZE, (void*)(keys + i));
+        }
+        set_ns += now_ns() - begin;
+
+        void* data;
+        begin = now_ns();
+        for (size_t i = 0; i < n; ++i)
+        {
+            found += hashmap_get(map, keys + i * KEY_SIZE, &data);
+        }
+        hit_ns += now_ns() - begin;
+
+        begin = now_ns();
+        for (size_t i = 0; i < n; ++i)
+        {
+            found += hashmap_get(map, missing + i * KEY_SIZE, &data);
+        }
+        miss_ns += now_ns() - begin;
+
+        begin = now_ns();
+        for (size_t i = 0; i < n; ++i)
+        {
+            hashmap_remove(map, keys + i * KEY_SIZE);
+        }
+        remove_ns += now_ns() - begin;
+
+        hashmap_free(map);
+    }
+
+    // The slowest single set shows pauses caused by resizing.
+    hashmap_t* map = hashmap_alloc(&string_hash, &string_equals);
+    for (size_t i = 0; i < n; ++i)
+    {
+        double begin = now_ns();
+        hashmap_set(map, keys + i * KEY_SIZE, (void*)(keys + i));
+        double elapsed = now_ns() - begin;
+        max_set_ns = elapsed > max_set_ns ? elapsed : max_set_ns;
+    }
+    hashmap_free(map);
+
+    if (found != n * rounds)
+    {
+        fprintf(stderr, "unexpected lookups: %zu\n", found);
+    }
+
+    double ops = (double)n * rounds;
+    printf(
+        "%8zu %10.1f %10.1f %10.1f %10.1f %12.1f\n",
+        n,
+        set_ns / ops,
+        hit_ns / ops,
+        miss_ns / ops,
+        remove_ns / ops,
+        max_set_ns);
+
+    free(keys);
+    free(missing);
+}
+
+int main(int argc, char* argv[])
+{
+    printf(
+        "%8s %10s %10s %10s %10s %12s  (ns/op)\n",
+        "size",
+        "set",
+        "get hit",
+        "get miss",
+        "remove",
+        "slowest set");
+
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); ++i)
+    {
+        run(SIZES[i]);
+    }
+
+    return 0;
+}
@@ -1,13 +1,24 @@
 #include "ide.h"
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <clang-c/Index.h>
 
+#include "astcache.h"
+#include "compdb.h"
+#include "document.h"
+#include "filestate.h"
+#include "fuzzy.h"
 #include "hashmap.h"
+#include "indexer.h"
 #include "libclang.h"
+#include "pool.h"
+#include "symindex.h"
 
 static const unsigned TRANSLATION_OPTIONS =
     CXTranslationUnit_PrecompiledPreamble
@@ -19,13 +30,296 @@ static const unsigned COMPLETION_OPTIONS =
     | CXCodeComplete_IncludeBriefComments
     | CXCodeComplete_IncludeCodePatterns;
 
-typedef void (*complete_chunk_t)(
-    completion_t*,
-    unsigned*,
-    unsigned*,
-    unsigned*,
-    unsigned*,
-    const char*);
+// Weight of the fuzzy match score against clang completion priority, where
+// lower priority values are better.
+static const int SCORE_WEIGHT = 4;
+
+// Milliseconds without changes of a buffer before it is reparsed.
+static const double REPARSE_DELAY = 300.0;
+
+// Where the text of a completion chunk goes.
+enum
+{
+    CHUNK_WORD = 1,
+    CHUNK_ABBR = 2,
+    CHUNK_SPACE = 4
+};
+
+static const char KIND_CHARS[] = {
+    [CXCursor_StructDecl] = 't',
+    [CXCursor_UnionDecl] = 't',
+    [CXCursor_EnumConstantDecl] = 't',
+    [CXCursor_EnumDecl] = 't',
+    [CXCursor_TypedefDecl] = 't',
+    [CXCursor_ClassTemplate] = 't',
+    [CXCursor_ClassDecl] = 't',
+    [CXCursor_ConversionFunction] = 'f',
+    [CXCursor_FunctionTemplate] = 'f',
+    [CXCursor_FunctionDecl] = 'f',
+    [CXCursor_Constructor] = 'm',
+    [CXCursor_Destructor] = 'm',
+    [CXCursor_CXXMethod] = 'm',
+    [CXCursor_FieldDecl] = 'm',
+    [CXCursor_VarDecl] = 'v',
+    [CXCursor_TemplateTypeParameter] = 'p',
+    [CXCursor_ParmDecl] = 's',
+    [CXCursor_PreprocessingDirective] = 'D',
+    [CXCursor_MacroDefinition] = 'M'};
+
+static const char* const KIND_NAMES[] = {
+    [CXCursor_StructDecl] = "struct ",
+    [CXCursor_UnionDecl] = "union ",
+    [CXCursor_EnumConstantDecl] = "enum ",
+    [CXCursor_EnumDecl] = "enum ",
+    [CXCursor_TypedefDecl] = "typedef ",
+    [CXCursor_ClassTemplate] = "class ",
+    [CXCursor_ClassDecl] = "class "};
+
+static const unsigned char CHUNK_TARGETS[] = {
+    [CXCompletionChunk_TypedText] = CHUNK_WORD | CHUNK_ABBR,
+    [CXCompletionChunk_Text] = CHUNK_WORD | CHUNK_ABBR,
+    [CXCompletionChunk_ResultType] = CHUNK_ABBR | CHUNK_SPACE,
+    [CXCompletionChunk_Placeholder] = CHUNK_ABBR,
+    [CXCompletionChunk_LeftParen] = CHUNK_ABBR,
+    [CXCompletionChunk_RightParen] = CHUNK_ABBR,
+    [CXCompletionChunk_LeftBracket] = CHUNK_ABBR,
+    [CXCompletionChunk_RightBracket] = CHUNK_ABBR,
+    [CXCompletionChunk_LeftBrace] = CHUNK_ABBR,
+    [CXCompletionChunk_RightBrace] = CHUNK_ABBR,
+    [CXCompletionChunk_LeftAngle] = CHUNK_ABBR,
+    [CXCompletionChunk_RightAngle] = CHUNK_ABBR,
+    [CXCompletionChunk_Comma] = CHUNK_ABBR,
+    [CXCompletionChunk_Colon] = CHUNK_ABBR,
+    [CXCompletionChunk_SemiColon] = CHUNK_ABBR,
+    [CXCompletionChunk_Equal] = CHUNK_ABBR,
+    [CXCompletionChunk_HorizontalSpace] = CHUNK_ABBR,
+    [CXCompletionChunk_VerticalSpace] = CHUNK_ABBR};
+
+#define TABLE_SIZE(table) (sizeof(table) / sizeof(table[0]))
+
+typedef struct
+{
+    char* typed_text;
+    unsigned size;
+    unsigned priority;
+} candidate_t;
+
+typedef struct
+{
+    unsigned index;
+    int rank;
+} ranked_t;
+
+// Completion results shared by the cache of a unit and requests converting
+// them without the unit locked, freed once the last of them is done. The
+// references are guarded by ide->lock.
+typedef struct
+{
+    CXCodeCompleteResults* results;
+    candidate_t* candidates;
+    unsigned refs;
+} completion_results_t;
+
+// Completion results computed at the completion start point, requests which
+// only extend the typed prefix are answered by filtering them.
+typedef struct
+{
+    completion_results_t* results;
+    unsigned line;
+    unsigned column;
+    unsigned generation;
+} completion_cache_t;
+
+// Position in the main file of a unit where a symbol is written.
+typedef struct
+{
+    unsigned line;
+    unsigned column;
+} write_site_t;
+
+typedef struct
+{
+    write_site_t* items;
+    unsigned size;
+    unsigned capacity;
+} write_sites_t;
+
+// Write sites of every symbol written in the main file of a unit keyed by
+// USR, the AST is visited once per generation of the tu.
+typedef struct
+{
+    hashmap_t* sites;
+    unsigned generation;
+} writes_cache_t;
+
+// Name extent of a declaration or reference in the main file of a unit,
+// the end is past the last character of the name.
+typedef struct
+{
+    unsigned begin_line;
+    unsigned begin_column;
+    unsigned end_line;
+    unsigned end_column;
+    // Visit order, nested cursors come later.
+    unsigned order;
+    CXCursor cursor;
+} cursor_extent_t;
+
+// Name extents of a unit sorted by their beginning, built once per
+// generation of the tu to find cursors at positions without clang_getCursor
+// walking the AST.
+typedef struct
+{
+    cursor_extent_t* items;
+    unsigned size;
+    unsigned capacity;
+    unsigned generation;
+    bool built;
+} cursor_index_t;
+
+// Units are shared between threads: ide->lock guards the units map, status
+// and refs of every unit, unit->lock serializes libclang calls on the tu.
+typedef struct
+{
+    char* filename;
+    CXTranslationUnit tu;
+    ide_status_t status;
+    unsigned refs;
+    unsigned generation;
+    // The tu is loaded from the AST cache and cannot be used for completion
+    // until the source is parsed in background.
+    bool preloaded;
+    size_t memory;
+    unsigned long last_access;
+    completion_cache_t cache;
+    writes_cache_t writes;
+    cursor_index_t cursors;
+    // Mirror of the editor buffer, NULL until the buffer is sent. The file
+    // is dirty if the buffer differs from the file on disk.
+    document_t* document;
+    bool dirty;
+    // now_ms() time of the debounced reparse, 0 if none is pending.
+    double reparse_at;
+    // now_ms() time the parse was queued and milliseconds it took until the
+    // preamble was built, negative while the unit is cold.
+    double parse_queued_at;
+    double warm_after;
+    pthread_mutex_t lock;
+} unit_t;
+
+typedef struct
+{
+    unit_t* lru;
+    unit_t* mru;
+} lru_search_t;
+
+typedef struct
+{
+    ide_t* ide;
+    unit_t* unit;
+} parse_task_t;
+
+typedef struct
+{
+    ide_t* ide;
+    char* filename;
+} index_task_t;
+
+// Locations found in one translation unit by a references search.
+typedef struct location_list
+{
+    location_t* items;
+    unsigned size;
+    unsigned capacity;
+    struct location_list* next;
+} location_list_t;
+
+// Search of references in open translation units running on the parse pool,
+// lists of units searched are passed to the caller thread.
+typedef struct
+{
+    ide_t* ide;
+    const char* usr;
+    pthread_mutex_t lock;
+    pthread_cond_t searched;
+    unsigned pending;
+    location_list_t* found;
+    // Names of the files searched, references in other files are taken from
+    // the project index.
+    hashmap_t* files;
+    void* ctx;
+    void (*onreference)(void*, location_t*);
+} references_search_t;
+
+typedef struct
+{
+    references_search_t* search;
+    unit_t* unit;
+} references_task_t;
+
+typedef struct
+{
+    ide_t* ide;
+    location_list_t* list;
+} references_visit_t;
+
+typedef struct
+{
+    ide_t* ide;
+    const char* usr;
+    CXCursor cursor;
+    bool found;
+} usr_search_t;
+
+typedef struct
+{
+    ide_t* ide;
+    CXTranslationUnit tu;
+    hashmap_t* sites;
+} writes_visit_t;
+
+typedef struct
+{
+    ide_t* ide;
+    CXFile file;
+    cursor_index_t* index;
+} cursors_visit_t;
+
+// The first two and the last children of a cursor.
+typedef struct
+{
+    CXCursor first;
+    CXCursor second;
+    CXCursor last;
+    unsigned size;
+} children_t;
+
+// Modified buffers passed to libclang instead of the files on disk, along
+// with the document texts they point to.
+typedef struct
+{
+    struct CXUnsavedFile* files;
+    document_text_t** texts;
+    unsigned size;
+} unsaved_t;
+
+// Compilation database shared by parses looking up flags, freed once the
+// last of them is done when it is replaced. The references are guarded by
+// ide->lock.
+typedef struct
+{
+    compdb_t* db;
+    unsigned refs;
+} shared_compdb_t;
+
+// Compiler flags of a file, owned if they come from the compilation
+// database.
+typedef struct
+{
+    const char* const* items;
+    unsigned size;
+    char** owned;
+} flags_t;
 
 struct ide
 {
@@ -33,197 +327,451 @@ struct ide
     unsigned nflags;
     CXIndex index;
     libclang_t* libclang;
+    pool_t* pool;
+    // Reference searches run on their own threads so they do not wait for
+    // queued parses.
+    pool_t* search_pool;
+    pthread_mutex_t lock;
+    pthread_cond_t parsed;
+    size_t memory;
+    size_t memory_budget;
+    unsigned long clock;
+    astcache_t* cache;
+    shared_compdb_t* compdb;
+    pool_t* index_pool;
+    symindex_t* symbols;
+    filestates_t* file_states;
+    unsigned index_pending;
+    void* stage_ctx;
+    void (*onstage)(void*, ide_stage_t, double);
+    // Thread queueing reparses of changed buffers once they settle.
+    pthread_t debouncer;
+    pthread_cond_t changed;
+    bool stopping;
     hashmap_t* units;
-    hashmap_t* kind_chars;
-    hashmap_t* kind_names;
-    hashmap_t* completion_chunks;
 };
 
-static int string_hash(const void* string)
+static double now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static double stage_begin(ide_t* ide)
+{
+    return ide->onstage ? now_ms() : 0.0;
+}
+
+static void stage_end(ide_t* ide, ide_stage_t stage, double begin)
+{
+    if (ide->onstage)
+    {
+        (*ide->onstage)(ide->stage_ctx, stage, now_ms() - begin);
+    }
+}
+
+static void release_completion_results(
+    ide_t* ide,
+    completion_results_t* results)
+{
+    pthread_mutex_lock(&ide->lock);
+    bool last = --results->refs == 0;
+    pthread_mutex_unlock(&ide->lock);
+
+    if (last)
+    {
+        for (unsigned i = 0; i < results->results->NumResults; ++i)
+        {
+            free(results->candidates[i].typed_text);
+        }
+        free(results->candidates);
+        ide->libclang->dispose_completion(results->results);
+        free(results);
+    }
+}
+
+static void release_compdb(ide_t* ide, shared_compdb_t* compdb)
 {
-    int hash = 1;
+    pthread_mutex_lock(&ide->lock);
+    bool last = --compdb->refs == 0;
+    pthread_mutex_unlock(&ide->lock);
 
-    for (char const* p = string; p != NULL && *p != '\0'; ++p)
+    if (last)
     {
-        hash = (hash << 1) ^ *p;
+        compdb_free(compdb->db);
+        free(compdb);
     }
+}
 
-    return hash;
+static void clear_completion_cache(ide_t* ide, completion_cache_t* cache)
+{
+    if (cache->results)
+    {
+        release_completion_results(ide, cache->results);
+        cache->results = NULL;
+    }
 }
 
-static bool string_equals(const void* a, const void* b)
+static void free_write_sites(void* ctx, const void* usr, void* data)
 {
-    return strcmp(a, b) == 0;
+    write_sites_t* sites = (write_sites_t*)data;
+    free(sites->items);
+    free(sites);
+    free((void*)usr);
 }
 
-static int unsigned_hash(const void* value)
+static void clear_writes_cache(writes_cache_t* cache)
 {
-    return (unsigned)value;
+    if (cache->sites)
+    {
+        hashmap_each(cache->sites, NULL, &free_write_sites);
+        hashmap_free(cache->sites);
+        cache->sites = NULL;
+    }
 }
 
-static bool unsigned_equals(const void* a, const void* b)
+static void release_unit(ide_t* ide, unit_t* unit)
 {
-    return (unsigned)a == (unsigned)b;
+    pthread_mutex_lock(&ide->lock);
+    bool last = --unit->refs == 0;
+    if (last)
+    {
+        ide->memory -= unit->memory;
+    }
+    pthread_mutex_unlock(&ide->lock);
+
+    if (last)
+    {
+        clear_completion_cache(ide, &unit->cache);
+        clear_writes_cache(&unit->writes);
+        free(unit->cursors.items);
+        if (unit->tu)
+        {
+            ide->libclang->dispose_tu(unit->tu);
+        }
+        pthread_mutex_destroy(&unit->lock);
+        if (unit->document)
+        {
+            document_free(unit->document);
+        }
+        free(unit->filename);
+        free(unit);
+    }
 }
 
 static void dispose_unit(void* ctx, const void* filename, void* unit)
 {
-    free((void*)filename);
-    ((ide_t*)ctx)->libclang->dispose_tu((CXTranslationUnit)unit);
+    release_unit((ide_t*)ctx, (unit_t*)unit);
+}
+
+static size_t measure_tu(ide_t* ide, CXTranslationUnit tu)
+{
+    CXTUResourceUsage usage = ide->libclang->get_tu_resource_usage(tu);
+
+    size_t memory = 0;
+    for (unsigned i = 0; i < usage.numEntries; ++i)
+    {
+        memory += usage.entries[i].amount;
+    }
+
+    ide->libclang->dispose_tu_resource_usage(usage);
+
+    return memory;
 }
 
-static hashmap_t* init_kind_chars()
+static void find_lru_unit(void* ctx, const void* filename, void* data)
 {
-    hashmap_t* map = hashmap_alloc(&unsigned_hash, &unsigned_equals);
+    lru_search_t* search = (lru_search_t*)ctx;
+    unit_t* unit = (unit_t*)data;
+
+    if (unit->status != IDE_OK)
+    {
+        return;
+    }
 
-    hashmap_set(map, (void*)CXCursor_StructDecl, (void*)'t');
-    hashmap_set(map, (void*)CXCursor_UnionDecl, (void*)'t');
-    hashmap_set(map, (void*)CXCursor_EnumConstantDecl, (void*)'t');
-    hashmap_set(map, (void*)CXCursor_EnumDecl, (void*)'t');
-    hashmap_set(map, (void*)CXCursor_TypedefDecl, (void*)'t');
-    hashmap_set(map, (void*)CXCursor_ClassTemplate, (void*)'t');
-    hashmap_set(map, (void*)CXCursor_ClassDecl, (void*)'t');
-    hashmap_set(map, (void*)CXCursor_ConversionFunction, (void*)'f');
-    hashmap_set(map, (void*)CXCursor_FunctionTemplate, (void*)'f');
-    hashmap_set(map, (void*)CXCursor_FunctionDecl, (void*)'f');
-    hashmap_set(map, (void*)CXCursor_Constructor, (void*)'m');
-    hashmap_set(map, (void*)CXCursor_Destructor, (void*)'m');
-    hashmap_set(map, (void*)CXCursor_CXXMethod, (void*)'m');
-    hashmap_set(map, (void*)CXCursor_FieldDecl, (void*)'m');
-    hashmap_set(map, (void*)CXCursor_VarDecl, (void*)'v');
-    hashmap_set(map, (void*)CXCursor_TemplateTypeParameter, (void*)'p');
-    hashmap_set(map, (void*)CXCursor_ParmDecl, (void*)'s');
-    hashmap_set(map, (void*)CXCursor_PreprocessingDirective, (void*)'D');
-    hashmap_set(map, (void*)CXCursor_MacroDefinition, (void*)'M');
+    if (!search->mru || unit->last_access > search->mru->last_access)
+    {
+        search->mru = unit;
+    }
 
-    return map;
+    // Units referenced by anything but the units map are in use.
+    if (unit->refs == 1
+        && (!search->lru || unit->last_access < search->lru->last_access))
+    {
+        search->lru = unit;
+    }
 }
 
-static hashmap_t* init_kind_names()
+// Dispose translation units of the least recently used files until their
+// memory fits the budget. The most recently used unit is always kept, evicted
+// units are parsed again when requested.
+static void enforce_memory_budget(ide_t* ide)
 {
-    hashmap_t* map = hashmap_alloc(&unsigned_hash, &unsigned_equals);
+    for (;;)
+    {
+        pthread_mutex_lock(&ide->lock);
+
+        lru_search_t search = {.lru = NULL, .mru = NULL};
+        if (ide->memory_budget && ide->memory > ide->memory_budget)
+        {
+            hashmap_each(ide->units, &search, &find_lru_unit);
+        }
 
-    hashmap_set(map, (void*)CXCursor_StructDecl, (void*)"struct ");
-    hashmap_set(map, (void*)CXCursor_UnionDecl, (void*)"union ");
-    hashmap_set(map, (void*)CXCursor_EnumConstantDecl, (void*)"enum ");
-    hashmap_set(map, (void*)CXCursor_EnumDecl, (void*)"enum ");
-    hashmap_set(map, (void*)CXCursor_TypedefDecl, (void*)"typedef ");
-    hashmap_set(map, (void*)CXCursor_ClassTemplate, (void*)"class ");
-    hashmap_set(map, (void*)CXCursor_ClassDecl, (void*)"class ");
+        unit_t* unit = search.lru;
+        if (!unit || unit == search.mru)
+        {
+            pthread_mutex_unlock(&ide->lock);
+            return;
+        }
+
+        CXTranslationUnit tu = unit->tu;
+        completion_cache_t cache = unit->cache;
+        unit->tu = NULL;
+        unit->cache.results = NULL;
+        unit->status = IDE_EVICTED;
+        ide->memory -= unit->memory;
+        unit->memory = 0;
+
+        pthread_mutex_unlock(&ide->lock);
 
-    return map;
+        clear_completion_cache(ide, &cache);
+        ide->libclang->dispose_tu(tu);
+    }
 }
 
-static void buffcpy(
-    char buff[],
-    unsigned* buff_pos,
-    unsigned buff_size,
-    const char* str)
+static void add_unsaved(void* ctx, const void* filename, void* data)
 {
-    unsigned i = 0;
-    for (;i < buff_size && str[i] != '\0'; ++i)
+    unsaved_t* unsaved = (unsaved_t*)ctx;
+    unit_t* unit = (unit_t*)data;
+
+    if (unit->dirty)
     {
-        buff[*buff_pos + i] = str[i];
+        document_text_t* text = document_text(unit->document);
+        unsaved->texts[unsaved->size] = text;
+        unsaved->files[unsaved->size++] = (struct CXUnsavedFile){
+            .Filename = strdup(unit->filename),
+            .Contents = text->data,
+            .Length = text->size};
     }
+}
 
-    buff[*buff_pos + i] = '\0';
-    *buff_pos += i;
+// Take texts of modified buffers of all open files, buffers can change or be
+// closed while libclang reads them.
+static void collect_unsaved(ide_t* ide, unsaved_t* unsaved)
+{
+    pthread_mutex_lock(&ide->lock);
+    size_t nunits = hashmap_size(ide->units) + 1;
+    unsaved->files =
+        (struct CXUnsavedFile*)malloc(sizeof(struct CXUnsavedFile) * nunits);
+    unsaved->texts =
+        (document_text_t**)malloc(sizeof(document_text_t*) * nunits);
+    unsaved->size = 0;
+    hashmap_each(ide->units, unsaved, &add_unsaved);
+    pthread_mutex_unlock(&ide->lock);
 }
 
-static void complete_typed_text(
-    completion_t* completion,
-    unsigned* abrr_i,
-    unsigned* word_i,
-    unsigned* menu_i,
-    unsigned* sort_i,
-    const char* part)
+// Use the content provided for the file instead of its modified buffer, or
+// add it if the buffer is not modified. There is room for one more file than
+// collect_unsaved takes.
+static void override_unsaved(
+    unsaved_t* unsaved,
+    const char* filename,
+    const char* content,
+    unsigned size)
 {
-    buffcpy(completion->word, word_i, WORD_SIZE, part);
-    buffcpy(completion->abbr, abrr_i, ABBR_SIZE, part);
-    buffcpy(completion->sort, sort_i, SORT_SIZE, part);
+    unsigned i = 0;
+    while (i < unsaved->size
+        && strcmp(unsaved->files[i].Filename, filename) != 0)
+    {
+        ++i;
+    }
+
+    if (i == unsaved->size)
+    {
+        unsaved->texts[unsaved->size] = NULL;
+        unsaved->files[unsaved->size++].Filename = strdup(filename);
+    }
+
+    unsaved->files[i].Contents = content;
+    unsaved->files[i].Length = size;
 }
 
-static void complete_text(
-    completion_t* completion,
-    unsigned* abrr_i,
-    unsigned* word_i,
-    unsigned* menu_i,
-    unsigned* sort_i,
-    const char* part)
+static void free_unsaved(unsaved_t* unsaved)
 {
-    buffcpy(completion->word, word_i, WORD_SIZE, part);
-    buffcpy(completion->abbr, abrr_i, ABBR_SIZE, part);
-    buffcpy(completion->sort, sort_i, SORT_SIZE, part);
+    for (unsigned i = 0; i < unsaved->size; ++i)
+    {
+        free((void*)unsaved->files[i].Filename);
+        if (unsaved->texts[i])
+        {
+            document_text_release(unsaved->texts[i]);
+        }
+    }
+    free(unsaved->files);
+    free(unsaved->texts);
 }
 
-static void complete_placeholder(
-    completion_t* completion,
-    unsigned* abrr_i,
-    unsigned* word_i,
-    unsigned* menu_i,
-    unsigned* sort_i,
-    const char* part)
+// Reparse the unit against the modified buffers, the caller should hold a
+// reference to the parsed unit. A warm up reparse follows the initial parse
+// to build the preamble and runs a throwaway completion, so the first
+// completion requested does not pay for them.
+static void reparse_unit(ide_t* ide, unit_t* unit, bool warm_up)
 {
-    // buffcpy(completion->word, word_i, WORD_SIZE, "<#");
-    // buffcpy(completion->word, word_i, WORD_SIZE, part);
-    // buffcpy(completion->word, word_i, WORD_SIZE, "#>");
-    buffcpy(completion->abbr, abrr_i, ABBR_SIZE, part);
+    unsaved_t unsaved;
+    collect_unsaved(ide, &unsaved);
+
+    pthread_mutex_lock(&unit->lock);
+
+    // The tu is gone if another reparse failed meanwhile.
+    if (!unit->tu)
+    {
+        pthread_mutex_unlock(&unit->lock);
+        free_unsaved(&unsaved);
+        return;
+    }
+
+    double begin = stage_begin(ide);
+    int error = ide->libclang->reparse_tu(
+        unit->tu, unsaved.size, unsaved.files, TRANSLATION_OPTIONS);
+    if (warm_up && !error)
+    {
+        CXCodeCompleteResults* completions = ide->libclang->complete_at(
+            unit->tu,
+            unit->filename,
+            1,
+            1,
+            unsaved.files,
+            unsaved.size,
+            COMPLETION_OPTIONS);
+        if (completions)
+        {
+            ide->libclang->dispose_completion(completions);
+        }
+    }
+    stage_end(ide, warm_up ? IDE_STAGE_WARM_UP : IDE_STAGE_REPARSE, begin);
+
+    // A tu which failed to reparse can only be disposed, so the unit fails.
+    CXTranslationUnit failed_tu = NULL;
+    completion_cache_t failed_cache = {.results = NULL};
+    size_t memory = 0;
+    if (error)
+    {
+        failed_tu = unit->tu;
+        failed_cache = unit->cache;
+        unit->tu = NULL;
+        unit->cache.results = NULL;
+    }
+    else
+    {
+        memory = measure_tu(ide, unit->tu);
+    }
+    ++unit->generation;
+
+    pthread_mutex_lock(&ide->lock);
+    ide->memory += memory - unit->memory;
+    unit->memory = memory;
+    if (error)
+    {
+        unit->status = IDE_FAILED;
+    }
+    else if (warm_up)
+    {
+        unit->warm_after = now_ms() - unit->parse_queued_at;
+    }
+    pthread_mutex_unlock(&ide->lock);
+
+    pthread_mutex_unlock(&unit->lock);
+
+    free_unsaved(&unsaved);
+    clear_completion_cache(ide, &failed_cache);
+    if (failed_tu)
+    {
+        ide->libclang->dispose_tu(failed_tu);
+    }
 }
 
-static void complete_result_type(
-    completion_t* completion,
-    unsigned* abrr_i,
-    unsigned* word_i,
-    unsigned* menu_i,
-    unsigned* sort_i,
-    const char* part)
+static void run_reparse(void* ctx)
 {
-    buffcpy(completion->abbr, abrr_i, ABBR_SIZE, part);
-    buffcpy(completion->abbr, abrr_i, ABBR_SIZE, " ");
+    parse_task_t* task = (parse_task_t*)ctx;
+    ide_t* ide = task->ide;
+    unit_t* unit = task->unit;
+    free(task);
+
+    reparse_unit(ide, unit, false);
+
+    release_unit(ide, unit);
+    enforce_memory_budget(ide);
 }
 
-static void complete_symbol(
-    completion_t* completion,
-    unsigned* abrr_i,
-    unsigned* word_i,
-    unsigned* menu_i,
-    unsigned* sort_i,
-    const char* part)
+static void find_next_reparse(void* ctx, const void* filename, void* data)
 {
-    // buffcpy(completion->word, word_i, WORD_SIZE, part);
-    buffcpy(completion->abbr, abrr_i, ABBR_SIZE, part);
+    unit_t** next = (unit_t**)ctx;
+    unit_t* unit = (unit_t*)data;
+
+    if (unit->reparse_at > 0
+        && (!*next || unit->reparse_at < (*next)->reparse_at))
+    {
+        *next = unit;
+    }
 }
 
-static hashmap_t* init_completion_chunks()
+// Queue reparse of every changed unit once its buffer stays unchanged for
+// REPARSE_DELAY.
+static void* debounce(void* ctx)
 {
-    hashmap_t* map = hashmap_alloc(&unsigned_hash, &unsigned_equals);
+    ide_t* ide = (ide_t*)ctx;
+
+    pthread_mutex_lock(&ide->lock);
+    while (!ide->stopping)
+    {
+        unit_t* unit = NULL;
+        hashmap_each(ide->units, &unit, &find_next_reparse);
+
+        if (!unit)
+        {
+            pthread_cond_wait(&ide->changed, &ide->lock);
+            continue;
+        }
 
-    hashmap_set(map, (void*)CXCompletionChunk_TypedText, &complete_typed_text);
-    hashmap_set(map, (void*)CXCompletionChunk_Text, &complete_text);
-    hashmap_set(map, (void*)CXCompletionChunk_ResultType, &complete_result_type);
-    hashmap_set(map, (void*)CXCompletionChunk_Placeholder, &complete_placeholder);
-    hashmap_set(map, (void*)CXCompletionChunk_LeftParen, &complete_symbol);
-    hashmap_set(map, (void*)CXCompletionChunk_RightParen, &complete_symbol);
-    hashmap_set(map, (void*)CXCompletionChunk_LeftBracket, &complete_symbol);
-    hashmap_set(map, (void*)CXCompletionChunk_RightBracket, &complete_symbol);
-    hashmap_set(map, (void*)CXCompletionChunk_LeftBrace, &complete_symbol);
-    hashmap_set(map, (void*)CXCompletionChunk_RightBrace, &complete_symbol);
-    hashmap_set(map, (void*)CXCompletionChunk_LeftAngle, &complete_symbol);
-    hashmap_set(map, (void*)CXCompletionChunk_RightAngle, &complete_symbol);
-    hashmap_set(map, (void*)CXCompletionChunk_Comma, &complete_symbol);
-    hashmap_set(map, (void*)CXCompletionChunk_Colon, &complete_symbol);
-    hashmap_set(map, (void*)CXCompletionChunk_SemiColon, &complete_symbol);
-    hashmap_set(map, (void*)CXCompletionChunk_Equal, &complete_symbol);
-    hashmap_set(map, (void*)CXCompletionChunk_HorizontalSpace, &complete_symbol);
-    hashmap_set(map, (void*)CXCompletionChunk_VerticalSpace, &complete_symbol);
+        double now = now_ms();
+        if (unit->reparse_at > now)
+        {
+            struct timespec deadline;
+            deadline.tv_sec = (time_t)(unit->reparse_at / 1e3);
+            deadline.tv_nsec =
+                (long)((unit->reparse_at - deadline.tv_sec * 1e3) * 1e6);
+            pthread_cond_timedwait(&ide->changed, &ide->lock, &deadline);
+            continue;
+        }
+
+        if (unit->status == IDE_PARSING)
+        {
+            // Try again when the initial parse completes.
+            unit->reparse_at = now + REPARSE_DELAY;
+            continue;
+        }
+
+        // Evicted and failed units are parsed from scratch when requested.
+        unit->reparse_at = 0;
+        if (unit->status == IDE_OK && !unit->preloaded)
+        {
+            ++unit->refs;
+            parse_task_t* task = (parse_task_t*)malloc(sizeof(parse_task_t));
+            task->ide = ide;
+            task->unit = unit;
+            pool_submit(ide->pool, task, &run_reparse);
+        }
+    }
+    pthread_mutex_unlock(&ide->lock);
 
-    return map;
+    return NULL;
 }
 
 ide_t* ide_alloc(
     const char* libclang_path,
     const char* const* flags,
-    unsigned nflags)
+    unsigned nflags,
+    unsigned nthreads)
 {
     libclang_t* libclang = libclang_load(libclang_path);
 
@@ -238,174 +786,2084 @@ ide_t* ide_alloc(
     ide->flags = flags;
     ide->nflags = nflags;
     ide->index = libclang->create_index(1, 0);
+    ide->pool = pool_alloc(nthreads);
+    ide->search_pool = pool_alloc(nthreads);
+    pthread_mutex_init(&ide->lock, NULL);
+    pthread_cond_init(&ide->parsed, NULL);
+    ide->memory = 0;
+    ide->memory_budget = 0;
+    ide->clock = 0;
+    ide->cache = NULL;
+    ide->compdb = NULL;
+    ide->index_pool = pool_alloc(0);
+    ide->symbols = symindex_alloc();
+    ide->file_states = filestates_alloc();
+    ide->index_pending = 0;
+    ide->stage_ctx = NULL;
+    ide->onstage = NULL;
     ide->units = hashmap_alloc(&string_hash, &string_equals);
-    ide->kind_chars = init_kind_chars();
-    ide->kind_names = init_kind_names();
-    ide->completion_chunks = init_completion_chunks();
+
+    // Reparse deadlines are in now_ms() time.
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ide->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    ide->stopping = false;
+    pthread_create(&ide->debouncer, NULL, &debounce, ide);
 
     return ide;
 }
 
 void ide_free(ide_t* ide)
 {
-    hashmap_free(ide->completion_chunks);
-    hashmap_free(ide->kind_names);
-    hashmap_free(ide->kind_chars);
+    pthread_mutex_lock(&ide->lock);
+    ide->stopping = true;
+    pthread_cond_signal(&ide->changed);
+    pthread_mutex_unlock(&ide->lock);
+    pthread_join(ide->debouncer, NULL);
+
+    // Wait for pending parses before units are released, queued indexing is
+    // cancelled by the stopping flag.
+    pool_free(ide->pool);
+    pool_free(ide->search_pool);
+    pool_free(ide->index_pool);
+    symindex_free(ide->symbols);
+    filestates_free(ide->file_states);
     hashmap_each(ide->units, ide, &dispose_unit);
     hashmap_free(ide->units);
+    if (ide->cache)
+    {
+        astcache_free(ide->cache);
+    }
+    if (ide->compdb)
+    {
+        release_compdb(ide, ide->compdb);
+    }
+    pthread_cond_destroy(&ide->changed);
+    pthread_cond_destroy(&ide->parsed);
+    pthread_mutex_destroy(&ide->lock);
     ide->libclang->dispose_index(ide->index);
     libclang_close(ide->libclang);
     free(ide);
 }
 
-void ide_on_file_open(ide_t* ide, const char* filename)
+void ide_set_memory_budget(ide_t* ide, size_t budget)
 {
-    void* unit;
-    if (hashmap_get(ide->units, filename, &unit))
+    pthread_mutex_lock(&ide->lock);
+    ide->memory_budget = budget;
+    pthread_mutex_unlock(&ide->lock);
+
+    enforce_memory_budget(ide);
+}
+
+bool ide_set_cache_dir(ide_t* ide, const char* path)
+{
+    astcache_t* cache = astcache_alloc(ide->libclang, path);
+    if (!cache)
     {
-        return;
+        return false;
     }
 
-    unit = ide->libclang->parse_tu(
-        ide->index,
-        filename,
-        ide->flags,
-        ide->nflags,
-        NULL,
-        0,
-        TRANSLATION_OPTIONS);
+    pthread_mutex_lock(&ide->lock);
+    astcache_t* old = ide->cache;
+    ide->cache = cache;
+    pthread_mutex_unlock(&ide->lock);
 
-    if (!unit)
+    // Files are opened only after the cache is configured.
+    if (old)
     {
-        // TODO: add error details.
-        return ;
+        astcache_free(old);
     }
 
-    const char* key = strdup(filename);
-    hashmap_set(ide->units, key, unit);
+    return true;
 }
 
-void ide_on_file_close(ide_t* ide, const char* filename)
+bool ide_set_compilation_database(ide_t* ide, const char* dir)
 {
-    void* unit;
-    if (!hashmap_get(ide->units, filename, &unit))
+    compdb_t* db = compdb_alloc(ide->libclang, dir);
+    if (!db)
+    {
+        return false;
+    }
+
+    shared_compdb_t* compdb =
+        (shared_compdb_t*)malloc(sizeof(shared_compdb_t));
+    compdb->db = db;
+    compdb->refs = 1;
+
+    pthread_mutex_lock(&ide->lock);
+    shared_compdb_t* old = ide->compdb;
+    ide->compdb = compdb;
+    pthread_mutex_unlock(&ide->lock);
+
+    // Parses in progress keep the database they took.
+    if (old)
     {
-        ide->libclang->dispose_tu((CXTranslationUnit)unit);
+        release_compdb(ide, old);
     }
+
+    return true;
 }
 
-void ide_on_file_save(ide_t* ide, const char* filename)
+// Get flags of the file from the compilation database, the global flags are
+// used for files missing in it.
+static void get_flags(ide_t* ide, const char* filename, flags_t* flags)
 {
-    void* unit;
-    if (!hashmap_get(ide->units, filename, &unit))
+    pthread_mutex_lock(&ide->lock);
+    shared_compdb_t* compdb = ide->compdb;
+    if (compdb)
+    {
+        ++compdb->refs;
+    }
+    pthread_mutex_unlock(&ide->lock);
+
+    flags->items = ide->flags;
+    flags->size = ide->nflags;
+    flags->owned = NULL;
+
+    if (!compdb)
+    {
+        return;
+    }
+
+    if (compdb_get_flags(compdb->db, filename, &flags->owned, &flags->size))
+    {
+        flags->items = (const char* const*)flags->owned;
+    }
+
+    release_compdb(ide, compdb);
+}
+
+static void free_flags(flags_t* flags)
+{
+    if (flags->owned)
     {
-        ide->libclang->reparse_tu(
-            (CXTranslationUnit)unit,
-            0,
-            NULL,
-            TRANSLATION_OPTIONS);
+        compdb_free_flags(flags->owned, flags->size);
     }
 }
 
-static void read_completion(
+void ide_set_stage_handler(
     ide_t* ide,
-    CXCompletionResult* result,
     void* ctx,
-    void (*oncompletion)(void*, completion_t*))
+    void (*onstage)(void*, ide_stage_t, double))
 {
-    completion_t completion;
-    completion.abbr[0] = '\0';
-    completion.word[0] = '\0';
-    completion.menu[0] = '\0';
-    completion.sort[0] = '\0';
+    ide->stage_ctx = ctx;
+    ide->onstage = onstage;
+}
 
-    unsigned abbr_i = 0;
-    unsigned word_i = 0;
-    unsigned menu_i = 0;
-    unsigned sort_i = 0;
+// Replace the unit translation unit with the one provided, a NULL tu keeps
+// the preloaded one if any.
+static void publish_unit(
+    ide_t* ide,
+    unit_t* unit,
+    CXTranslationUnit tu,
+    bool preloaded)
+{
+    size_t memory = tu ? measure_tu(ide, tu) : 0;
 
-    void* kind_char;
-    if (hashmap_get(ide->kind_chars, (void*)result->CursorKind, &kind_char))
-    {
-        completion.kind = (char)kind_char;
-    }
+    pthread_mutex_lock(&unit->lock);
+    pthread_mutex_lock(&ide->lock);
 
-    void* kind_name;
-    if (hashmap_get(ide->kind_names, (void*)result->CursorKind, &kind_name))
+    // A tu preloaded from the AST cache cannot be reparsed or completed, so
+    // it is dropped if its source fails to parse.
+    CXTranslationUnit old_tu = NULL;
+    completion_cache_t old_cache = {.results = NULL};
+    if (tu || (!preloaded && unit->preloaded))
     {
-        buffcpy(completion.abbr, &abbr_i, ABBR_SIZE, (char*)kind_name);
+        old_tu = unit->tu;
+        old_cache = unit->cache;
+        unit->tu = tu;
+        unit->cache.results = NULL;
+        ++unit->generation;
+        ide->memory += memory - unit->memory;
+        unit->memory = memory;
     }
 
-    CXCompletionString comp_string = result->CompletionString;
-    unsigned num_chunks =
-        ide->libclang->get_num_completion_chunks(comp_string);
+    // TODO: add error details.
+    unit->status = unit->tu ? IDE_OK : IDE_FAILED;
+    unit->preloaded = preloaded;
+    unit->last_access = ++ide->clock;
+    pthread_cond_broadcast(&ide->parsed);
+    pthread_mutex_unlock(&ide->lock);
 
-    for (unsigned i = 0; i < num_chunks; ++i)
+    pthread_mutex_unlock(&unit->lock);
+
+    clear_completion_cache(ide, &old_cache);
+    if (old_tu)
     {
-        CXString chunk_text =
-            ide->libclang->get_completion_chunk_text(comp_string, i);
+        ide->libclang->dispose_tu(old_tu);
+    }
+}
 
-        enum CXCompletionChunkKind chunk_kind =
-            ide->libclang->get_completion_chunk_kind(comp_string, i);
+static void parse_unit(void* ctx)
+{
+    parse_task_t* task = (parse_task_t*)ctx;
+    ide_t* ide = task->ide;
+    unit_t* unit = task->unit;
+    free(task);
 
-        const char* part = ide->libclang->get_string(chunk_text);
+    pthread_mutex_lock(&ide->lock);
+    astcache_t* cache = ide->cache;
+    pthread_mutex_unlock(&ide->lock);
 
-        void* chunk_fn;
-        if (hashmap_get(ide->completion_chunks, (void*)chunk_kind, &chunk_fn))
+    flags_t flags;
+    get_flags(ide, unit->filename, &flags);
+
+    // A valid AST cache entry makes the file available for navigation at
+    // once, the source is still parsed as completion needs a full tu.
+    bool cached = false;
+    if (cache)
+    {
+        CXTranslationUnit tu = astcache_load(
+            cache, ide->index, unit->filename, flags.items, flags.size);
+        if (tu)
         {
-            (*(complete_chunk_t)chunk_fn)(
-                &completion, &abbr_i, &word_i, &menu_i, &sort_i, part);
+            publish_unit(ide, unit, tu, true);
+            cached = true;
         }
+    }
 
-        ide->libclang->dispose_string(chunk_text);
+    double begin = stage_begin(ide);
+    CXTranslationUnit tu = ide->libclang->parse_tu(
+        ide->index,
+        unit->filename,
+        flags.items,
+        flags.size,
+        NULL,
+        0,
+        TRANSLATION_OPTIONS);
+    stage_end(ide, IDE_STAGE_PARSE, begin);
+
+    // Missing or stale entries are rebuilt from the parsed tu, it is saved
+    // before publishing while no other thread can use it.
+    if (cache && tu && !cached)
+    {
+        astcache_save(cache, tu, unit->filename, flags.items, flags.size);
     }
 
-    (*oncompletion)(ctx, &completion);
-}
+    free_flags(&flags);
 
-// NOTE: this method should be general and operate native clang API types, but
-// we're doing this completer only for VIM and for simplicity and performance
-// reasons we're translating clang completions to VIM complete-item here.
-void ide_find_completions(
+    publish_unit(ide, unit, tu, false);
+
+    if (tu)
+    {
+        reparse_unit(ide, unit, true);
+    }
+
+    release_unit(ide, unit);
+    enforce_memory_budget(ide);
+}
+
+// Queue parsing of the unit, ide->lock must be held.
+static void schedule_parse(ide_t* ide, unit_t* unit)
+{
+    unit->status = IDE_PARSING;
+    unit->parse_queued_at = now_ms();
+    unit->warm_after = -1;
+    ++unit->refs;
+
+    parse_task_t* task = (parse_task_t*)malloc(sizeof(parse_task_t));
+    task->ide = ide;
+    task->unit = unit;
+    pool_submit(ide->pool, task, &parse_unit);
+}
+
+void ide_on_file_open(ide_t* ide, const char* filename)
+{
+    pthread_mutex_lock(&ide->lock);
+
+    void* found;
+    if (hashmap_get(ide->units, filename, &found))
+    {
+        pthread_mutex_unlock(&ide->lock);
+        return;
+    }
+
+    unit_t* unit = (unit_t*)malloc(sizeof(unit_t));
+    unit->filename = strdup(filename);
+    unit->tu = NULL;
+    // The units map owns a reference to the unit.
+    unit->refs = 1;
+    unit->generation = 0;
+    unit->preloaded = false;
+    unit->memory = 0;
+    unit->last_access = 0;
+    unit->cache.results = NULL;
+    unit->writes.sites = NULL;
+    unit->cursors = (cursor_index_t){
+        .items = NULL, .size = 0, .capacity = 0, .built = false};
+    unit->document = NULL;
+    unit->dirty = false;
+    unit->reparse_at = 0;
+    unit->parse_queued_at = 0;
+    unit->warm_after = -1;
+    pthread_mutex_init(&unit->lock, NULL);
+    hashmap_set(ide->units, unit->filename, unit);
+    schedule_parse(ide, unit);
+
+    pthread_mutex_unlock(&ide->lock);
+}
+
+static bool is_unit_pending(unit_t* unit, bool need_source)
+{
+    return unit->status == IDE_PARSING
+        || (need_source && unit->status == IDE_OK && unit->preloaded);
+}
+
+ide_status_t ide_file_status(ide_t* ide, const char* filename)
+{
+    ide_status_t status = IDE_NOT_FOUND;
+
+    pthread_mutex_lock(&ide->lock);
+    void* unit;
+    if (hashmap_get(ide->units, filename, &unit))
+    {
+        // A unit preloaded from the AST cache is parsing as completion
+        // waits for its source.
+        status = is_unit_pending((unit_t*)unit, true)
+            ? IDE_PARSING
+            : ((unit_t*)unit)->status;
+    }
+    pthread_mutex_unlock(&ide->lock);
+
+    return status;
+}
+
+bool ide_file_warm(ide_t* ide, const char* filename, double* elapsed)
+{
+    bool warm = false;
+
+    pthread_mutex_lock(&ide->lock);
+    void* found;
+    if (hashmap_get(ide->units, filename, &found))
+    {
+        unit_t* unit = (unit_t*)found;
+        warm = unit->status == IDE_OK && unit->warm_after >= 0;
+        *elapsed = unit->warm_after;
+    }
+    pthread_mutex_unlock(&ide->lock);
+
+    return warm;
+}
+
+void ide_on_file_close(ide_t* ide, const char* filename)
+{
+    pthread_mutex_lock(&ide->lock);
+    void* unit;
+    bool found = hashmap_get(ide->units, filename, &unit);
+    if (found)
+    {
+        hashmap_remove(ide->units, filename);
+    }
+    pthread_mutex_unlock(&ide->lock);
+
+    if (found)
+    {
+        release_unit(ide, (unit_t*)unit);
+    }
+}
+
+// Wait until the unit is parsed or the timeout expires, ide->lock must be
+// held. If need_source is set, a unit preloaded from the AST cache is pending
+// until its source is parsed.
+static ide_status_t wait_unit(
+    ide_t* ide,
+    unit_t* unit,
+    unsigned timeout,
+    bool need_source)
+{
+    if (is_unit_pending(unit, need_source) && timeout > 0)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout / 1000;
+        deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        while (is_unit_pending(unit, need_source))
+        {
+            if (pthread_cond_timedwait(
+                &ide->parsed, &ide->lock, &deadline) == ETIMEDOUT)
+            {
+                break;
+            }
+        }
+    }
+
+    return is_unit_pending(unit, need_source) ? IDE_PARSING : unit->status;
+}
+
+// Find a parsed unit and take a reference to it, the caller must release the
+// unit if IDE_OK is returned.
+static ide_status_t acquire_unit(
+    ide_t* ide,
+    const char* filename,
+    unsigned timeout,
+    bool need_source,
+    unit_t** unit)
+{
+    pthread_mutex_lock(&ide->lock);
+
+    void* found;
+    ide_status_t status = IDE_NOT_FOUND;
+    if (hashmap_get(ide->units, filename, &found))
+    {
+        if (((unit_t*)found)->status == IDE_EVICTED)
+        {
+            schedule_parse(ide, (unit_t*)found);
+        }
+
+        status = wait_unit(ide, (unit_t*)found, timeout, need_source);
+        if (status == IDE_OK)
+        {
+            *unit = (unit_t*)found;
+            ++(*unit)->refs;
+            (*unit)->last_access = ++ide->clock;
+        }
+    }
+
+    pthread_mutex_unlock(&ide->lock);
+
+    return status;
+}
+
+// Lock the unit taken with acquire_unit. Its tu is disposed if a parse or a
+// reparse failed since, then the unit is released and false is returned.
+static bool lock_acquired_unit(ide_t* ide, unit_t* unit)
+{
+    pthread_mutex_lock(&unit->lock);
+    if (unit->tu)
+    {
+        return true;
+    }
+
+    pthread_mutex_unlock(&unit->lock);
+    release_unit(ide, unit);
+    return false;
+}
+
+// Mark the unit buffer changed and schedule its reparse, ide->lock must be
+// held.
+static void touch_unit(ide_t* ide, unit_t* unit)
+{
+    unit->dirty = true;
+    unit->reparse_at = now_ms() + REPARSE_DELAY;
+    pthread_cond_signal(&ide->changed);
+}
+
+void ide_on_file_change(
     ide_t* ide,
     const char* filename,
-    unsigned line,
-    unsigned column,
     const char* content,
-    unsigned size,
+    size_t size)
+{
+    document_t* document = document_alloc(content, size);
+
+    pthread_mutex_lock(&ide->lock);
+
+    void* found;
+    if (hashmap_get(ide->units, filename, &found))
+    {
+        unit_t* unit = (unit_t*)found;
+        if (unit->document)
+        {
+            document_free(unit->document);
+        }
+        unit->document = document;
+        document = NULL;
+        touch_unit(ide, unit);
+    }
+
+    pthread_mutex_unlock(&ide->lock);
+
+    if (document)
+    {
+        document_free(document);
+    }
+}
+
+bool ide_on_lines_change(
+    ide_t* ide,
+    const char* filename,
+    long first,
+    long last,
+    const char* const* lines,
+    unsigned nlines)
+{
+    bool changed = false;
+
+    pthread_mutex_lock(&ide->lock);
+
+    void* found;
+    // Edits only apply to a mirror of the whole buffer.
+    if (hashmap_get(ide->units, filename, &found)
+        && ((unit_t*)found)->document)
+    {
+        unit_t* unit = (unit_t*)found;
+        changed = document_set_lines(
+            unit->document, first, last, lines, nlines);
+        if (changed)
+        {
+            touch_unit(ide, unit);
+        }
+    }
+
+    pthread_mutex_unlock(&ide->lock);
+
+    return changed;
+}
+
+static void index_dependent(void* ctx, const char* source)
+{
+    ide_index_files((ide_t*)ctx, &source, 1);
+}
+
+void ide_on_file_save(ide_t* ide, const char* filename)
+{
+    // The buffer matches the file now.
+    pthread_mutex_lock(&ide->lock);
+    void* found;
+    if (hashmap_get(ide->units, filename, &found))
+    {
+        unit_t* unit = (unit_t*)found;
+        unit->dirty = false;
+        unit->reparse_at = 0;
+    }
+    pthread_mutex_unlock(&ide->lock);
+
+    // Sources which are indexed from the file are out of date, the others
+    // are left as they are.
+    char* canonical = filestates_canonical_name(filename);
+    symindex_dependents(ide->symbols, canonical, ide, &index_dependent);
+    free(canonical);
+
+    unit_t* unit;
+    if (acquire_unit(ide, filename, 0, true, &unit) != IDE_OK)
+    {
+        return;
+    }
+
+    reparse_unit(ide, unit, false);
+
+    release_unit(ide, unit);
+    enforce_memory_budget(ide);
+}
+
+// Read the completion result into the arena, the word is built in the
+// scratch arena in the meantime since its chunks interleave with the abbr
+// ones.
+static void read_completion(
+    ide_t* ide,
+    CXCompletionResult* result,
+    arena_t* arena,
+    arena_t* scratch,
     void* ctx,
     void (*oncompletion)(void*, completion_t*))
 {
-    void* unit;
-    if (!hashmap_get(ide->units, filename, &unit))
+    CXCompletionString comp_string = result->CompletionString;
+    unsigned cursor_kind = result->CursorKind;
+
+    completion_t completion;
+    completion.kind =
+        cursor_kind < TABLE_SIZE(KIND_CHARS) ? KIND_CHARS[cursor_kind] : '\0';
+    completion.abbr = arena_begin(arena);
+    completion.priority =
+        ide->libclang->get_completion_priority(comp_string);
+
+    if (cursor_kind < TABLE_SIZE(KIND_NAMES) && KIND_NAMES[cursor_kind])
     {
-        // TODO: add error details.
-        return;
+        const char* name = KIND_NAMES[cursor_kind];
+        arena_append(arena, name, strlen(name));
+    }
+
+    unsigned num_chunks =
+        ide->libclang->get_num_completion_chunks(comp_string);
+
+    arena_reset(scratch);
+
+    for (unsigned i = 0; i < num_chunks; ++i)
+    {
+        unsigned chunk_kind =
+            ide->libclang->get_completion_chunk_kind(comp_string, i);
+        unsigned targets = chunk_kind < TABLE_SIZE(CHUNK_TARGETS)
+            ? CHUNK_TARGETS[chunk_kind]
+            : 0;
+
+        if (!targets)
+        {
+            continue;
+        }
+
+        CXString chunk_text =
+            ide->libclang->get_completion_chunk_text(comp_string, i);
+        const char* part = ide->libclang->get_string(chunk_text);
+
+        if (part)
+        {
+            size_t part_size = strlen(part);
+            if (targets & CHUNK_WORD)
+            {
+                arena_append(scratch, part, part_size);
+            }
+            if (targets & CHUNK_ABBR)
+            {
+                arena_append(arena, part, part_size);
+            }
+            if (targets & CHUNK_SPACE)
+            {
+                arena_append(arena, " ", 1);
+            }
+        }
+
+        ide->libclang->dispose_string(chunk_text);
+    }
+
+    arena_end(arena);
+
+    completion.word = arena_begin(arena);
+    if (arena_size(scratch) > 0)
+    {
+        arena_append(arena, arena_get(scratch, 0), arena_size(scratch));
+    }
+    arena_end(arena);
+
+    (*oncompletion)(ctx, &completion);
+}
+
+static bool is_identifier_char(char c)
+{
+    return (c >= 'a' && c <= 'z')
+        || (c >= 'A' && c <= 'Z')
+        || (c >= '0' && c <= '9')
+        || c == '_'
+        || (unsigned char)c >= 0x80;
+}
+
+// Find the column where the identifier under the cursor starts, i.e. the
+// point right after '.', '->', '::' or a space, and the prefix typed since.
+static unsigned find_completion_start(
+    const char* content,
+    unsigned size,
+    unsigned line,
+    unsigned column,
+    const char** prefix,
+    unsigned* prefix_size)
+{
+    unsigned offset = 0;
+    for (unsigned l = 1; l < line && offset < size; ++offset)
+    {
+        if (content[offset] == '\n')
+        {
+            ++l;
+        }
+    }
+
+    // A column past the end of the line must not take text of the next one.
+    unsigned line_end = offset;
+    while (line_end < size && content[line_end] != '\n')
+    {
+        ++line_end;
+    }
+
+    unsigned end = column > 0 ? offset + column - 1 : offset;
+    if (end > line_end)
+    {
+        end = line_end;
+    }
+
+    unsigned start = end;
+    while (start > offset && is_identifier_char(content[start - 1]))
+    {
+        --start;
+    }
+
+    *prefix = content + start;
+    *prefix_size = end - start;
+
+    return start - offset + 1;
+}
+
+static char* read_typed_text(ide_t* ide, CXCompletionString comp_string)
+{
+    unsigned num_chunks =
+        ide->libclang->get_num_completion_chunks(comp_string);
+
+    for (unsigned i = 0; i < num_chunks; ++i)
+    {
+        if (ide->libclang->get_completion_chunk_kind(comp_string, i)
+            == CXCompletionChunk_TypedText)
+        {
+            CXString chunk_text =
+                ide->libclang->get_completion_chunk_text(comp_string, i);
+            char* typed_text = strdup(ide->libclang->get_string(chunk_text));
+            ide->libclang->dispose_string(chunk_text);
+            return typed_text;
+        }
+    }
+
+    return strdup("");
+}
+
+// Refresh the unit completion cache if it was computed for another start
+// point or translation unit version, unit->lock must be held.
+static bool update_completion_cache(
+    ide_t* ide,
+    unit_t* unit,
+    const char* filename,
+    unsigned line,
+    unsigned column,
+    const char* content,
+    unsigned size)
+{
+    completion_cache_t* cache = &unit->cache;
+
+    if (cache->results
+        && cache->line == line
+        && cache->column == column
+        && cache->generation == unit->generation)
+    {
+        return true;
     }
 
-    struct CXUnsavedFile unsaved_file =
-        {.Filename = filename, .Contents = content, .Length = size};
+    clear_completion_cache(ide, cache);
 
-    CXTranslationUnit tu = (CXTranslationUnit)unit;
+    // Modified buffers are the ones the tu is reparsed with, otherwise
+    // libclang drops the preamble built by the reparse.
+    unsaved_t unsaved;
+    collect_unsaved(ide, &unsaved);
+    if (content)
+    {
+        override_unsaved(&unsaved, filename, content, size);
+    }
+
+    double begin = stage_begin(ide);
     CXCodeCompleteResults* completions = ide->libclang->complete_at(
-        tu,
+        unit->tu,
         filename,
         line,
         column,
-        (struct CXUnsavedFile[]){unsaved_file},
-        1,
+        unsaved.files,
+        unsaved.size,
         COMPLETION_OPTIONS);
+    stage_end(ide, IDE_STAGE_COMPLETE_AT, begin);
+
+    free_unsaved(&unsaved);
 
     if (!completions)
     {
         // TODO: add error details.
-        return;
+        return false;
     }
 
+    completion_results_t* results =
+        (completion_results_t*)malloc(sizeof(completion_results_t));
+    results->results = completions;
+    results->refs = 1;
+    results->candidates = (candidate_t*)malloc(
+        sizeof(candidate_t) * (completions->NumResults + 1));
     for (unsigned i = 0; i < completions->NumResults; ++i)
     {
-        read_completion(ide, &(completions->Results[i]), ctx, oncompletion);
+        CXCompletionString comp_string =
+            completions->Results[i].CompletionString;
+        candidate_t* candidate = &results->candidates[i];
+        candidate->typed_text = read_typed_text(ide, comp_string);
+        candidate->size = strlen(candidate->typed_text);
+        candidate->priority =
+            ide->libclang->get_completion_priority(comp_string);
+    }
+    cache->results = results;
+    cache->line = line;
+    cache->column = column;
+    cache->generation = unit->generation;
+
+    return true;
+}
+
+static void sift_down(ranked_t* heap, unsigned size, unsigned i)
+{
+    for (;;)
+    {
+        unsigned min = i;
+        unsigned left = 2 * i + 1;
+        unsigned right = left + 1;
+
+        if (left < size && heap[left].rank < heap[min].rank)
+        {
+            min = left;
+        }
+        if (right < size && heap[right].rank < heap[min].rank)
+        {
+            min = right;
+        }
+        if (min == i)
+        {
+            break;
+        }
+
+        ranked_t tmp = heap[i];
+        heap[i] = heap[min];
+        heap[min] = tmp;
+        i = min;
+    }
+}
+
+static void sift_up(ranked_t* heap, unsigned i)
+{
+    while (i > 0 && heap[(i - 1) / 2].rank > heap[i].rank)
+    {
+        ranked_t tmp = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
     }
+}
+
+static int compare_ranked(const void* a, const void* b)
+{
+    const ranked_t* x = (const ranked_t*)a;
+    const ranked_t* y = (const ranked_t*)b;
+
+    if (x->rank != y->rank)
+    {
+        return x->rank < y->rank ? 1 : -1;
+    }
+
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// Select at most limit candidates matching the query with the best rank
+// using a min heap of the best candidates seen so far, the selection is
+// stored in best in rank order and its size is returned.
+static unsigned select_candidates(
+    const candidate_t* candidates,
+    unsigned ncandidates,
+    const char* query,
+    unsigned query_size,
+    unsigned limit,
+    ranked_t* best)
+{
+    unsigned size = 0;
+
+    for (unsigned i = 0; i < ncandidates; ++i)
+    {
+        const candidate_t* candidate = &candidates[i];
+        int score = fuzzy_match(
+            query, query_size, candidate->typed_text, candidate->size);
+
+        if (score == FUZZY_NO_MATCH)
+        {
+            continue;
+        }
+
+        int rank = score * SCORE_WEIGHT - (int)candidate->priority;
+
+        if (size < limit)
+        {
+            best[size] = (ranked_t){.index = i, .rank = rank};
+            sift_up(best, size++);
+        }
+        else if (rank > best[0].rank)
+        {
+            best[0] = (ranked_t){.index = i, .rank = rank};
+            sift_down(best, size, 0);
+        }
+    }
+
+    qsort(best, size, sizeof(ranked_t), &compare_ranked);
+
+    return size;
+}
+
+// NOTE: this method should be general and operate native clang API types, but
+// we're doing this completer only for VIM and for simplicity and performance
+// reasons we're translating clang completions to VIM complete-item here.
+ide_status_t ide_find_completions(
+    ide_t* ide,
+    const char* filename,
+    unsigned line,
+    unsigned column,
+    const char* content,
+    unsigned size,
+    unsigned timeout,
+    const char* query,
+    unsigned max_results,
+    arena_t* arena,
+    void* ctx,
+    void (*oncompletion)(void*, completion_t*))
+{
+    unit_t* unit;
+    ide_status_t status =
+        acquire_unit(ide, filename, timeout, true, &unit);
+    if (status != IDE_OK)
+    {
+        return status;
+    }
+
+    // Without content the buffer mirror is used, or the file on disk if the
+    // buffer was never sent.
+    document_text_t* text = NULL;
+    if (!content)
+    {
+        pthread_mutex_lock(&ide->lock);
+        if (unit->document)
+        {
+            text = document_text(unit->document);
+            content = text->data;
+            size = (unsigned)text->size;
+        }
+        pthread_mutex_unlock(&ide->lock);
+    }
+
+    const char* prefix = "";
+    unsigned prefix_size = 0;
+    unsigned start = content
+        ? find_completion_start(
+            content, size, line, column, &prefix, &prefix_size)
+        : column;
+
+    if (!lock_acquired_unit(ide, unit))
+    {
+        if (text)
+        {
+            document_text_release(text);
+        }
+        return IDE_FAILED;
+    }
+
+    if (!update_completion_cache(
+        ide, unit, filename, line, start, content, size))
+    {
+        pthread_mutex_unlock(&unit->lock);
+        release_unit(ide, unit);
+        if (text)
+        {
+            document_text_release(text);
+        }
+        return IDE_FAILED;
+    }
+
+    // Results are converted and delivered without the unit locked, so the
+    // handler can make other requests on the file.
+    completion_results_t* results = unit->cache.results;
+    pthread_mutex_lock(&ide->lock);
+    ++results->refs;
+    pthread_mutex_unlock(&ide->lock);
+
+    pthread_mutex_unlock(&unit->lock);
+
+    if (query)
+    {
+        prefix = query;
+        prefix_size = strlen(query);
+    }
+
+    unsigned ncandidates = results->results->NumResults;
+    unsigned limit =
+        max_results && max_results < ncandidates ? max_results : ncandidates;
+
+    ranked_t* best = (ranked_t*)malloc(sizeof(ranked_t) * (limit + 1));
+    unsigned nbest = select_candidates(
+        results->candidates, ncandidates, prefix, prefix_size, limit, best);
+
+    double begin = stage_begin(ide);
+    arena_t* scratch = arena_alloc();
+    for (unsigned i = 0; i < nbest; ++i)
+    {
+        read_completion(
+            ide,
+            &(results->results->Results[best[i].index]),
+            arena,
+            scratch,
+            ctx,
+            oncompletion);
+    }
+
+    arena_free(scratch);
+    stage_end(ide, IDE_STAGE_CONVERSION, begin);
+    free(best);
+
+    release_completion_results(ide, results);
+    release_unit(ide, unit);
+    if (text)
+    {
+        document_text_release(text);
+    }
+
+    return IDE_OK;
+}
+
+static void index_file(void* ctx)
+{
+    index_task_t* task = (index_task_t*)ctx;
+    ide_t* ide = task->ide;
+
+    // Files queued when the ide is freed are dropped rather than indexed.
+    pthread_mutex_lock(&ide->lock);
+    bool stopping = ide->stopping;
+    pthread_mutex_unlock(&ide->lock);
+
+    if (!stopping
+        && !symindex_is_current(ide->symbols, task->filename, ide->file_states))
+    {
+        flags_t flags;
+        get_flags(ide, task->filename, &flags);
+
+        indexer_index_file(
+            ide->libclang,
+            ide->index,
+            ide->symbols,
+            ide->file_states,
+            task->filename,
+            flags.items,
+            flags.size);
+
+        free_flags(&flags);
+    }
+
+    pthread_mutex_lock(&ide->lock);
+    --ide->index_pending;
+    pthread_mutex_unlock(&ide->lock);
+
+    free(task->filename);
+    free(task);
+}
+
+void ide_index_files(
+    ide_t* ide,
+    const char* const* filenames,
+    unsigned nfiles)
+{
+    pthread_mutex_lock(&ide->lock);
+    ide->index_pending += nfiles;
+    pthread_mutex_unlock(&ide->lock);
+
+    for (unsigned i = 0; i < nfiles; ++i)
+    {
+        index_task_t* task = (index_task_t*)malloc(sizeof(index_task_t));
+        task->ide = ide;
+        task->filename = strdup(filenames[i]);
+        pool_submit(ide->index_pool, task, &index_file);
+    }
+}
+
+unsigned ide_index_pending(ide_t* ide)
+{
+    pthread_mutex_lock(&ide->lock);
+    unsigned pending = ide->index_pending;
+    pthread_mutex_unlock(&ide->lock);
+
+    return pending;
+}
+
+bool ide_load_index(ide_t* ide, const char* path)
+{
+    return symindex_load(ide->symbols, path);
+}
+
+bool ide_save_index(ide_t* ide, const char* path)
+{
+    return symindex_save(ide->symbols, path);
+}
+
+static bool is_indexed_cursor(enum CXCursorKind kind)
+{
+    return (kind >= CXCursor_FirstDecl && kind <= CXCursor_LastDecl)
+        || (kind >= CXCursor_FirstRef && kind <= CXCursor_LastRef)
+        || kind == CXCursor_DeclRefExpr
+        || kind == CXCursor_MemberRefExpr;
+}
+
+static enum CXChildVisitResult add_cursor_extent(
+    CXCursor cursor,
+    CXCursor parent,
+    CXClientData data)
+{
+    cursors_visit_t* visit = (cursors_visit_t*)data;
+    libclang_t* libclang = visit->ide->libclang;
+
+    if (!libclang->location_is_from_main_file(
+        libclang->get_cursor_location(cursor)))
+    {
+        return CXChildVisit_Continue;
+    }
+
+    if (!is_indexed_cursor(cursor.kind))
+    {
+        return CXChildVisit_Recurse;
+    }
+
+    CXSourceRange range =
+        libclang->cursor_get_spelling_name_range(cursor, 0, 0);
+    cursor_extent_t extent = {.cursor = cursor};
+    CXFile begin_file;
+    CXFile end_file;
+    unsigned offset;
+    libclang->get_spelling_location(
+        libclang->get_range_start(range),
+        &begin_file,
+        &extent.begin_line,
+        &extent.begin_column,
+        &offset);
+    libclang->get_spelling_location(
+        libclang->get_range_end(range),
+        &end_file,
+        &extent.end_line,
+        &extent.end_column,
+        &offset);
+
+    // Names spelled in macros are left to clang_getCursor.
+    if (begin_file != visit->file || end_file != visit->file)
+    {
+        return CXChildVisit_Recurse;
+    }
+
+    cursor_index_t* index = visit->index;
+    if (index->size == index->capacity)
+    {
+        index->capacity = index->capacity ? index->capacity * 2 : 256;
+        index->items = (cursor_extent_t*)realloc(
+            index->items, sizeof(cursor_extent_t) * index->capacity);
+    }
+    extent.order = index->size;
+    index->items[index->size++] = extent;
+
+    return CXChildVisit_Recurse;
+}
+
+static int compare_positions(
+    unsigned line1,
+    unsigned column1,
+    unsigned line2,
+    unsigned column2)
+{
+    if (line1 != line2)
+    {
+        return line1 < line2 ? -1 : 1;
+    }
+    return column1 < column2 ? -1 : column1 > column2;
+}
+
+// Sort extents by their beginning, nested cursors sharing it come first.
+static int compare_extents(const void* a, const void* b)
+{
+    const cursor_extent_t* extent1 = (const cursor_extent_t*)a;
+    const cursor_extent_t* extent2 = (const cursor_extent_t*)b;
+    int result = compare_positions(
+        extent1->begin_line,
+        extent1->begin_column,
+        extent2->begin_line,
+        extent2->begin_column);
+    if (result)
+    {
+        return result;
+    }
+    return extent1->order > extent2->order ? -1 : 1;
+}
+
+// Build the cursor index of the unit if the tu changed since it was built,
+// unit->lock must be held.
+static cursor_index_t* get_cursor_index(ide_t* ide, unit_t* unit)
+{
+    cursor_index_t* index = &unit->cursors;
+    if (index->built && index->generation == unit->generation)
+    {
+        return index;
+    }
+
+    index->size = 0;
+    index->generation = unit->generation;
+    index->built = true;
+
+    cursors_visit_t visit = {
+        .ide = ide,
+        .file = ide->libclang->get_file(unit->tu, unit->filename),
+        .index = index};
+    ide->libclang->visit_children(
+        ide->libclang->get_tu_cursor(unit->tu), &add_cursor_extent, &visit);
+
+    qsort(index->items, index->size, sizeof(cursor_extent_t), &compare_extents);
+
+    // Keep the innermost of the cursors sharing a beginning, so the extent
+    // found by a lookup is the one clang_getCursor would pick.
+    unsigned size = 0;
+    for (unsigned i = 0; i < index->size; ++i)
+    {
+        if (size == 0
+            || compare_positions(
+                index->items[size - 1].begin_line,
+                index->items[size - 1].begin_column,
+                index->items[i].begin_line,
+                index->items[i].begin_column) != 0)
+        {
+            index->items[size++] = index->items[i];
+        }
+    }
+    index->size = size;
+
+    return index;
+}
+
+// Binary search of the name extent containing the position.
+static bool find_indexed_cursor(
+    cursor_index_t* index,
+    unsigned line,
+    unsigned column,
+    CXCursor* cursor)
+{
+    unsigned low = 0;
+    unsigned high = index->size;
+    while (low < high)
+    {
+        unsigned middle = low + (high - low) / 2;
+        cursor_extent_t* extent = &index->items[middle];
+        if (compare_positions(
+            extent->begin_line, extent->begin_column, line, column) <= 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if (low == 0)
+    {
+        return false;
+    }
+
+    cursor_extent_t* extent = &index->items[low - 1];
+    if (compare_positions(
+        line, column, extent->end_line, extent->end_column) >= 0)
+    {
+        return false;
+    }
+
+    *cursor = extent->cursor;
+    return true;
+}
+
+// Get the cursor of the symbol referenced at the position, unit->lock must be
+// held.
+static CXCursor find_referenced_cursor(
+    ide_t* ide,
+    unit_t* unit,
+    unsigned line,
+    unsigned column)
+{
+    CXCursor cursor;
+    if (!find_indexed_cursor(
+        get_cursor_index(ide, unit), line, column, &cursor))
+    {
+        CXFile file = ide->libclang->get_file(unit->tu, unit->filename);
+        CXSourceLocation location =
+            ide->libclang->get_location(unit->tu, file, line, column);
+        cursor = ide->libclang->get_cursor(unit->tu, location);
+    }
+    CXCursor referenced = ide->libclang->get_cursor_referenced(cursor);
+
+    return ide->libclang->cursor_is_null(referenced) ? cursor : referenced;
+}
+
+static void add_location(
+    ide_t* ide,
+    location_list_t* list,
+    CXSourceLocation source_location)
+{
+    CXFile file;
+    unsigned line;
+    unsigned column;
+    unsigned offset;
+    ide->libclang->get_spelling_location(
+        source_location, &file, &line, &column, &offset);
+    if (!file)
+    {
+        return;
+    }
+
+    if (list->size == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->items = (location_t*)realloc(
+            list->items, sizeof(location_t) * list->capacity);
+    }
+
+    CXString filename = ide->libclang->get_file_name(file);
+    list->items[list->size++] = (location_t){
+        .filename = strdup(ide->libclang->get_string(filename)),
+        .line = line,
+        .column = column};
+    ide->libclang->dispose_string(filename);
+}
+
+static void report_locations(
+    location_list_t* list,
+    void* ctx,
+    void (*onlocation)(void*, location_t*))
+{
+    for (unsigned i = 0; i < list->size; ++i)
+    {
+        (*onlocation)(ctx, &list->items[i]);
+        free((void*)list->items[i].filename);
+    }
+    free(list->items);
+}
+
+static void add_indexed_location(void* ctx, location_t* location)
+{
+    location_list_t* list = (location_list_t*)ctx;
+    if (list->size == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 16;
+        list->items = (location_t*)realloc(
+            list->items, sizeof(location_t) * list->capacity);
+    }
+
+    list->items[list->size++] = (location_t){
+        .filename = strdup(location->filename),
+        .line = location->line,
+        .column = location->column};
+}
+
+static ide_status_t find_symbol(
+    ide_t* ide,
+    const char* filename,
+    unsigned line,
+    unsigned column,
+    symbol_kind_t kind,
+    void* ctx,
+    void (*onlocation)(void*, location_t*))
+{
+    // Navigation works on translation units preloaded from the AST cache.
+    unit_t* unit;
+    ide_status_t status = acquire_unit(ide, filename, 0, false, &unit);
+    if (status != IDE_OK)
+    {
+        return status;
+    }
+
+    // Locations are reported once the unit is unlocked, so the handler can
+    // make other requests.
+    location_list_t list = {
+        .items = NULL, .size = 0, .capacity = 0, .next = NULL};
+
+    if (!lock_acquired_unit(ide, unit))
+    {
+        return IDE_FAILED;
+    }
+
+    CXCursor cursor = find_referenced_cursor(ide, unit, line, column);
+    CXString usr = ide->libclang->get_cursor_usr(cursor);
+    const char* usr_string = ide->libclang->get_string(usr);
+
+    if (usr_string && *usr_string != '\0')
+    {
+        symindex_find(
+            ide->symbols, usr_string, kind, &list, &add_indexed_location);
+    }
+
+    if (list.size == 0)
+    {
+        CXCursor target = kind == SYMBOL_DEFINITION
+            ? ide->libclang->get_cursor_definition(cursor)
+            : cursor;
+
+        if (!ide->libclang->cursor_is_null(target))
+        {
+            add_location(
+                ide, &list, ide->libclang->get_cursor_location(target));
+        }
+    }
+
+    ide->libclang->dispose_string(usr);
+
+    pthread_mutex_unlock(&unit->lock);
+    release_unit(ide, unit);
+
+    report_locations(&list, ctx, onlocation);
+
+    return IDE_OK;
+}
+
+ide_status_t ide_find_definition(
+    ide_t* ide,
+    const char* filename,
+    unsigned line,
+    unsigned column,
+    void* ctx,
+    void (*ondefinition)(void*, location_t*))
+{
+    return find_symbol(
+        ide, filename, line, column, SYMBOL_DEFINITION, ctx, ondefinition);
+}
+
+ide_status_t ide_find_declaration(
+    ide_t* ide,
+    const char* filename,
+    unsigned line,
+    unsigned column,
+    void* ctx,
+    void (*ondeclaration)(void*, location_t*))
+{
+    return find_symbol(
+        ide, filename, line, column, SYMBOL_DECLARATION, ctx, ondeclaration);
+}
+
+static enum CXVisitorResult add_reference(
+    void* ctx,
+    CXCursor cursor,
+    CXSourceRange range)
+{
+    references_visit_t* visit = (references_visit_t*)ctx;
+    add_location(
+        visit->ide, visit->list, visit->ide->libclang->get_range_start(range));
+    return CXVisit_Continue;
+}
+
+// Find references to the cursor in the main file of the unit, unit->lock
+// must be held.
+static void find_unit_references(
+    ide_t* ide,
+    unit_t* unit,
+    CXCursor cursor,
+    location_list_t* list)
+{
+    references_visit_t visit = {.ide = ide, .list = list};
+    CXCursorAndRangeVisitor visitor = {
+        .context = &visit,
+        .visit = &add_reference};
+    ide->libclang->find_references_in_file(
+        cursor, ide->libclang->get_file(unit->tu, unit->filename), visitor);
+}
+
+static enum CXChildVisitResult find_usr_cursor(
+    CXCursor cursor,
+    CXCursor parent,
+    CXClientData data)
+{
+    usr_search_t* search = (usr_search_t*)data;
+    libclang_t* libclang = search->ide->libclang;
+
+    // Declarations from headers do not lead to the main file.
+    if (!libclang->location_is_from_main_file(
+        libclang->get_cursor_location(cursor)))
+    {
+        return CXChildVisit_Continue;
+    }
+
+    CXCursor referenced = libclang->get_cursor_referenced(cursor);
+    if (!libclang->cursor_is_null(referenced))
+    {
+        CXString usr = libclang->get_cursor_usr(referenced);
+        const char* usr_string = libclang->get_string(usr);
+        search->found = usr_string && strcmp(usr_string, search->usr) == 0;
+        libclang->dispose_string(usr);
+
+        if (search->found)
+        {
+            search->cursor = referenced;
+            return CXChildVisit_Break;
+        }
+    }
+
+    return CXChildVisit_Recurse;
+}
+
+static void search_references(void* ctx)
+{
+    references_task_t* task = (references_task_t*)ctx;
+    references_search_t* search = task->search;
+    ide_t* ide = search->ide;
+    unit_t* unit = task->unit;
+    free(task);
+
+    location_list_t* list = (location_list_t*)malloc(sizeof(location_list_t));
+    *list = (location_list_t){
+        .items = NULL, .size = 0, .capacity = 0, .next = NULL};
+
+    pthread_mutex_lock(&unit->lock);
+    if (unit->tu)
+    {
+        // Cursors belong to their translation unit, so the symbol is found
+        // again by its USR.
+        usr_search_t usr_search = {
+            .ide = ide, .usr = search->usr, .found = false};
+        ide->libclang->visit_children(
+            ide->libclang->get_tu_cursor(unit->tu),
+            &find_usr_cursor,
+            &usr_search);
+
+        if (usr_search.found)
+        {
+            find_unit_references(ide, unit, usr_search.cursor, list);
+        }
+    }
+    pthread_mutex_unlock(&unit->lock);
+
+    release_unit(ide, unit);
+
+    pthread_mutex_lock(&search->lock);
+    list->next = search->found;
+    search->found = list;
+    --search->pending;
+    pthread_cond_signal(&search->searched);
+    pthread_mutex_unlock(&search->lock);
+}
+
+// Add the name of a searched file along with its canonical name, the index
+// can refer to the file by either of them.
+static void add_searched_file(references_search_t* search, const char* name)
+{
+    char* canonical = filestates_canonical_name(name);
+    const char* names[] = {name, canonical};
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        void* data;
+        if (!hashmap_get(search->files, names[i], &data))
+        {
+            hashmap_set(search->files, strdup(names[i]), NULL);
+        }
+    }
+    free(canonical);
+}
+
+// Queue search of every parsed unit but the one provided, ide->lock must be
+// held.
+static void queue_reference_searches(
+    void* ctx,
+    const void* filename,
+    void* data)
+{
+    references_task_t* origin = (references_task_t*)ctx;
+    references_search_t* search = origin->search;
+    unit_t* unit = (unit_t*)data;
+
+    if (unit == origin->unit || unit->status != IDE_OK || !unit->tu)
+    {
+        return;
+    }
+
+    ++unit->refs;
+    ++search->pending;
+    add_searched_file(search, unit->filename);
+
+    references_task_t* task =
+        (references_task_t*)malloc(sizeof(references_task_t));
+    task->search = search;
+    task->unit = unit;
+    pool_submit(search->ide->search_pool, task, &search_references);
+}
+
+static void report_indexed_reference(void* ctx, location_t* location)
+{
+    references_search_t* search = (references_search_t*)ctx;
+    void* data;
+    if (!hashmap_get(search->files, location->filename, &data))
+    {
+        (*search->onreference)(search->ctx, location);
+    }
+}
+
+static void free_searched_file(void* ctx, const void* filename, void* data)
+{
+    free((void*)filename);
+}
+
+ide_status_t ide_find_references(
+    ide_t* ide,
+    const char* filename,
+    unsigned line,
+    unsigned column,
+    void* ctx,
+    void (*onreference)(void*, location_t*))
+{
+    unit_t* unit;
+    ide_status_t status = acquire_unit(ide, filename, 0, false, &unit);
+    if (status != IDE_OK)
+    {
+        return status;
+    }
+
+    // References in the file itself are reported at once.
+    location_list_t list = {
+        .items = NULL, .size = 0, .capacity = 0, .next = NULL};
+
+    if (!lock_acquired_unit(ide, unit))
+    {
+        return IDE_FAILED;
+    }
+
+    CXCursor cursor = find_referenced_cursor(ide, unit, line, column);
+    find_unit_references(ide, unit, cursor, &list);
+    CXString usr = ide->libclang->get_cursor_usr(cursor);
+    const char* usr_cstring = ide->libclang->get_string(usr);
+    char* usr_string = strdup(usr_cstring ? usr_cstring : "");
+    ide->libclang->dispose_string(usr);
+    pthread_mutex_unlock(&unit->lock);
+
+    report_locations(&list, ctx, onreference);
+
+    // Symbols without USR are local to the file.
+    if (*usr_string != '\0')
+    {
+        references_search_t search = {
+            .ide = ide,
+            .usr = usr_string,
+            .pending = 0,
+            .found = NULL,
+            .files = hashmap_alloc(&string_hash, &string_equals),
+            .ctx = ctx,
+            .onreference = onreference};
+        add_searched_file(&search, unit->filename);
+        pthread_mutex_init(&search.lock, NULL);
+        pthread_cond_init(&search.searched, NULL);
+
+        references_task_t origin = {.search = &search, .unit = unit};
+        pthread_mutex_lock(&ide->lock);
+        pthread_mutex_lock(&search.lock);
+        hashmap_each(ide->units, &origin, &queue_reference_searches);
+        pthread_mutex_unlock(&search.lock);
+        pthread_mutex_unlock(&ide->lock);
+
+        // Report every unit as soon as its search completes.
+        pthread_mutex_lock(&search.lock);
+        while (search.pending || search.found)
+        {
+            if (!search.found)
+            {
+                pthread_cond_wait(&search.searched, &search.lock);
+                continue;
+            }
+
+            location_list_t* found = search.found;
+            search.found = found->next;
+            pthread_mutex_unlock(&search.lock);
+
+            report_locations(found, ctx, onreference);
+            free(found);
+
+            pthread_mutex_lock(&search.lock);
+        }
+        pthread_mutex_unlock(&search.lock);
+
+        symindex_find(
+            ide->symbols,
+            usr_string,
+            SYMBOL_REFERENCE,
+            &search,
+            &report_indexed_reference);
+
+        hashmap_each(search.files, NULL, &free_searched_file);
+        hashmap_free(search.files);
+        pthread_cond_destroy(&search.searched);
+        pthread_mutex_destroy(&search.lock);
+    }
+
+    free(usr_string);
+    release_unit(ide, unit);
+
+    return IDE_OK;
+}
+
+static enum CXChildVisitResult add_child(
+    CXCursor cursor,
+    CXCursor parent,
+    CXClientData data)
+{
+    children_t* children = (children_t*)data;
+    if (children->size == 0)
+    {
+        children->first = cursor;
+    }
+    else if (children->size == 1)
+    {
+        children->second = cursor;
+    }
+    children->last = cursor;
+    ++children->size;
+
+    return CXChildVisit_Continue;
+}
+
+static children_t get_children(ide_t* ide, CXCursor cursor)
+{
+    children_t children = {.size = 0};
+    ide->libclang->visit_children(cursor, &add_child, &children);
+    return children;
+}
+
+// Copy the first or the last token of the range, the token is empty if the
+// range has none or it is longer than an operator.
+static void get_token(
+    writes_visit_t* visit,
+    CXSourceRange range,
+    bool last,
+    char token[4])
+{
+    libclang_t* libclang = visit->ide->libclang;
+
+    CXToken* tokens = NULL;
+    unsigned ntokens = 0;
+    libclang->tokenize(visit->tu, range, &tokens, &ntokens);
+
+    token[0] = '\0';
+    if (ntokens)
+    {
+        CXString spelling = libclang->get_token_spelling(
+            visit->tu, tokens[last ? ntokens - 1 : 0]);
+        const char* spelling_string = libclang->get_string(spelling);
+        if (spelling_string && strlen(spelling_string) < 4)
+        {
+            strcpy(token, spelling_string);
+        }
+        libclang->dispose_string(spelling);
+    }
+
+    if (tokens)
+    {
+        libclang->dispose_tokens(visit->tu, tokens, ntokens);
+    }
+}
+
+// Record a write to the variable or member the expression names, or to the
+// array it indexes. Writes through pointers are not tracked.
+static void add_write(writes_visit_t* visit, CXCursor expr)
+{
+    libclang_t* libclang = visit->ide->libclang;
+
+    while (expr.kind == CXCursor_UnexposedExpr
+        || expr.kind == CXCursor_ParenExpr
+        || expr.kind == CXCursor_ArraySubscriptExpr)
+    {
+        children_t children = get_children(visit->ide, expr);
+        if (!children.size)
+        {
+            return;
+        }
+        expr = children.first;
+    }
+
+    if (expr.kind != CXCursor_DeclRefExpr
+        && expr.kind != CXCursor_MemberRefExpr)
+    {
+        return;
+    }
+
+    CXCursor referenced = libclang->get_cursor_referenced(expr);
+    if (referenced.kind != CXCursor_VarDecl
+        && referenced.kind != CXCursor_ParmDecl
+        && referenced.kind != CXCursor_FieldDecl)
+    {
+        return;
+    }
+
+    CXString usr = libclang->get_cursor_usr(referenced);
+    const char* usr_string = libclang->get_string(usr);
+    if (usr_string && *usr_string != '\0')
+    {
+        write_sites_t* sites;
+        void* found;
+        if (hashmap_get(visit->sites, usr_string, &found))
+        {
+            sites = (write_sites_t*)found;
+        }
+        else
+        {
+            sites = (write_sites_t*)malloc(sizeof(write_sites_t));
+            *sites = (write_sites_t){.items = NULL, .size = 0, .capacity = 0};
+            hashmap_set(visit->sites, strdup(usr_string), sites);
+        }
+
+        if (sites->size == sites->capacity)
+        {
+            sites->capacity = sites->capacity ? sites->capacity * 2 : 4;
+            sites->items = (write_site_t*)realloc(
+                sites->items, sizeof(write_site_t) * sites->capacity);
+        }
+
+        CXFile file;
+        unsigned offset;
+        write_site_t* site = &sites->items[sites->size++];
+        libclang->get_spelling_location(
+            libclang->get_cursor_location(expr),
+            &file,
+            &site->line,
+            &site->column,
+            &offset);
+    }
+    libclang->dispose_string(usr);
+}
+
+// Plain and compound assignments write their left operand.
+static void add_assignment(writes_visit_t* visit, CXCursor cursor)
+{
+    libclang_t* libclang = visit->ide->libclang;
+
+    children_t children = get_children(visit->ide, cursor);
+    if (children.size != 2)
+    {
+        return;
+    }
+
+    if (cursor.kind == CXCursor_BinaryOperator)
+    {
+        // The operator is the token between the operands.
+        CXSourceRange between = libclang->get_range(
+            libclang->get_range_end(
+                libclang->get_cursor_extent(children.first)),
+            libclang->get_range_start(
+                libclang->get_cursor_extent(children.second)));
+        char token[4];
+        get_token(visit, between, false, token);
+        if (strcmp(token, "=") != 0)
+        {
+            return;
+        }
+    }
+
+    add_write(visit, children.first);
+}
+
+// Increments and decrements write their operand, taking a non-const pointer
+// to it lets the operand be written through the pointer.
+static void add_unary_write(
+    writes_visit_t* visit,
+    CXCursor cursor,
+    CXCursor parent)
+{
+    libclang_t* libclang = visit->ide->libclang;
+
+    children_t children = get_children(visit->ide, cursor);
+    if (children.size != 1)
+    {
+        return;
+    }
+
+    CXSourceRange extent = libclang->get_cursor_extent(cursor);
+    char token[4];
+    get_token(visit, extent, false, token);
+
+    if (strcmp(token, "&") == 0)
+    {
+        // The address itself is never const, the pointer it is stored to
+        // or passed as is. Conversions to it are implicit casts libclang
+        // exposes as the parent expression.
+        bool converted = parent.kind == CXCursor_UnexposedExpr
+            || parent.kind == CXCursor_CStyleCastExpr
+            || parent.kind == CXCursor_VarDecl;
+        CXType pointee = libclang->get_pointee_type(
+            libclang->get_cursor_type(converted ? parent : cursor));
+        if (!libclang->is_const_qualified_type(pointee))
+        {
+            add_write(visit, children.first);
+        }
+        return;
+    }
+
+    if (strcmp(token, "++") != 0 && strcmp(token, "--") != 0)
+    {
+        // Postfix operators come last.
+        get_token(visit, extent, true, token);
+        if (strcmp(token, "++") != 0 && strcmp(token, "--") != 0)
+        {
+            return;
+        }
+    }
+
+    add_write(visit, children.first);
+}
+
+// Calls write arguments bound to non-const references, and the object of
+// non-const methods.
+static void add_call_writes(writes_visit_t* visit, CXCursor cursor)
+{
+    libclang_t* libclang = visit->ide->libclang;
+
+    CXCursor callee = libclang->get_cursor_referenced(cursor);
+    if (libclang->cursor_is_null(callee))
+    {
+        return;
+    }
+
+    CXType type = libclang->get_cursor_type(callee);
+    int nparams = libclang->get_num_arg_types(type);
+    int nargs = libclang->cursor_get_num_arguments(cursor);
+    if (nparams < 0 || nargs < 0)
+    {
+        return;
+    }
+
+    bool method = callee.kind == CXCursor_CXXMethod;
+    bool writes_object = method && !libclang->cxx_method_is_const(callee);
+
+    // Operator calls pass the object as the first argument.
+    int first = method && nargs == nparams + 1 ? 1 : 0;
+    if (first && writes_object)
+    {
+        add_write(visit, libclang->cursor_get_argument(cursor, 0));
+    }
+    else if (writes_object)
+    {
+        children_t children = get_children(visit->ide, cursor);
+        if (children.size && children.first.kind == CXCursor_MemberRefExpr)
+        {
+            children_t member = get_children(visit->ide, children.first);
+            if (member.size)
+            {
+                add_write(visit, member.first);
+            }
+        }
+    }
+
+    for (int i = first; i < nargs && i - first < nparams; ++i)
+    {
+        CXType param = libclang->get_arg_type(type, i - first);
+        if (param.kind == CXType_LValueReference
+            && !libclang->is_const_qualified_type(
+                libclang->get_pointee_type(param)))
+        {
+            add_write(visit, libclang->cursor_get_argument(cursor, i));
+        }
+    }
+}
+
+// Binding a non-const reference lets the initializer be written through it.
+static void add_reference_binding(writes_visit_t* visit, CXCursor cursor)
+{
+    libclang_t* libclang = visit->ide->libclang;
+
+    CXType type = libclang->get_cursor_type(cursor);
+    if (type.kind != CXType_LValueReference
+        || libclang->is_const_qualified_type(libclang->get_pointee_type(type)))
+    {
+        return;
+    }
+
+    children_t children = get_children(visit->ide, cursor);
+    if (children.size)
+    {
+        add_write(visit, children.last);
+    }
+}
+
+static enum CXChildVisitResult collect_writes(
+    CXCursor cursor,
+    CXCursor parent,
+    CXClientData data)
+{
+    writes_visit_t* visit = (writes_visit_t*)data;
+    libclang_t* libclang = visit->ide->libclang;
+
+    // Headers are left to their own units.
+    if (!libclang->location_is_from_main_file(
+        libclang->get_cursor_location(cursor)))
+    {
+        return CXChildVisit_Continue;
+    }
+
+    switch (cursor.kind)
+    {
+    case CXCursor_BinaryOperator:
+    case CXCursor_CompoundAssignOperator:
+        add_assignment(visit, cursor);
+        break;
+    case CXCursor_UnaryOperator:
+        add_unary_write(visit, cursor, parent);
+        break;
+    case CXCursor_CallExpr:
+        add_call_writes(visit, cursor);
+        break;
+    case CXCursor_VarDecl:
+        add_reference_binding(visit, cursor);
+        break;
+    default:
+        break;
+    }
+
+    return CXChildVisit_Recurse;
+}
+
+// Get write sites of the unit, unit->lock must be held.
+static hashmap_t* get_write_sites(ide_t* ide, unit_t* unit)
+{
+    writes_cache_t* cache = &unit->writes;
+    if (cache->sites && cache->generation == unit->generation)
+    {
+        return cache->sites;
+    }
+
+    clear_writes_cache(cache);
+    cache->sites = hashmap_alloc(&string_hash, &string_equals);
+    cache->generation = unit->generation;
+
+    writes_visit_t visit = {.ide = ide, .tu = unit->tu, .sites = cache->sites};
+    ide->libclang->visit_children(
+        ide->libclang->get_tu_cursor(unit->tu), &collect_writes, &visit);
+
+    return cache->sites;
+}
+
+ide_status_t ide_find_assingments(
+    ide_t* ide,
+    const char* filename,
+    unsigned line,
+    unsigned column,
+    void* ctx,
+    void (*onassingment)(void*, location_t*))
+{
+    unit_t* unit;
+    ide_status_t status = acquire_unit(ide, filename, 0, false, &unit);
+    if (status != IDE_OK)
+    {
+        return status;
+    }
+
+    // Write sites are copied to report them once the unit is unlocked, so
+    // the handler can make other requests.
+    write_sites_t copy = {.items = NULL, .size = 0, .capacity = 0};
+
+    if (!lock_acquired_unit(ide, unit))
+    {
+        return IDE_FAILED;
+    }
+
+    CXCursor cursor = find_referenced_cursor(ide, unit, line, column);
+    CXString usr = ide->libclang->get_cursor_usr(cursor);
+    const char* usr_string = ide->libclang->get_string(usr);
+
+    void* found;
+    if (usr_string
+        && *usr_string != '\0'
+        && hashmap_get(get_write_sites(ide, unit), usr_string, &found))
+    {
+        write_sites_t* sites = (write_sites_t*)found;
+        copy.items =
+            (write_site_t*)malloc(sizeof(write_site_t) * sites->size);
+        memcpy(copy.items, sites->items, sizeof(write_site_t) * sites->size);
+        copy.size = sites->size;
+    }
+
+    ide->libclang->dispose_string(usr);
+
+    pthread_mutex_unlock(&unit->lock);
+
+    // The file name is kept by the reference to the unit.
+    for (unsigned i = 0; i < copy.size; ++i)
+    {
+        location_t location = {
+            .filename = unit->filename,
+            .line = copy.items[i].line,
+            .column = copy.items[i].column};
+        (*onassingment)(ctx, &location);
+    }
+    free(copy.items);
+
+    release_unit(ide, unit);
 
-    ide->libclang->dispose_completion(completions);
+    return IDE_OK;
 }
@@ -1,28 +1,46 @@
 /**
  * Interface for IDE C/C++ plugin based on libclang.
  *
+ * All the functions except ide_alloc and ide_free can be called from several
+ * threads at once, calls on different files do not block each other.
+ *
  * Jun 7 2017 Vladimir Bogretsov <bogrecov@gmail.com>
  */
 
 #ifndef IDE_H
 #define IDE_H
 
-#define ABBR_SIZE 128
-#define MENU_SIZE 128  // TODO: remove menu member.
-#define SORT_SIZE 128
-#define WORD_SIZE 128
-#define INFO_SIZE 1024
+#include <stdbool.h>
+#include <stddef.h>
 
+#include "arena.h"
 
 typedef struct ide ide_t;
 
+typedef enum
+{
+    IDE_OK,
+    IDE_PARSING,
+    IDE_FAILED,
+    IDE_NOT_FOUND,
+    IDE_EVICTED
+} ide_status_t;
+
+typedef enum
+{
+    IDE_STAGE_PARSE,
+    IDE_STAGE_REPARSE,
+    IDE_STAGE_COMPLETE_AT,
+    IDE_STAGE_CONVERSION,
+    IDE_STAGE_WARM_UP
+} ide_stage_t;
+
+// Strings of a completion are stored in the arena passed to
+// ide_find_completions, the record only keeps their offsets.
 typedef struct
 {
-    char abbr[ABBR_SIZE];
-    char menu[MENU_SIZE];  // TODO: remove menu member.
-    char sort[SORT_SIZE];
-    char word[WORD_SIZE];
-    char info[INFO_SIZE];
+    unsigned abbr;
+    unsigned word;
     char kind;
     unsigned priority;
 } completion_t;
@@ -39,28 +57,144 @@ typedef struct
  * @param  libclang_path Path to libclang library.
  * @param  flags         Compiler flags.
  * @param  nflags        Number of compiler flags.
+ * @param  nthreads      Number of parser threads and of threads searching
+ *                       references, 0 means number of CPUs.
  * @return               Initialized ide instance.
  */
 ide_t* ide_alloc(
     const char* libclang_path,
     const char* const* flags,
-    unsigned nflags);
+    unsigned nflags,
+    unsigned nthreads);
 
 /**
- * Deallocate the ide instance provided.
+ * Deallocate the ide instance provided. Files being indexed are finished,
+ * files queued for indexing are dropped.
  * @param ide Instance to be deallocated.
  */
 void ide_free(ide_t* ide);
 
 /**
- * Notify IDE about opening a file.
+ * Set limit of memory used by translation units. When the limit is exceeded
+ * translation units of the least recently used files are disposed and parsed
+ * again on the next request.
+ * @param ide    IDE instance.
+ * @param budget Memory limit in bytes, 0 means no limit.
+ */
+void ide_set_memory_budget(ide_t* ide, size_t budget);
+
+/**
+ * Enable persistent cache of parsed files in the directory provided. A file
+ * with a valid cache entry is available right after opening, while its
+ * source is parsed in background. Should be called before files are opened.
+ * @param  ide  IDE instance.
+ * @param  path Cache directory, created if missing.
+ * @return      true if the cache directory can be used otherwise false.
+ */
+bool ide_set_cache_dir(ide_t* ide, const char* path);
+
+/**
+ * Take compiler flags of files from compile_commands.json in the directory
+ * provided, files missing in it use the global flags. Headers without own
+ * entry use flags of a matching source. The database is loaded again when
+ * the file changes. The database can be replaced at any time, parses in
+ * progress finish with the one they started with.
+ * @param  ide IDE instance.
+ * @param  dir Directory containing compile_commands.json.
+ * @return     true if the database is loaded otherwise false.
+ */
+bool ide_set_compilation_database(ide_t* ide, const char* dir);
+
+/**
+ * Set handler of stage timings, used for profiling. The handler is called
+ * from parser threads as well, so it should be thread safe. Should be called
+ * before files are opened.
+ * @param ide     IDE instance.
+ * @param ctx     Enclosure context.
+ * @param onstage Stage handler receiving the stage duration in milliseconds,
+ *                NULL disables timing.
+ */
+void ide_set_stage_handler(
+    ide_t* ide,
+    void* ctx,
+    void (*onstage)(void*, ide_stage_t, double));
+
+/**
+ * Notify IDE about opening a file. The file is parsed in background, the
+ * function returns immediately.
  * @param ide      IDE instance.
  * @param filename Opened file name.
  */
 void ide_on_file_open(ide_t* ide, const char* filename);
 
 /**
- * Notifgy IDE about file save.
+ * Get parsing status of the file.
+ * @param  ide      IDE instance.
+ * @param  filename File name.
+ * @return          IDE_OK if the file is parsed, IDE_PARSING if the file is
+ *                  being parsed or only loaded from the AST cache so
+ *                  completion still waits for it, IDE_FAILED if parsing failed,
+ *                  IDE_NOT_FOUND if the file is not opened and IDE_EVICTED
+ *                  if the file was evicted to fit the memory budget.
+ */
+ide_status_t ide_file_status(ide_t* ide, const char* filename);
+
+/**
+ * Check if the file is warm. A parsed file is warmed up in background by
+ * building its preamble and caching completion results, until then the first
+ * completion is slow. Parsing again after eviction makes the file cold.
+ * @param  ide      IDE instance.
+ * @param  filename File name.
+ * @param  elapsed  Milliseconds from queueing the parse until the file became
+ *                  warm.
+ * @return          true if the file is warm otherwise false.
+ */
+bool ide_file_warm(ide_t* ide, const char* filename, double* elapsed);
+
+/**
+ * Notify IDE about a change of the file buffer. The file is reparsed in
+ * background with the latest content of all modified buffers once the buffer
+ * stays unchanged for a short delay, so completion runs against an up to date
+ * translation unit. The content replaces the buffer mirror of the file.
+ * @param ide      IDE instance.
+ * @param filename Changed file name.
+ * @param content  Current buffer content.
+ * @param size     Content size in bytes.
+ */
+void ide_on_file_change(
+    ide_t* ide,
+    const char* filename,
+    const char* content,
+    size_t size);
+
+/**
+ * Apply a ranged line edit to the mirror of the file buffer, like
+ * nvim_buf_set_lines or the on_lines event of nvim_buf_attach. A file without
+ * a mirror should be sent as a whole with ide_on_file_change first. The file
+ * is reparsed in background as with ide_on_file_change.
+ * @param  ide      IDE instance.
+ * @param  filename Changed file name.
+ * @param  first    Index of the first line replaced.
+ * @param  last     Index past the last line replaced, negative indices count
+ *                  from the end, -1 is the index past the last line.
+ * @param  lines    New lines without line terminators.
+ * @param  nlines   Number of new lines.
+ * @return          true if the edit is applied, false if the file is not
+ *                  opened, has no mirror or the range does not fit the
+ *                  mirror, which should be sent again as a whole then.
+ */
+bool ide_on_lines_change(
+    ide_t* ide,
+    const char* filename,
+    long first,
+    long last,
+    const char* const* lines,
+    unsigned nlines);
+
+/**
+ * Notifgy IDE about file save. Indexed sources which include the file, or
+ * the file itself if it is an indexed source, are indexed again in
+ * background.
  * @param ide      IDE instance.
  * @param filename Saved file name.
  */
@@ -74,36 +208,98 @@ void ide_on_file_save(ide_t* ide, const char* filename);
 void ide_on_file_close(ide_t* ide, const char* filename);
 
 /**
- * Find completions for the position in the file.
+ * Find completions for the position in the file. Only completions fuzzy
+ * matching the query are provided, best matches first. Results are cached per
+ * completion start point, so requests made while the user keeps typing the
+ * same identifier do not call libclang again. The handler is called without
+ * the file locked, so it can make other requests on the file.
  * @param ide         IDE instance.
  * @param filename    File where completions deisred.
  * @param line        Line number where completions desired.
  * @param column      Column number where completions desired.
- * @param content     Content of the file.
+ * @param content     Content of the file, NULL to use the buffer mirror kept
+ *                    by ide_on_file_change and ide_on_lines_change.
  * @param size        Content size.
+ * @param timeout     Milliseconds to wait for pending parse of the file.
+ * @param query       Query to match completions against, NULL means the
+ *                    identifier prefix typed before the position.
+ * @param max_results Maximum number of completions provided, 0 means all.
+ * @param arena       Arena where completion strings are stored, it should
+ *                    outlive the completions provided.
  * @param ctx         Enclosure context.
  * @param ncompletion Single completion handler.
+ * @return            Status of the file, completions are only provided if
+ *                    the status is IDE_OK.
  */
-void ide_find_completions(
+ide_status_t ide_find_completions(
     ide_t* ide,
     const char* filename,
     unsigned line,
     unsigned column,
     const char* content,
     unsigned size,
+    unsigned timeout,
+    const char* query,
+    unsigned max_results,
+    arena_t* arena,
     void* ctx,
     void (*oncompletion)(void*, completion_t*));
 
 /**
- * Find symbol declaration.
+ * Index the source files provided in background on all CPUs. Definitions,
+ * declarations and references found are used to navigate to symbols of files
+ * not opened. Sources indexed before are skipped if neither they nor the
+ * headers they include changed since, which is told by file IDs and
+ * modification times or, for files rewritten like by git checkout, by
+ * content hashes.
+ * @param ide       IDE instance.
+ * @param filenames Source files to index.
+ * @param nfiles    Number of source files.
+ */
+void ide_index_files(
+    ide_t* ide,
+    const char* const* filenames,
+    unsigned nfiles);
+
+/**
+ * Get number of files waiting to be indexed.
+ * @param  ide IDE instance.
+ * @return     Number of files queued or being indexed.
+ */
+unsigned ide_index_pending(ide_t* ide);
+
+/**
+ * Load the project index saved by ide_save_index. The file is mapped into
+ * memory, so it is available at once and is not copied to the heap. Files
+ * indexed after loading take precedence over the loaded index, sources of
+ * the loaded index which did not change are not indexed again.
+ * @param  ide  IDE instance.
+ * @param  path Index file.
+ * @return      true if the index is loaded otherwise false.
+ */
+bool ide_load_index(ide_t* ide, const char* path);
+
+/**
+ * Save the project index including the loaded one to a file.
+ * @param  ide  IDE instance.
+ * @param  path Index file, can be the one loaded.
+ * @return      true if the index is saved otherwise false.
+ */
+bool ide_save_index(ide_t* ide, const char* path);
+
+/**
+ * Find symbol definition. The symbol is looked up in the project index and
+ * in the translation unit of the file if the index has no definition.
  * @param ide          IDE instance.
  * @param filename     File where symbol desired is located.
  * @param line         Line number where symbol desired is located.
  * @param column       Column number where symbol desired is located.
  * @param ctx          Enclosure context.
- * @param ondefinition Definition handler.
+ * @param ondefinition Definition handler, called without the file locked.
+ * @return             Status of the file, definitions are only provided if
+ *                     the status is IDE_OK.
  */
-void ide_find_definition(
+ide_status_t ide_find_definition(
     ide_t* ide,
     const char* filename,
     unsigned line,
@@ -112,15 +308,19 @@ void ide_find_definition(
     void (*ondefinition)(void*, location_t*));
 
 /**
- * Find symbol declaration.
+ * Find symbol declaration. The symbol is looked up in the project index and
+ * in the translation unit of the file if the index has no declaration.
  * @param ide          IDE instance.
  * @param filename     File where symbol desired is located.
  * @param line         Line number where symbol desired is located.
  * @param column       Column number where symbol desired is located.
  * @param ctx          Enclosure context.
- * @param ondefinition Single declaration handler.
+ * @param ondefinition Single declaration handler, called without the file
+ *                     locked.
+ * @return             Status of the file, declarations are only provided if
+ *                     the status is IDE_OK.
  */
-void ide_find_declaration(
+ide_status_t ide_find_declaration(
     ide_t* ide,
     const char* filename,
     unsigned line,
@@ -129,15 +329,19 @@ void ide_find_declaration(
     void (*ondeclaration)(void*, location_t*));
 
 /**
- * Find symbol assingment.
+ * Find places of the file where the symbol is written: assignments,
+ * increments and decrements, non-const references and pointers taken to it.
+ * Write sites of a file are collected once until it is parsed again.
  * @param ide          IDE instance.
  * @param filename     File where symbol desired is located.
  * @param line         Line number where symbol desired is located.
  * @param column       Column number where symbol desired is located.
  * @param ctx          Enclosure context.
- * @param onassingment Single assingment handler.
+ * @param onassingment Single assingment handler, called without the file
+ *                     locked.
+ * @return             status of the file provided.
  */
-void ide_find_assingments(
+ide_status_t ide_find_assingments(
     ide_t* ide,
     const char* filename,
     unsigned line,
@@ -146,15 +350,19 @@ void ide_find_assingments(
     void (*onassingment)(void*, location_t*));
 
 /**
- * Find symbol reference.
+ * Find symbol references in every parsed file. References in the file
+ * provided come first, other files are searched in parallel and reported as
+ * each of them is done. References in other files are taken from the project
+ * index. The handler is called on the calling thread.
  * @param ide          IDE instance.
  * @param filename     File where symbol desired is located.
  * @param line         Line number where symbol desired is located.
  * @param column       Column number where symbol desired is located.
  * @param ctx          Enclosure context.
  * @param onreference  Single reference handler.
+ * @return             status of the file provided.
  */
-void ide_find_references(
+ide_status_t ide_find_references(
     ide_t* ide,
     const char* filename,
     unsigned line,
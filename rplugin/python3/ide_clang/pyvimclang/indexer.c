@@ -0,0 +1,305 @@
+#include "indexer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const unsigned INDEX_OPTIONS = CXIndexOpt_SuppressWarnings;
+
+static const unsigned INDEX_TRANSLATION_OPTIONS =
+    CXTranslationUnit_Incomplete;
+
+typedef struct
+{
+    char* filename;
+    CXFileUniqueID id;
+} file_id_t;
+
+typedef struct
+{
+    libclang_t* libclang;
+    symbol_entry_t* entries;
+    size_t size;
+    size_t capacity;
+    // Name of the file of the last location, locations come mostly grouped
+    // by file.
+    CXFile last_file;
+    char* last_filename;
+    // Source and headers included, as seen by libclang. Files are disposed
+    // with the translation unit, so they are read as they are entered.
+    file_id_t* files;
+    size_t nfiles;
+    size_t files_capacity;
+} collector_t;
+
+static const char* file_name(collector_t* collector, CXFile file)
+{
+    if (file != collector->last_file)
+    {
+        CXString name = collector->libclang->get_file_name(file);
+        collector->last_file = file;
+        collector->last_filename =
+            strdup(collector->libclang->get_string(name));
+        collector->libclang->dispose_string(name);
+    }
+
+    return collector->last_filename;
+}
+
+static void add_entry(
+    collector_t* collector,
+    const char* usr,
+    CXIdxLoc loc,
+    symbol_kind_t kind)
+{
+    if (!usr || *usr == '\0')
+    {
+        return;
+    }
+
+    CXFile file;
+    unsigned line;
+    unsigned column;
+    collector->libclang->index_loc_get_file_location(
+        loc, NULL, &file, &line, &column, NULL);
+
+    if (!file)
+    {
+        return;
+    }
+
+    if (collector->size == collector->capacity)
+    {
+        collector->capacity =
+            collector->capacity ? collector->capacity * 2 : 256;
+        collector->entries = (symbol_entry_t*)realloc(
+            collector->entries, sizeof(symbol_entry_t) * collector->capacity);
+    }
+
+    // File names are shared between entries of the same file and freed by
+    // free_entries.
+    collector->entries[collector->size++] = (symbol_entry_t){
+        .usr = strdup(usr),
+        .filename = file_name(collector, file),
+        .line = line,
+        .column = column,
+        .kind = kind};
+}
+
+static void free_entries(collector_t* collector)
+{
+    const char* last_filename = NULL;
+    for (size_t i = 0; i < collector->size; ++i)
+    {
+        free((void*)collector->entries[i].usr);
+        if (collector->entries[i].filename != last_filename)
+        {
+            last_filename = collector->entries[i].filename;
+            free((void*)last_filename);
+        }
+    }
+
+    if (collector->last_filename != last_filename)
+    {
+        free(collector->last_filename);
+    }
+
+    free(collector->entries);
+}
+
+static void add_file(collector_t* collector, CXFile file)
+{
+    if (!file)
+    {
+        return;
+    }
+
+    file_id_t item;
+    if (collector->libclang->get_file_unique_id(file, &item.id) != 0)
+    {
+        return;
+    }
+
+    // Headers reached through relative include paths are named with ".."
+    // components.
+    CXString name = collector->libclang->get_file_name(file);
+    item.filename = filestates_canonical_name(
+        collector->libclang->get_string(name));
+    collector->libclang->dispose_string(name);
+
+    if (collector->nfiles == collector->files_capacity)
+    {
+        collector->files_capacity =
+            collector->files_capacity ? collector->files_capacity * 2 : 64;
+        collector->files = (file_id_t*)realloc(
+            collector->files, sizeof(file_id_t) * collector->files_capacity);
+    }
+
+    collector->files[collector->nfiles++] = item;
+}
+
+static int compare_files(const void* a, const void* b)
+{
+    return strcmp(
+        ((const file_id_t*)a)->filename, ((const file_id_t*)b)->filename);
+}
+
+// States of the files the source was indexed from. A file changed since
+// libclang read it gets an unknown hash, so the source is indexed again.
+static dependency_t* get_dependencies(
+    collector_t* collector,
+    filestates_t* states,
+    size_t* ndependencies)
+{
+    // Headers are entered once per inclusion. Files are NULL if none was
+    // entered, which qsort must not get.
+    if (collector->nfiles > 0)
+    {
+        qsort(
+            collector->files,
+            collector->nfiles,
+            sizeof(file_id_t),
+            &compare_files);
+    }
+
+    dependency_t* dependencies = (dependency_t*)malloc(
+        sizeof(dependency_t) * (collector->nfiles + 1));
+    *ndependencies = 0;
+    for (size_t i = 0; i < collector->nfiles; ++i)
+    {
+        const file_id_t* file = &collector->files[i];
+        if (i > 0 && strcmp(file->filename, file[-1].filename) == 0)
+        {
+            continue;
+        }
+
+        dependency_t* dependency = &dependencies[(*ndependencies)++];
+        dependency->filename = file->filename;
+        if (!filestates_get(states, file->filename, &dependency->state)
+            || dependency->state.device != file->id.data[0]
+            || dependency->state.inode != file->id.data[1]
+            || dependency->state.mtime / 1000000000
+                != (int64_t)file->id.data[2])
+        {
+            dependency->state.device = file->id.data[0];
+            dependency->state.inode = file->id.data[1];
+            dependency->state.mtime = 0;
+            dependency->state.hash = 0;
+        }
+    }
+
+    return dependencies;
+}
+
+static void free_files(collector_t* collector)
+{
+    for (size_t i = 0; i < collector->nfiles; ++i)
+    {
+        free(collector->files[i].filename);
+    }
+    free(collector->files);
+}
+
+static CXIdxClientFile enter_main_file(
+    CXClientData data,
+    CXFile file,
+    void* reserved)
+{
+    add_file((collector_t*)data, file);
+    return NULL;
+}
+
+static CXIdxClientFile include_file(
+    CXClientData data,
+    const CXIdxIncludedFileInfo* info)
+{
+    add_file((collector_t*)data, info->file);
+    return NULL;
+}
+
+static void index_declaration(CXClientData data, const CXIdxDeclInfo* info)
+{
+    if (info->entityInfo)
+    {
+        add_entry(
+            (collector_t*)data,
+            info->entityInfo->USR,
+            info->loc,
+            info->isDefinition ? SYMBOL_DEFINITION : SYMBOL_DECLARATION);
+    }
+}
+
+static void index_reference(CXClientData data, const CXIdxEntityRefInfo* info)
+{
+    if (info->referencedEntity)
+    {
+        add_entry(
+            (collector_t*)data,
+            info->referencedEntity->USR,
+            info->loc,
+            SYMBOL_REFERENCE);
+    }
+}
+
+bool indexer_index_file(
+    libclang_t* libclang,
+    CXIndex index,
+    symindex_t* symbols,
+    filestates_t* states,
+    const char* filename,
+    const char* const* flags,
+    unsigned nflags)
+{
+    collector_t collector = {
+        .libclang = libclang,
+        .entries = NULL,
+        .size = 0,
+        .capacity = 0,
+        .last_file = NULL,
+        .last_filename = NULL,
+        .files = NULL,
+        .nfiles = 0,
+        .files_capacity = 0};
+
+    IndexerCallbacks callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.indexDeclaration = &index_declaration;
+    callbacks.indexEntityReference = &index_reference;
+    callbacks.enteredMainFile = &enter_main_file;
+    callbacks.ppIncludedFile = &include_file;
+
+    CXIndexAction action = libclang->index_action_create(index);
+    int result = libclang->index_source_file(
+        action,
+        &collector,
+        &callbacks,
+        sizeof(callbacks),
+        INDEX_OPTIONS,
+        filename,
+        flags,
+        nflags,
+        NULL,
+        0,
+        NULL,
+        INDEX_TRANSLATION_OPTIONS);
+    libclang->index_action_dispose(action);
+
+    if (result == 0)
+    {
+        size_t ndependencies;
+        dependency_t* dependencies =
+            get_dependencies(&collector, states, &ndependencies);
+        symindex_update(
+            symbols,
+            filename,
+            collector.entries,
+            collector.size,
+            dependencies,
+            ndependencies);
+        free(dependencies);
+    }
+
+    free_entries(&collector);
+    free_files(&collector);
+
+    return result == 0;
+}
@@ -0,0 +1,37 @@
+/**
+ * Source file indexing with libclang indexing API.
+ */
+#ifndef INDEXER_H
+#define INDEXER_H
+
+#include <stdbool.h>
+
+#include <clang-c/Index.h>
+
+#include "filestate.h"
+#include "libclang.h"
+#include "symindex.h"
+
+/**
+ * Index the source file provided and replace its symbol locations in the
+ * symbol index. States of the source and of the headers it includes are
+ * recorded along with the locations.
+ * @param  libclang libclang functions.
+ * @param  index    clang index used for parsing.
+ * @param  symbols  symbol index to be updated.
+ * @param  states   cache of file states.
+ * @param  filename source file to index.
+ * @param  flags    compiler flags.
+ * @param  nflags   number of compiler flags.
+ * @return          true if the file was indexed otherwise false.
+ */
+bool indexer_index_file(
+    libclang_t* libclang,
+    CXIndex index,
+    symindex_t* symbols,
+    filestates_t* states,
+    const char* filename,
+    const char* const* flags,
+    unsigned nflags);
+
+#endif // !INDEXER_H
@@ -28,6 +28,7 @@ libclang_t* libclang_load(const char* path)
     }
 
     libclang_t* libclang = (libclang_t*)malloc(sizeof(libclang_t));
+    libclang->handle = handle;
 
     int num_not_loaded = 0;
 
@@ -82,9 +83,197 @@ libclang_t* libclang_load(const char* path)
         (clang_default_code_complete_options_t)load_function(
             handle, "clang_defaultCodeCompleteOptions", &num_not_loaded);
 
+    libclang->get_tu_resource_usage =
+        (clang_get_tu_resource_usage_t)load_function(
+            handle, "clang_getCXTUResourceUsage", &num_not_loaded);
+
+    libclang->dispose_tu_resource_usage =
+        (clang_dispose_tu_resource_usage_t)load_function(
+            handle, "clang_disposeCXTUResourceUsage", &num_not_loaded);
+
+    libclang->save_tu = (clang_save_tu_t)load_function(
+        handle, "clang_saveTranslationUnit", &num_not_loaded);
+
+    libclang->default_save_options =
+        (clang_default_save_options_t)load_function(
+            handle, "clang_defaultSaveOptions", &num_not_loaded);
+
+    libclang->create_tu2 = (clang_create_tu2_t)load_function(
+        handle, "clang_createTranslationUnit2", &num_not_loaded);
+
+    libclang->get_inclusions = (clang_get_inclusions_t)load_function(
+        handle, "clang_getInclusions", &num_not_loaded);
+
+    libclang->get_file_name = (clang_get_file_name_t)load_function(
+        handle, "clang_getFileName", &num_not_loaded);
+
+    libclang->get_file = (clang_get_file_t)load_function(
+        handle, "clang_getFile", &num_not_loaded);
+
+    libclang->get_file_unique_id =
+        (clang_get_file_unique_id_t)load_function(
+            handle, "clang_getFileUniqueID", &num_not_loaded);
+
+    libclang->get_location = (clang_get_location_t)load_function(
+        handle, "clang_getLocation", &num_not_loaded);
+
+    libclang->get_spelling_location =
+        (clang_get_spelling_location_t)load_function(
+            handle, "clang_getSpellingLocation", &num_not_loaded);
+
+    libclang->get_cursor = (clang_get_cursor_t)load_function(
+        handle, "clang_getCursor", &num_not_loaded);
+
+    libclang->get_cursor_location =
+        (clang_get_cursor_location_t)load_function(
+            handle, "clang_getCursorLocation", &num_not_loaded);
+
+    libclang->get_cursor_referenced =
+        (clang_get_cursor_referenced_t)load_function(
+            handle, "clang_getCursorReferenced", &num_not_loaded);
+
+    libclang->get_cursor_definition =
+        (clang_get_cursor_definition_t)load_function(
+            handle, "clang_getCursorDefinition", &num_not_loaded);
+
+    libclang->get_cursor_usr = (clang_get_cursor_usr_t)load_function(
+        handle, "clang_getCursorUSR", &num_not_loaded);
+
+    libclang->cursor_is_null = (clang_cursor_is_null_t)load_function(
+        handle, "clang_Cursor_isNull", &num_not_loaded);
+
+    libclang->get_tu_cursor = (clang_get_tu_cursor_t)load_function(
+        handle, "clang_getTranslationUnitCursor", &num_not_loaded);
+
+    libclang->visit_children = (clang_visit_children_t)load_function(
+        handle, "clang_visitChildren", &num_not_loaded);
+
+    libclang->location_is_from_main_file =
+        (clang_location_is_from_main_file_t)load_function(
+            handle, "clang_Location_isFromMainFile", &num_not_loaded);
+
+    libclang->get_range_start = (clang_get_range_start_t)load_function(
+        handle, "clang_getRangeStart", &num_not_loaded);
+
+    libclang->find_references_in_file =
+        (clang_find_references_in_file_t)load_function(
+            handle, "clang_findReferencesInFile", &num_not_loaded);
+
+    libclang->get_cursor_extent = (clang_get_cursor_extent_t)load_function(
+        handle, "clang_getCursorExtent", &num_not_loaded);
+
+    libclang->cursor_get_spelling_name_range =
+        (clang_cursor_get_spelling_name_range_t)load_function(
+            handle, "clang_Cursor_getSpellingNameRange", &num_not_loaded);
+
+    libclang->get_range = (clang_get_range_t)load_function(
+        handle, "clang_getRange", &num_not_loaded);
+
+    libclang->get_range_end = (clang_get_range_end_t)load_function(
+        handle, "clang_getRangeEnd", &num_not_loaded);
+
+    libclang->tokenize = (clang_tokenize_t)load_function(
+        handle, "clang_tokenize", &num_not_loaded);
+
+    libclang->get_token_spelling = (clang_get_token_spelling_t)load_function(
+        handle, "clang_getTokenSpelling", &num_not_loaded);
+
+    libclang->dispose_tokens = (clang_dispose_tokens_t)load_function(
+        handle, "clang_disposeTokens", &num_not_loaded);
+
+    libclang->get_cursor_type = (clang_get_cursor_type_t)load_function(
+        handle, "clang_getCursorType", &num_not_loaded);
+
+    libclang->get_pointee_type = (clang_get_pointee_type_t)load_function(
+        handle, "clang_getPointeeType", &num_not_loaded);
+
+    libclang->is_const_qualified_type =
+        (clang_is_const_qualified_type_t)load_function(
+            handle, "clang_isConstQualifiedType", &num_not_loaded);
+
+    libclang->cursor_get_num_arguments =
+        (clang_cursor_get_num_arguments_t)load_function(
+            handle, "clang_Cursor_getNumArguments", &num_not_loaded);
+
+    libclang->cursor_get_argument = (clang_cursor_get_argument_t)load_function(
+        handle, "clang_Cursor_getArgument", &num_not_loaded);
+
+    libclang->get_num_arg_types = (clang_get_num_arg_types_t)load_function(
+        handle, "clang_getNumArgTypes", &num_not_loaded);
+
+    libclang->get_arg_type = (clang_get_arg_type_t)load_function(
+        handle, "clang_getArgType", &num_not_loaded);
+
+    libclang->cxx_method_is_const = (clang_cxx_method_is_const_t)load_function(
+        handle, "clang_CXXMethod_isConst", &num_not_loaded);
+
+    libclang->index_action_create =
+        (clang_index_action_create_t)load_function(
+            handle, "clang_IndexAction_create", &num_not_loaded);
+
+    libclang->index_action_dispose =
+        (clang_index_action_dispose_t)load_function(
+            handle, "clang_IndexAction_dispose", &num_not_loaded);
+
+    libclang->index_source_file = (clang_index_source_file_t)load_function(
+        handle, "clang_indexSourceFile", &num_not_loaded);
+
+    libclang->index_loc_get_file_location =
+        (clang_index_loc_get_file_location_t)load_function(
+            handle, "clang_indexLoc_getFileLocation", &num_not_loaded);
+
+    libclang->compilation_database_from_directory =
+        (clang_compilation_database_from_directory_t)load_function(
+            handle, "clang_CompilationDatabase_fromDirectory", &num_not_loaded);
+
+    libclang->compilation_database_dispose =
+        (clang_compilation_database_dispose_t)load_function(
+            handle, "clang_CompilationDatabase_dispose", &num_not_loaded);
+
+    libclang->compilation_database_get_commands =
+        (clang_compilation_database_get_commands_t)load_function(
+            handle,
+            "clang_CompilationDatabase_getCompileCommands",
+            &num_not_loaded);
+
+    libclang->compilation_database_get_all_commands =
+        (clang_compilation_database_get_all_commands_t)load_function(
+            handle,
+            "clang_CompilationDatabase_getAllCompileCommands",
+            &num_not_loaded);
+
+    libclang->compile_commands_dispose =
+        (clang_compile_commands_dispose_t)load_function(
+            handle, "clang_CompileCommands_dispose", &num_not_loaded);
+
+    libclang->compile_commands_get_size =
+        (clang_compile_commands_get_size_t)load_function(
+            handle, "clang_CompileCommands_getSize", &num_not_loaded);
+
+    libclang->compile_commands_get_command =
+        (clang_compile_commands_get_command_t)load_function(
+            handle, "clang_CompileCommands_getCommand", &num_not_loaded);
+
+    libclang->compile_command_get_directory =
+        (clang_compile_command_get_directory_t)load_function(
+            handle, "clang_CompileCommand_getDirectory", &num_not_loaded);
+
+    libclang->compile_command_get_filename =
+        (clang_compile_command_get_filename_t)load_function(
+            handle, "clang_CompileCommand_getFilename", &num_not_loaded);
+
+    libclang->compile_command_get_num_args =
+        (clang_compile_command_get_num_args_t)load_function(
+            handle, "clang_CompileCommand_getNumArgs", &num_not_loaded);
+
+    libclang->compile_command_get_arg =
+        (clang_compile_command_get_arg_t)load_function(
+            handle, "clang_CompileCommand_getArg", &num_not_loaded);
+
     if (num_not_loaded)
     {
-        close_library(libclang);
+        close_library(handle);
+        free(libclang);
         errno = EBADF;
         return NULL;
     }
@@ -95,4 +284,5 @@ libclang_t* libclang_load(const char* path)
 void libclang_close(libclang_t* libclang)
 {
     close_library(libclang->handle);
+    free(libclang);
 }
@@ -7,6 +7,7 @@
 #ifndef LIBCLANG_H
 #define LIBCLANG_H
 
+#include <clang-c/CXCompilationDatabase.h>
 #include <clang-c/Index.h>
 
 /**
@@ -107,10 +108,327 @@ typedef enum CXCompletionChunkKind (*clang_get_completion_chunk_kind_t)(
 typedef unsigned (*clang_default_code_complete_options_t)();
 //clang_defaultCodeCompleteOptions
 
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+ */
+typedef CXTUResourceUsage (*clang_get_tu_resource_usage_t)(CXTranslationUnit);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+ */
+typedef void (*clang_dispose_tu_resource_usage_t)(CXTUResourceUsage);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+ */
+typedef int (*clang_save_tu_t)(CXTranslationUnit, const char*, unsigned);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+ */
+typedef unsigned (*clang_default_save_options_t)(CXTranslationUnit);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+ */
+typedef enum CXErrorCode (*clang_create_tu2_t)(
+    CXIndex,
+    const char*,
+    CXTranslationUnit*);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__MISC.html
+ */
+typedef void (*clang_get_inclusions_t)(
+    CXTranslationUnit,
+    CXInclusionVisitor,
+    CXClientData);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__FILES.html
+ */
+typedef CXString (*clang_get_file_name_t)(CXFile);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__FILES.html
+ */
+typedef CXFile (*clang_get_file_t)(CXTranslationUnit, const char*);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__FILES.html
+ */
+typedef int (*clang_get_file_unique_id_t)(CXFile, CXFileUniqueID*);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__LOCATIONS.html
+ */
+typedef CXSourceLocation (*clang_get_location_t)(
+    CXTranslationUnit,
+    CXFile,
+    unsigned,
+    unsigned);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__LOCATIONS.html
+ */
+typedef void (*clang_get_spelling_location_t)(
+    CXSourceLocation,
+    CXFile*,
+    unsigned*,
+    unsigned*,
+    unsigned*);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__SOURCE.html
+ */
+typedef CXCursor (*clang_get_cursor_t)(CXTranslationUnit, CXSourceLocation);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__SOURCE.html
+ */
+typedef CXSourceLocation (*clang_get_cursor_location_t)(CXCursor);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__XREF.html
+ */
+typedef CXCursor (*clang_get_cursor_referenced_t)(CXCursor);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__XREF.html
+ */
+typedef CXCursor (*clang_get_cursor_definition_t)(CXCursor);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__XREF.html
+ */
+typedef CXString (*clang_get_cursor_usr_t)(CXCursor);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__MANIP.html
+ */
+typedef int (*clang_cursor_is_null_t)(CXCursor);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__MANIP.html
+ */
+typedef CXCursor (*clang_get_tu_cursor_t)(CXTranslationUnit);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__TRAVERSAL.html
+ */
+typedef unsigned (*clang_visit_children_t)(
+    CXCursor,
+    CXCursorVisitor,
+    CXClientData);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__LOCATIONS.html
+ */
+typedef int (*clang_location_is_from_main_file_t)(CXSourceLocation);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__LOCATIONS.html
+ */
+typedef CXSourceLocation (*clang_get_range_start_t)(CXSourceRange);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__HIGH.html
+ */
+typedef CXResult (*clang_find_references_in_file_t)(
+    CXCursor,
+    CXFile,
+    CXCursorAndRangeVisitor);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__SOURCE.html
+ */
+typedef CXSourceRange (*clang_get_cursor_extent_t)(CXCursor);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__XREF.html
+ */
+typedef CXSourceRange (*clang_cursor_get_spelling_name_range_t)(
+    CXCursor,
+    unsigned,
+    unsigned);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__LOCATIONS.html
+ */
+typedef CXSourceRange (*clang_get_range_t)(
+    CXSourceLocation,
+    CXSourceLocation);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__LOCATIONS.html
+ */
+typedef CXSourceLocation (*clang_get_range_end_t)(CXSourceRange);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__LEX.html
+ */
+typedef void (*clang_tokenize_t)(
+    CXTranslationUnit,
+    CXSourceRange,
+    CXToken**,
+    unsigned*);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__LEX.html
+ */
+typedef CXString (*clang_get_token_spelling_t)(CXTranslationUnit, CXToken);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__LEX.html
+ */
+typedef void (*clang_dispose_tokens_t)(CXTranslationUnit, CXToken*, unsigned);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html
+ */
+typedef CXType (*clang_get_cursor_type_t)(CXCursor);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html
+ */
+typedef CXType (*clang_get_pointee_type_t)(CXType);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html
+ */
+typedef unsigned (*clang_is_const_qualified_type_t)(CXType);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html
+ */
+typedef int (*clang_cursor_get_num_arguments_t)(CXCursor);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html
+ */
+typedef CXCursor (*clang_cursor_get_argument_t)(CXCursor, unsigned);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html
+ */
+typedef int (*clang_get_num_arg_types_t)(CXType);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html
+ */
+typedef CXType (*clang_get_arg_type_t)(CXType, unsigned);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__CPP.html
+ */
+typedef unsigned (*clang_cxx_method_is_const_t)(CXCursor);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__HIGH.html
+ */
+typedef CXIndexAction (*clang_index_action_create_t)(CXIndex);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__HIGH.html
+ */
+typedef void (*clang_index_action_dispose_t)(CXIndexAction);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__HIGH.html
+ */
+typedef int (*clang_index_source_file_t)(
+    CXIndexAction,
+    CXClientData,
+    IndexerCallbacks*,
+    unsigned,
+    unsigned,
+    const char*,
+    const char* const*,
+    int,
+    struct CXUnsavedFile*,
+    unsigned,
+    CXTranslationUnit*,
+    unsigned);
+
+/**
+ * https://clang.llvm.org/doxygen/group__CINDEX__HIGH.html
+ */
+typedef void (*clang_index_loc_get_file_location_t)(
+    CXIdxLoc,
+    CXIdxClientFile*,
+    CXFile*,
+    unsigned*,
+    unsigned*,
+    unsigned*);
+
 
 /**
  * Functions imported from libclang.
  */
+/**
+ * https://clang.llvm.org/doxygen/group__COMPILATIONDB.html
+ */
+typedef CXCompilationDatabase (*clang_compilation_database_from_directory_t)(
+    const char*,
+    CXCompilationDatabase_Error*);
+
+/**
+ * https://clang.llvm.org/doxygen/group__COMPILATIONDB.html
+ */
+typedef void (*clang_compilation_database_dispose_t)(CXCompilationDatabase);
+
+/**
+ * https://clang.llvm.org/doxygen/group__COMPILATIONDB.html
+ */
+typedef CXCompileCommands (*clang_compilation_database_get_commands_t)(
+    CXCompilationDatabase,
+    const char*);
+
+/**
+ * https://clang.llvm.org/doxygen/group__COMPILATIONDB.html
+ */
+typedef CXCompileCommands (*clang_compilation_database_get_all_commands_t)(
+    CXCompilationDatabase);
+
+/**
+ * https://clang.llvm.org/doxygen/group__COMPILATIONDB.html
+ */
+typedef void (*clang_compile_commands_dispose_t)(CXCompileCommands);
+
+/**
+ * https://clang.llvm.org/doxygen/group__COMPILATIONDB.html
+ */
+typedef unsigned (*clang_compile_commands_get_size_t)(CXCompileCommands);
+
+/**
+ * https://clang.llvm.org/doxygen/group__COMPILATIONDB.html
+ */
+typedef CXCompileCommand (*clang_compile_commands_get_command_t)(
+    CXCompileCommands,
+    unsigned);
+
+/**
+ * https://clang.llvm.org/doxygen/group__COMPILATIONDB.html
+ */
+typedef CXString (*clang_compile_command_get_directory_t)(CXCompileCommand);
+
+/**
+ * https://clang.llvm.org/doxygen/group__COMPILATIONDB.html
+ */
+typedef CXString (*clang_compile_command_get_filename_t)(CXCompileCommand);
+
+/**
+ * https://clang.llvm.org/doxygen/group__COMPILATIONDB.html
+ */
+typedef unsigned (*clang_compile_command_get_num_args_t)(CXCompileCommand);
+
+/**
+ * https://clang.llvm.org/doxygen/group__COMPILATIONDB.html
+ */
+typedef CXString (*clang_compile_command_get_arg_t)(
+    CXCompileCommand,
+    unsigned);
+
 typedef struct
 {
     void* handle;
@@ -129,6 +447,61 @@ typedef struct
     clang_get_completion_chunk_text_t get_completion_chunk_text;
     clang_get_completion_chunk_kind_t get_completion_chunk_kind;
     clang_default_code_complete_options_t default_code_complete_options;
+    clang_get_tu_resource_usage_t get_tu_resource_usage;
+    clang_dispose_tu_resource_usage_t dispose_tu_resource_usage;
+    clang_save_tu_t save_tu;
+    clang_default_save_options_t default_save_options;
+    clang_create_tu2_t create_tu2;
+    clang_get_inclusions_t get_inclusions;
+    clang_get_file_name_t get_file_name;
+    clang_get_file_t get_file;
+    clang_get_file_unique_id_t get_file_unique_id;
+    clang_get_location_t get_location;
+    clang_get_spelling_location_t get_spelling_location;
+    clang_get_cursor_t get_cursor;
+    clang_get_cursor_location_t get_cursor_location;
+    clang_get_cursor_referenced_t get_cursor_referenced;
+    clang_get_cursor_definition_t get_cursor_definition;
+    clang_get_cursor_usr_t get_cursor_usr;
+    clang_cursor_is_null_t cursor_is_null;
+    clang_get_tu_cursor_t get_tu_cursor;
+    clang_visit_children_t visit_children;
+    clang_location_is_from_main_file_t location_is_from_main_file;
+    clang_get_range_start_t get_range_start;
+    clang_find_references_in_file_t find_references_in_file;
+    clang_get_cursor_extent_t get_cursor_extent;
+    clang_cursor_get_spelling_name_range_t cursor_get_spelling_name_range;
+    clang_get_range_t get_range;
+    clang_get_range_end_t get_range_end;
+    clang_tokenize_t tokenize;
+    clang_get_token_spelling_t get_token_spelling;
+    clang_dispose_tokens_t dispose_tokens;
+    clang_get_cursor_type_t get_cursor_type;
+    clang_get_pointee_type_t get_pointee_type;
+    clang_is_const_qualified_type_t is_const_qualified_type;
+    clang_cursor_get_num_arguments_t cursor_get_num_arguments;
+    clang_cursor_get_argument_t cursor_get_argument;
+    clang_get_num_arg_types_t get_num_arg_types;
+    clang_get_arg_type_t get_arg_type;
+    clang_cxx_method_is_const_t cxx_method_is_const;
+    clang_index_action_create_t index_action_create;
+    clang_index_action_dispose_t index_action_dispose;
+    clang_index_source_file_t index_source_file;
+    clang_index_loc_get_file_location_t index_loc_get_file_location;
+    clang_compilation_database_from_directory_t
+        compilation_database_from_directory;
+    clang_compilation_database_dispose_t compilation_database_dispose;
+    clang_compilation_database_get_commands_t
+        compilation_database_get_commands;
+    clang_compilation_database_get_all_commands_t
+        compilation_database_get_all_commands;
+    clang_compile_commands_dispose_t compile_commands_dispose;
+    clang_compile_commands_get_size_t compile_commands_get_size;
+    clang_compile_commands_get_command_t compile_commands_get_command;
+    clang_compile_command_get_directory_t compile_command_get_directory;
+    clang_compile_command_get_filename_t compile_command_get_filename;
+    clang_compile_command_get_num_args_t compile_command_get_num_args;
+    clang_compile_command_get_arg_t compile_command_get_arg;
 
 } libclang_t;
 
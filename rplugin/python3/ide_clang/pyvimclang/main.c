@@ -1,53 +1,764 @@
+/**
+ * Latency benchmark of the IDE interface.
+ *
+ * Runs a script of editor events against the IDE and reports p50/p95/p99
+ * latency of every operation and of every libclang stage as JSON. A run can
+ * be compared against a JSON report stored before.
+ *
+ * Build:
+ *   gcc -O2 -pthread -I. -o benchmark main.c arena.c astcache.c compdb.c \
+ *       document.c filestate.c fuzzy.c hash.c hashmap.c ide.c indexer.c \
+ *       libclang.c pool.c symfile.c symindex.c -ldl
+ *
+ * Script lines, '#' starts a comment:
+ *   open <file>                          open the file and wait for parse
+ *   edit <file> <line> <column> <text>   insert text, \n \t \\ are escapes
+ *   complete <file> <line> <column> [query]
+ *   save <file>                          reparse the file
+ *   close <file>
+ *
+ * Edits are kept in memory and passed to the IDE as buffer changes and to
+ * completion as unsaved content, files on disk are never modified.
+ */
 #include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "hashmap.h"
 #include "ide.h"
 
-#define LIBCLANG_PATH                                                          \
-    "/Applications/Xcode.app/Contents/Developer/Toolchains/"                   \
-    "XcodeDefault.xctoolchain/usr/lib/libclang.dylib"
+#define PARSE_TIMEOUT 60000
+#define MAX_RESULTS 200
+#define DEFAULT_THRESHOLD 10.0
+#define LINE_SIZE 4096
+#define NAME_SIZE 32
 
+typedef enum
+{
+    METRIC_OPEN,
+    METRIC_COMPLETE,
+    METRIC_SAVE,
+    METRIC_CLOSE,
+    METRIC_PARSE,
+    METRIC_REPARSE,
+    METRIC_COMPLETE_AT,
+    METRIC_CONVERSION,
+    METRIC_WARM_UP,
+    METRIC_COUNT
+} metric_t;
+
+// Stages follow operations in metric_t in the ide_stage_t order.
+#define FIRST_STAGE METRIC_PARSE
+
+static const char* const METRIC_NAMES[METRIC_COUNT] = {
+    "open",
+    "complete",
+    "save",
+    "close",
+    "parse",
+    "reparse",
+    "complete_at",
+    "conversion",
+    "warm_up"};
+
+typedef struct
+{
+    double* values;
+    size_t size;
+    size_t capacity;
+} samples_t;
+
+typedef struct
+{
+    size_t count;
+    double p50;
+    double p95;
+    double p99;
+} summary_t;
+
+typedef struct
+{
+    samples_t samples[METRIC_COUNT];
+    // Stages are reported from parser threads.
+    pthread_mutex_t lock;
+} recorder_t;
+
+typedef struct
+{
+    char* filename;
+    char* content;
+    size_t size;
+} document_t;
+
+typedef struct
+{
+    const char* libclang_path;
+    const char* flags_path;
+    const char* script_path;
+    const char* output_path;
+    const char* baseline_path;
+    const char* compdb_dir;
+    unsigned iterations;
+    unsigned nthreads;
+    unsigned max_results;
+    double threshold;
+} options_t;
+
+static double now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static void samples_add(samples_t* samples, double value)
+{
+    if (samples->size == samples->capacity)
+    {
+        samples->capacity = samples->capacity ? samples->capacity * 2 : 64;
+        samples->values = (double*)realloc(
+            samples->values, sizeof(double) * samples->capacity);
+    }
+
+    samples->values[samples->size++] = value;
+}
+
+static void record(recorder_t* recorder, metric_t metric, double value)
+{
+    pthread_mutex_lock(&recorder->lock);
+    samples_add(&recorder->samples[metric], value);
+    pthread_mutex_unlock(&recorder->lock);
+}
+
+static void record_stage(void* ctx, ide_stage_t stage, double duration)
+{
+    record((recorder_t*)ctx, FIRST_STAGE + stage, duration);
+}
+
+static int compare_double(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest rank percentile of sorted values.
+static double percentile(const samples_t* samples, unsigned p)
+{
+    size_t rank = (p * samples->size + 99) / 100;
+    return samples->values[rank > 0 ? rank - 1 : 0];
+}
+
+static summary_t summarize(samples_t* samples)
+{
+    qsort(samples->values, samples->size, sizeof(double), &compare_double);
+
+    summary_t summary = {.count = samples->size};
+    if (samples->size)
+    {
+        summary.p50 = percentile(samples, 50);
+        summary.p95 = percentile(samples, 95);
+        summary.p99 = percentile(samples, 99);
+    }
+
+    return summary;
+}
+
+static char* read_file(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return NULL;
+    }
+
+    size_t capacity = 4096;
+    char* data = (char*)malloc(capacity);
+    *size = 0;
+
+    size_t n;
+    while ((n = fread(data + *size, 1, capacity - *size - 1, file)) > 0)
+    {
+        *size += n;
+        if (capacity - *size == 1)
+        {
+            capacity *= 2;
+            data = (char*)realloc(data, capacity);
+        }
+    }
+
+    data[*size] = '\0';
+    fclose(file);
 
-static void print_completion(void* ctx, completion_t* completion)
+    return data;
+}
+
+// Read one flag per line, empty lines and lines starting with '#' are
+// skipped.
+static bool read_flags(const char* path, char*** flags, unsigned* nflags)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+
+    unsigned capacity = 0;
+    *flags = NULL;
+    *nflags = 0;
+
+    char line[LINE_SIZE];
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+        {
+            continue;
+        }
+
+        if (*nflags == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+            *flags = (char**)realloc(*flags, sizeof(char*) * capacity);
+        }
+        (*flags)[(*nflags)++] = strdup(line);
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+static void unescape(char* text)
+{
+    char* out = text;
+    for (char* in = text; *in; ++in)
+    {
+        if (*in == '\\' && in[1])
+        {
+            ++in;
+            *out++ = *in == 'n' ? '\n' : *in == 't' ? '\t' : *in;
+        }
+        else
+        {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+}
+
+// Byte offset of the 1 based line and column, clamped to the content.
+static size_t find_offset(document_t* document, unsigned line, unsigned column)
+{
+    size_t offset = 0;
+    for (unsigned l = 1; l < line && offset < document->size; ++offset)
+    {
+        if (document->content[offset] == '\n')
+        {
+            ++l;
+        }
+    }
+
+    offset += column - 1;
+    return offset < document->size ? offset : document->size;
+}
+
+static void insert_text(
+    document_t* document,
+    unsigned line,
+    unsigned column,
+    const char* text)
+{
+    size_t offset = find_offset(document, line, column);
+    size_t size = strlen(text);
+
+    document->content =
+        (char*)realloc(document->content, document->size + size + 1);
+    memmove(
+        document->content + offset + size,
+        document->content + offset,
+        document->size - offset + 1);
+    memcpy(document->content + offset, text, size);
+    document->size += size;
+}
+
+static void free_document(void* ctx, const void* filename, void* data)
+{
+    document_t* document = (document_t*)data;
+    free(document->filename);
+    free(document->content);
+    free(document);
+}
+
+static void ignore_completion(void* ctx, completion_t* completion)
 {
-    printf(
-        "[%c] abbr: %s menu: %s word: %s\n",
-        completion->kind,
-        completion->abbr,
-        completion->menu,
-        completion->word);
 }
 
-int main(int argc, char const* argv[])
+static void wait_parsed(ide_t* ide, const char* filename)
 {
-    if (argc != 4)
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = 100000};
+    while (ide_file_status(ide, filename) == IDE_PARSING)
+    {
+        nanosleep(&pause, NULL);
+    }
+}
+
+static bool run_line(
+    ide_t* ide,
+    hashmap_t* documents,
+    recorder_t* recorder,
+    const options_t* options,
+    char* line,
+    unsigned line_number)
+{
+    char command[NAME_SIZE];
+    char filename[LINE_SIZE];
+    int offset = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    if (sscanf(line, " %31s %4095s %n", command, filename, &offset) < 1
+        || command[0] == '#')
+    {
+        return true;
+    }
+
+    void* found = NULL;
+    bool opened = hashmap_get(documents, filename, &found);
+    document_t* document = (document_t*)found;
+    char* args = line + offset;
+
+    if (strcmp(command, "open") == 0)
+    {
+        if (!opened)
+        {
+            document = (document_t*)malloc(sizeof(document_t));
+            document->content = read_file(filename, &document->size);
+            if (!document->content)
+            {
+                fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+                free(document);
+                return false;
+            }
+            document->filename = strdup(filename);
+            hashmap_set(documents, document->filename, document);
+        }
+
+        double begin = now_ms();
+        ide_on_file_open(ide, filename);
+        wait_parsed(ide, filename);
+        record(recorder, METRIC_OPEN, now_ms() - begin);
+        return true;
+    }
+
+    if (!opened)
+    {
+        fprintf(
+            stderr, "line %u: %s is not opened\n", line_number, filename);
+        return false;
+    }
+
+    unsigned row;
+    unsigned column;
+
+    if (strcmp(command, "edit") == 0)
     {
-        printf("%s\n", "usage: completer <filename> <line> <col>");
+        int text_offset = 0;
+        if (sscanf(args, "%u %u %n", &row, &column, &text_offset) != 2)
+        {
+            fprintf(
+                stderr,
+                "line %u: usage: edit <file> <line> <column> <text>\n",
+                line_number);
+            return false;
+        }
+
+        char* text = args + text_offset;
+        unescape(text);
+        insert_text(document, row, column, text);
+        ide_on_file_change(ide, filename, document->content, document->size);
+    }
+    else if (strcmp(command, "complete") == 0)
+    {
+        char query[LINE_SIZE];
+        int nargs = sscanf(args, "%u %u %4095s", &row, &column, query);
+        if (nargs < 2)
+        {
+            fprintf(
+                stderr,
+                "line %u: usage: complete <file> <line> <column> [query]\n",
+                line_number);
+            return false;
+        }
+
+        arena_t* arena = arena_alloc();
+        double begin = now_ms();
+        ide_find_completions(
+            ide,
+            filename,
+            row,
+            column,
+            document->content,
+            (unsigned)document->size,
+            PARSE_TIMEOUT,
+            nargs == 3 ? query : NULL,
+            options->max_results,
+            arena,
+            NULL,
+            &ignore_completion);
+        record(recorder, METRIC_COMPLETE, now_ms() - begin);
+        arena_free(arena);
+    }
+    else if (strcmp(command, "save") == 0)
+    {
+        double begin = now_ms();
+        ide_on_file_save(ide, filename);
+        record(recorder, METRIC_SAVE, now_ms() - begin);
+    }
+    else if (strcmp(command, "close") == 0)
+    {
+        double begin = now_ms();
+        ide_on_file_close(ide, filename);
+        record(recorder, METRIC_CLOSE, now_ms() - begin);
+        hashmap_remove(documents, filename);
+        free_document(NULL, document->filename, document);
+    }
+    else
+    {
+        fprintf(
+            stderr, "line %u: unknown command %s\n", line_number, command);
+        return false;
+    }
+
+    return true;
+}
+
+static bool run_script(
+    ide_t* ide,
+    hashmap_t* documents,
+    recorder_t* recorder,
+    const options_t* options)
+{
+    FILE* script = fopen(options->script_path, "r");
+    if (!script)
+    {
+        fprintf(
+            stderr, "%s: %s\n", options->script_path, strerror(errno));
+        return false;
+    }
+
+    bool ok = true;
+    char line[LINE_SIZE];
+    unsigned line_number = 0;
+    while (ok && fgets(line, sizeof(line), script))
+    {
+        ok = run_line(ide, documents, recorder, options, line, ++line_number);
+    }
+
+    fclose(script);
+
+    return ok;
+}
+
+static void write_report(FILE* output, summary_t summaries[METRIC_COUNT])
+{
+    const char* sections[] = {"operations", "stages"};
+    metric_t bounds[] = {0, FIRST_STAGE, METRIC_COUNT};
+
+    fprintf(output, "{\n");
+    for (unsigned s = 0; s < 2; ++s)
+    {
+        fprintf(output, "  \"%s\": {", sections[s]);
+        const char* separator = "\n";
+        for (metric_t m = bounds[s]; m < bounds[s + 1]; ++m)
+        {
+            if (!summaries[m].count)
+            {
+                continue;
+            }
+            fprintf(
+                output,
+                "%s    \"%s\": {\"count\": %zu, \"p50\": %.3f, "
+                "\"p95\": %.3f, \"p99\": %.3f}",
+                separator,
+                METRIC_NAMES[m],
+                summaries[m].count,
+                summaries[m].p50,
+                summaries[m].p95,
+                summaries[m].p99);
+            separator = ",\n";
+        }
+        fprintf(output, "\n  }%s\n", s == 0 ? "," : "");
+    }
+    fprintf(output, "}\n");
+}
+
+// Read summaries from a report written by write_report, returns false if the
+// file cannot be read.
+static bool read_report(const char* path, summary_t summaries[METRIC_COUNT])
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+
+    memset(summaries, 0, sizeof(summary_t) * METRIC_COUNT);
+
+    char line[LINE_SIZE];
+    while (fgets(line, sizeof(line), file))
+    {
+        char name[NAME_SIZE];
+        summary_t summary;
+        if (sscanf(
+            line,
+            " \"%31[^\"]\": {\"count\": %zu, \"p50\": %lf, \"p95\": %lf, "
+            "\"p99\": %lf}",
+            name,
+            &summary.count,
+            &summary.p50,
+            &summary.p95,
+            &summary.p99) != 5)
+        {
+            continue;
+        }
+
+        for (metric_t m = 0; m < METRIC_COUNT; ++m)
+        {
+            if (strcmp(name, METRIC_NAMES[m]) == 0)
+            {
+                summaries[m] = summary;
+            }
+        }
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+static double change(double baseline, double current)
+{
+    return baseline > 0.0 ? (current - baseline) / baseline * 100.0 : 0.0;
+}
+
+// Print relative change of every metric present in both runs, returns the
+// number of metrics which p95 regressed more than the threshold.
+static unsigned compare_reports(
+    summary_t baseline[METRIC_COUNT],
+    summary_t current[METRIC_COUNT],
+    double threshold)
+{
+    unsigned regressions = 0;
+
+    fprintf(
+        stderr,
+        "%-12s %10s %10s %10s %10s\n",
+        "metric",
+        "p50 ms",
+        "p50 %",
+        "p95 %",
+        "p99 %");
+
+    for (metric_t m = 0; m < METRIC_COUNT; ++m)
+    {
+        if (!baseline[m].count || !current[m].count)
+        {
+            continue;
+        }
+
+        double p95 = change(baseline[m].p95, current[m].p95);
+        bool regressed = p95 > threshold;
+        regressions += regressed;
+
+        fprintf(
+            stderr,
+            "%-12s %10.3f %+9.1f%% %+9.1f%% %+9.1f%%%s\n",
+            METRIC_NAMES[m],
+            current[m].p50,
+            change(baseline[m].p50, current[m].p50),
+            p95,
+            change(baseline[m].p99, current[m].p99),
+            regressed ? "  REGRESSED" : "");
+    }
+
+    return regressions;
+}
+
+static void usage(const char* program)
+{
+    fprintf(
+        stderr,
+        "usage: %s [-n iterations] [-j threads] [-m max_results] "
+        "[-o report.json] [-b baseline.json] [-t threshold_percent] "
+        "[-d compile_commands_dir] <libclang> <flags_file> <script>\n",
+        program);
+}
+
+static bool parse_options(int argc, char* argv[], options_t* options)
+{
+    *options = (options_t){
+        .output_path = NULL,
+        .baseline_path = NULL,
+        .compdb_dir = NULL,
+        .iterations = 1,
+        .nthreads = 0,
+        .max_results = MAX_RESULTS,
+        .threshold = DEFAULT_THRESHOLD};
+
+    int option;
+    while ((option = getopt(argc, argv, "n:j:m:o:b:t:d:")) != -1)
+    {
+        switch (option)
+        {
+        case 'n':
+            options->iterations = (unsigned)atoi(optarg);
+            break;
+        case 'j':
+            options->nthreads = (unsigned)atoi(optarg);
+            break;
+        case 'm':
+            options->max_results = (unsigned)atoi(optarg);
+            break;
+        case 'o':
+            options->output_path = optarg;
+            break;
+        case 'b':
+            options->baseline_path = optarg;
+            break;
+        case 't':
+            options->threshold = atof(optarg);
+            break;
+        case 'd':
+            options->compdb_dir = optarg;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    if (argc - optind != 3)
+    {
+        return false;
+    }
+
+    options->libclang_path = argv[optind];
+    options->flags_path = argv[optind + 1];
+    options->script_path = argv[optind + 2];
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    options_t options;
+    if (!parse_options(argc, argv, &options))
+    {
+        usage(argv[0]);
         return 1;
     }
 
-    const char* path = argv[1];
-    int line = atoi(argv[2]);
-    int col = atoi(argv[3]);
+    char** flags;
+    unsigned nflags;
+    if (!read_flags(options.flags_path, &flags, &nflags))
+    {
+        fprintf(stderr, "%s: %s\n", options.flags_path, strerror(errno));
+        return 1;
+    }
 
-    printf("%s\n", "initializing IDE  ...");
-    const char* flags[1] = {"-Iext"};
-    ide_t* ide = ide_alloc(LIBCLANG_PATH, flags, 1);
+    ide_t* ide = ide_alloc(
+        options.libclang_path,
+        (const char* const*)flags,
+        nflags,
+        options.nthreads);
     if (!ide)
     {
-        printf("%s\n", "initialize IDE  failed");
-        return -1;
+        fprintf(stderr, "cannot load %s\n", options.libclang_path);
+        return 1;
     }
-    printf("%s\n", "initializing IDE  done");
 
-    printf("open file %s ...\n", path);
-    ide_on_file_open(ide, path);
-    printf("open file %s done\n", path);
+    if (options.compdb_dir
+        && !ide_set_compilation_database(ide, options.compdb_dir))
+    {
+        fprintf(
+            stderr,
+            "cannot load %s/compile_commands.json\n",
+            options.compdb_dir);
+        ide_free(ide);
+        return 1;
+    }
+
+    recorder_t recorder;
+    memset(&recorder, 0, sizeof(recorder));
+    pthread_mutex_init(&recorder.lock, NULL);
+    ide_set_stage_handler(ide, &recorder, &record_stage);
+
+    hashmap_t* documents = hashmap_alloc(&string_hash, &string_equals);
+
+    bool ok = true;
+    for (unsigned i = 0; ok && i < options.iterations; ++i)
+    {
+        ok = run_script(ide, documents, &recorder, &options);
+    }
+
+    // Background parses report their stages until the IDE is freed.
+    ide_free(ide);
+    hashmap_each(documents, NULL, &free_document);
+    hashmap_free(documents);
+
+    int result = ok ? 0 : 1;
+
+    summary_t summaries[METRIC_COUNT];
+    for (metric_t m = 0; m < METRIC_COUNT; ++m)
+    {
+        summaries[m] = summarize(&recorder.samples[m]);
+        free(recorder.samples[m].values);
+    }
+    pthread_mutex_destroy(&recorder.lock);
+
+    FILE* output = options.output_path
+        ? fopen(options.output_path, "w")
+        : stdout;
+    if (!output)
+    {
+        fprintf(stderr, "%s: %s\n", options.output_path, strerror(errno));
+        result = 1;
+    }
+    else
+    {
+        write_report(output, summaries);
+        if (output != stdout)
+        {
+            fclose(output);
+        }
+    }
 
-    printf("getting completions in location %d:%d ...\n", line, col);
-    ide_find_completions(ide, path, line, col, NULL, &print_completion);
-    printf("getting completions in location %d:%d done\n", line, col);
+    if (options.baseline_path)
+    {
+        summary_t baseline[METRIC_COUNT];
+        if (!read_report(options.baseline_path, baseline))
+        {
+            fprintf(
+                stderr,
+                "%s: %s\n",
+                options.baseline_path,
+                strerror(errno));
+            result = 1;
+        }
+        else if (compare_reports(baseline, summaries, options.threshold))
+        {
+            result = result ? result : 2;
+        }
+    }
+
+    for (unsigned i = 0; i < nflags; ++i)
+    {
+        free(flags[i]);
+    }
+    free(flags);
 
-    return 0;
-}
\ No newline at end of file
+    return result;
+}
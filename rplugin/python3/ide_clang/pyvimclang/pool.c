@@ -0,0 +1,144 @@
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct task
+{
+    void* ctx;
+    void (*run)(void*);
+    struct task* next;
+} task_t;
+
+struct pool
+{
+    pthread_t* threads;
+    unsigned nthreads;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    task_t* head;
+    task_t* tail;
+    bool stopping;
+};
+
+static void* pool_worker(void* arg)
+{
+    pool_t* pool = (pool_t*)arg;
+
+    pthread_mutex_lock(&pool->lock);
+
+    for (;;)
+    {
+        while (pool->head == NULL && !pool->stopping)
+        {
+            pthread_cond_wait(&pool->ready, &pool->lock);
+        }
+
+        if (pool->head == NULL)
+        {
+            break;
+        }
+
+        task_t* task = pool->head;
+        pool->head = task->next;
+        if (pool->head == NULL)
+        {
+            pool->tail = NULL;
+        }
+
+        pthread_mutex_unlock(&pool->lock);
+        (*task->run)(task->ctx);
+        free(task);
+        pthread_mutex_lock(&pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+pool_t* pool_alloc(unsigned nthreads)
+{
+    if (nthreads == 0)
+    {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? (unsigned)ncpu : 1;
+    }
+
+    pool_t* pool = (pool_t*)malloc(sizeof(pool_t));
+    pool->threads = (pthread_t*)malloc(sizeof(pthread_t) * nthreads);
+    pool->nthreads = 0;
+    pool->head = NULL;
+    pool->tail = NULL;
+    pool->stopping = false;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->ready, NULL);
+
+    for (unsigned i = 0; i < nthreads; ++i)
+    {
+        if (pthread_create(
+            &pool->threads[pool->nthreads], NULL, &pool_worker, pool) == 0)
+        {
+            ++pool->nthreads;
+        }
+    }
+
+    return pool;
+}
+
+void pool_free(pool_t* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned i = 0; i < pool->nthreads; ++i)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    // Run whatever is left when no thread could be started.
+    while (pool->head != NULL)
+    {
+        task_t* task = pool->head;
+        pool->head = task->next;
+        (*task->run)(task->ctx);
+        free(task);
+    }
+
+    pthread_cond_destroy(&pool->ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+void pool_submit(pool_t* pool, void* ctx, void (*run)(void*))
+{
+    task_t* task = (task_t*)malloc(sizeof(task_t));
+    task->ctx = ctx;
+    task->run = run;
+    task->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->tail == NULL)
+    {
+        pool->head = task;
+    }
+    else
+    {
+        pool->tail->next = task;
+    }
+    pool->tail = task;
+
+    pthread_cond_signal(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+unsigned pool_size(pool_t* pool)
+{
+    return pool->nthreads;
+}
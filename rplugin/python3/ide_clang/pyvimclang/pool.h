@@ -0,0 +1,38 @@
+/**
+ * Fixed size thread pool executing tasks in FIFO order.
+ */
+#ifndef POOL_H
+#define POOL_H
+
+typedef struct pool pool_t;
+
+/**
+ * Allocate a new pool and start its worker threads.
+ * @param  nthreads Number of worker threads, 0 means number of CPUs.
+ * @return          the new pool allocated.
+ */
+pool_t* pool_alloc(unsigned nthreads);
+
+/**
+ * Wait for queued tasks to complete, stop worker threads and deallocate the
+ * pool provided.
+ * @param pool pool to be deallocated.
+ */
+void pool_free(pool_t* pool);
+
+/**
+ * Queue the task provided for execution on one of the pool threads.
+ * @param pool pool where the task should be executed.
+ * @param ctx  closure context.
+ * @param run  the task to execute.
+ */
+void pool_submit(pool_t* pool, void* ctx, void (*run)(void*));
+
+/**
+ * Get number of worker threads of the pool provided.
+ * @param  pool the pool.
+ * @return      number of worker threads.
+ */
+unsigned pool_size(pool_t* pool);
+
+#endif // !POOL_H
@@ -3,6 +3,8 @@
  *
  * Jun 11 2017 Vladimir Bogretsov <bogrecov@gmail.com>
  */
+#define PY_SSIZE_T_CLEAN
+
 #include <errno.h>
 #include <string.h>
 
@@ -10,18 +12,37 @@
 #include "ide.h"
 
 #define IDE_DOC "IDE object."
+#define COMPLETIONS_DOC "Completion results, items are built on access."
 
 #define MODULE_DOC "Python bindings for libclang based ide functions \
 implementations."
 
+#define ECOMPLETION_INDEX "completion index out of range"
 #define EINVALID_FLAG "expected flag of type 'str' at index %d"
 #define ELIBCLANG_LOAD "unable to load libclang: %s"
 #define EARGS_INIT_FALGS_ITER "flags expected to be iterable"
 #define EARGS_INIT_FLAGS_ITER_FAILED "unexpected error when iterating flags"
 #define EARGS_ON_FILE_OPEN "expected arguments: 'str', 'str'"
 #define EARGS_ON_FILE_CLOSE "expected arguments: 'str'"
+#define EARGS_ON_FILE_CHANGE "expected arguments: 'str', 'str'"
+#define EARGS_ON_LINES_CHANGE "expected arguments: 'str', 'int', 'int', 'list'"
+#define EINVALID_LINE "expected line of type 'str' at index %zd"
 #define EARGS_ON_FILE_SAVE "expected arguments: 'str', 'str'"
-#define EARGS_FIND_COMPLETIONS "expected arguments: 'str', 'int', 'int', 'str'"
+#define EARGS_FIND_COMPLETIONS "expected arguments: 'str', 'int', 'int', \
+'str' or None, ['int', 'str', 'int']"
+#define EARGS_STREAM_COMPLETIONS "expected arguments: 'str', 'int', 'int', \
+'str' or None, 'int', 'callable', ['int', 'str', 'int']"
+#define EARGS_STATUS "expected arguments: 'str'"
+#define EARGS_WARM "expected arguments: 'str'"
+#define EARGS_SET_MEMORY_BUDGET "expected arguments: 'int'"
+#define EARGS_SET_CACHE_DIR "expected arguments: 'str'"
+#define EARGS_SET_COMPILATION_DATABASE "expected arguments: 'str'"
+#define EARGS_INDEX "expected arguments: 'list'"
+#define EARGS_LOAD_INDEX "expected arguments: 'str'"
+#define EARGS_SAVE_INDEX "expected arguments: 'str'"
+#define EARGS_FIND_LOCATION "expected arguments: 'str', 'int', 'int'"
+#define ECACHE_DIR "unable to use cache directory: %s"
+#define ECOMPILATION_DATABASE "unable to load compilation database: %s"
 
 typedef struct {
     PyObject_HEAD
@@ -30,16 +51,39 @@ typedef struct {
     int nflags;
 } pyvimclang_Ide;
 
+// Completion results stored as arrays of string offsets into a single UTF-8
+// buffer, so no Python object is created until an item is accessed.
+typedef struct {
+    PyObject_HEAD
+    arena_t* arena;
+    unsigned* abbrs;
+    unsigned* words;
+    char* kinds;
+    Py_ssize_t size;
+} pyvimclang_Completions;
+
 static PyObject* TAG_MENU;
 static PyObject* TAG_WORD;
 static PyObject* TAG_ABBR;
 static PyObject* TAG_KIND;
 static PyObject* TAG_SORT;
 static PyObject* MENU_NAME;
+static PyObject* TAG_FILENAME;
+static PyObject* TAG_LINE;
+static PyObject* TAG_COLUMN;
+static PyObject* STATUS_NAMES[5];
 
 static void
 Ide_dealloc(pyvimclang_Ide* self)
 {
+    // Pending parses read the flags, so they are freed after the ide.
+    if (self->ide)
+    {
+        // Threads running parses and indexing are joined.
+        Py_BEGIN_ALLOW_THREADS
+        ide_free(self->ide);
+        Py_END_ALLOW_THREADS
+    }
     if (self->flags)
     {
         for (int i = 0; i < self->nflags; ++i)
@@ -48,10 +92,6 @@ Ide_dealloc(pyvimclang_Ide* self)
         }
         free(self->flags);
     }
-    if (self->ide)
-    {
-        ide_free(self->ide);
-    }
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -90,7 +130,8 @@ _Ide_read_flags(pyvimclang_Ide* self, PyObject* flags)
             PyErr_Format(PyExc_TypeError, EINVALID_FLAG, i);
             return -1;
         }
-        self->flags[i++] = PyUnicode_AS_DATA(item);
+        self->flags[i++] = strdup(PyUnicode_AsUTF8(item));
+        self->nflags = i;
         Py_DECREF(item);
     }
 
@@ -113,8 +154,10 @@ Ide_init(
 {
     char* libclang_path;
     PyObject* flags_tuple = NULL;
+    unsigned nthreads = 0;
 
-    if (!PyArg_ParseTuple(args, "s|O", &libclang_path, &flags_tuple))
+    if (!PyArg_ParseTuple(
+        args, "s|OI", &libclang_path, &flags_tuple, &nthreads))
     {
         return -1;
     }
@@ -130,7 +173,10 @@ Ide_init(
     }
 
     self->ide = ide_alloc(
-        libclang_path, (const char* const*)self->flags, self->nflags);
+        libclang_path,
+        (const char* const*)self->flags,
+        self->nflags,
+        nthreads);
 
     if (self->ide == NULL)
     {
@@ -152,14 +198,85 @@ Ide_on_file_open(pyvimclang_Ide* self, PyObject* args)
         {
             PyErr_SetString(
                 PyExc_TypeError, EARGS_ON_FILE_OPEN);
-            Py_RETURN_NONE;
+            return NULL;
         }
 
+        Py_BEGIN_ALLOW_THREADS
         ide_on_file_open(self->ide, path);
+        Py_END_ALLOW_THREADS
     }
     Py_RETURN_NONE;
 }
 
+static PyObject*
+Ide_on_file_change(pyvimclang_Ide* self, PyObject* args)
+{
+    if (self->ide)
+    {
+        char* path;
+        char* content;
+        Py_ssize_t size;
+
+        if (!PyArg_ParseTuple(args, "ss#", &path, &content, &size))
+        {
+            PyErr_SetString(PyExc_TypeError, EARGS_ON_FILE_CHANGE);
+            return NULL;
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        ide_on_file_change(self->ide, path, content, (size_t)size);
+        Py_END_ALLOW_THREADS
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+Ide_on_lines_change(pyvimclang_Ide* self, PyObject* args)
+{
+    if (!self->ide)
+    {
+        Py_RETURN_NONE;
+    }
+
+    char* path;
+    long first;
+    long last;
+    PyObject* list;
+    if (!PyArg_ParseTuple(
+        args, "sllO!", &path, &first, &last, &PyList_Type, &list))
+    {
+        PyErr_SetString(PyExc_TypeError, EARGS_ON_LINES_CHANGE);
+        return NULL;
+    }
+
+    Py_ssize_t nlines = PyList_Size(list);
+    const char** lines = (const char**)malloc(sizeof(char*) * (nlines + 1));
+    for (Py_ssize_t i = 0; i < nlines; ++i)
+    {
+        // UTF-8 of the str is cached by the object which the list keeps.
+        lines[i] = PyUnicode_Check(PyList_GetItem(list, i))
+            ? PyUnicode_AsUTF8(PyList_GetItem(list, i))
+            : NULL;
+        if (!lines[i])
+        {
+            free(lines);
+            PyErr_Clear();
+            PyErr_Format(PyExc_TypeError, EINVALID_LINE, i);
+            return NULL;
+        }
+    }
+
+    bool changed;
+    Py_BEGIN_ALLOW_THREADS
+    changed = ide_on_lines_change(
+        self->ide, path, first, last, lines, (unsigned)nlines);
+    Py_END_ALLOW_THREADS
+
+    free(lines);
+
+    return PyBool_FromLong(changed);
+}
+
 static PyObject*
 Ide_on_file_save(pyvimclang_Ide* self, PyObject* args)
 {
@@ -170,10 +287,12 @@ Ide_on_file_save(pyvimclang_Ide* self, PyObject* args)
         if (!PyArg_ParseTuple(args, "s", &path))
         {
             PyErr_SetString(PyExc_TypeError, EARGS_ON_FILE_SAVE);
-            Py_RETURN_NONE;
+            return NULL;
         }
 
+        Py_BEGIN_ALLOW_THREADS
         ide_on_file_save(self->ide, path);
+        Py_END_ALLOW_THREADS
     }
     Py_RETURN_NONE;
 }
@@ -187,24 +306,412 @@ Ide_on_file_close(pyvimclang_Ide* self, PyObject* args)
         if (!PyArg_ParseTuple(args, "s", &path))
         {
             PyErr_SetString(PyExc_TypeError, EARGS_ON_FILE_CLOSE);
-            Py_RETURN_NONE;
+            return NULL;
         }
 
+        Py_BEGIN_ALLOW_THREADS
         ide_on_file_close(self->ide, path);
+        Py_END_ALLOW_THREADS
     }
     Py_RETURN_NONE;
 }
 
-static void insert_completion(void* ctx, completion_t* completion)
+static PyObject*
+Ide_set_memory_budget(pyvimclang_Ide* self, PyObject* args)
 {
+    if (self->ide)
+    {
+        Py_ssize_t budget;
+        if (!PyArg_ParseTuple(args, "n", &budget))
+        {
+            PyErr_SetString(PyExc_TypeError, EARGS_SET_MEMORY_BUDGET);
+            return NULL;
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        ide_set_memory_budget(self->ide, (size_t)budget);
+        Py_END_ALLOW_THREADS
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+Ide_set_cache_dir(pyvimclang_Ide* self, PyObject* args)
+{
+    if (self->ide)
+    {
+        char* path;
+        if (!PyArg_ParseTuple(args, "s", &path))
+        {
+            PyErr_SetString(PyExc_TypeError, EARGS_SET_CACHE_DIR);
+            return NULL;
+        }
+
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = ide_set_cache_dir(self->ide, path);
+        Py_END_ALLOW_THREADS
+
+        if (!ok)
+        {
+            PyErr_Format(PyExc_OSError, ECACHE_DIR, path);
+            return NULL;
+        }
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+Ide_set_compilation_database(pyvimclang_Ide* self, PyObject* args)
+{
+    if (self->ide)
+    {
+        char* dir;
+        if (!PyArg_ParseTuple(args, "s", &dir))
+        {
+            PyErr_SetString(PyExc_TypeError, EARGS_SET_COMPILATION_DATABASE);
+            return NULL;
+        }
+
+        bool ok;
+        Py_BEGIN_ALLOW_THREADS
+        ok = ide_set_compilation_database(self->ide, dir);
+        Py_END_ALLOW_THREADS
+
+        if (!ok)
+        {
+            PyErr_Format(PyExc_OSError, ECOMPILATION_DATABASE, dir);
+            return NULL;
+        }
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+Ide_status(pyvimclang_Ide* self, PyObject* args)
+{
+    if (!self->ide)
+    {
+        Py_RETURN_NONE;
+    }
+
+    char* path;
+    if (!PyArg_ParseTuple(args, "s", &path))
+    {
+        PyErr_SetString(PyExc_TypeError, EARGS_STATUS);
+        return NULL;
+    }
+
+    ide_status_t code;
+    Py_BEGIN_ALLOW_THREADS
+    code = ide_file_status(self->ide, path);
+    Py_END_ALLOW_THREADS
+
+    PyObject* status = STATUS_NAMES[code];
+    Py_INCREF(status);
+    return status;
+}
+
+static PyObject*
+Ide_warm(pyvimclang_Ide* self, PyObject* args)
+{
+    if (!self->ide)
+    {
+        Py_RETURN_NONE;
+    }
+
+    char* path;
+    if (!PyArg_ParseTuple(args, "s", &path))
+    {
+        PyErr_SetString(PyExc_TypeError, EARGS_WARM);
+        return NULL;
+    }
+
+    bool warm;
+    double elapsed;
+    Py_BEGIN_ALLOW_THREADS
+    warm = ide_file_warm(self->ide, path, &elapsed);
+    Py_END_ALLOW_THREADS
+
+    if (!warm)
+    {
+        Py_RETURN_NONE;
+    }
+
+    return PyFloat_FromDouble(elapsed);
+}
+
+static void
+Completions_dealloc(pyvimclang_Completions* self)
+{
+    if (self->arena)
+    {
+        arena_free(self->arena);
+    }
+    free(self->abbrs);
+    free(self->words);
+    free(self->kinds);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static Py_ssize_t
+Completions_length(pyvimclang_Completions* self)
+{
+    return self->size;
+}
+
+// Build the vim complete-item of the completion at the index provided.
+static PyObject*
+Completions_build_item(pyvimclang_Completions* self, Py_ssize_t i)
+{
+    char kind[] = {self->kinds[i], '\0'};
     PyObject* item = PyDict_New();
-    char kind[] = {completion->kind, '\0'};
-    PyDict_SetItem(item, TAG_KIND, PyUnicode_FromString(kind));
+    PyObject* kind_str = PyUnicode_FromString(kind);
+    PyObject* abbr =
+        PyUnicode_FromString(arena_get(self->arena, self->abbrs[i]));
+    PyObject* word =
+        PyUnicode_FromString(arena_get(self->arena, self->words[i]));
+
+    PyDict_SetItem(item, TAG_KIND, kind_str);
     PyDict_SetItem(item, TAG_MENU, MENU_NAME);
-    PyDict_SetItem(item, TAG_ABBR, PyUnicode_FromString(completion->abbr));
-    PyDict_SetItem(item, TAG_WORD, PyUnicode_FromString(completion->word));
-    PyDict_SetItem(item, TAG_SORT, PyUnicode_FromString(completion->sort));
-    PyList_Append((PyObject*)ctx, item);
+    PyDict_SetItem(item, TAG_ABBR, abbr);
+    PyDict_SetItem(item, TAG_WORD, word);
+    PyDict_SetItem(item, TAG_SORT, word);
+
+    // The dict holds its own references.
+    Py_DECREF(kind_str);
+    Py_DECREF(abbr);
+    Py_DECREF(word);
+
+    return item;
+}
+
+static PyObject*
+Completions_item(pyvimclang_Completions* self, Py_ssize_t i)
+{
+    if (i < 0 || i >= self->size)
+    {
+        PyErr_SetString(PyExc_IndexError, ECOMPLETION_INDEX);
+        return NULL;
+    }
+
+    return Completions_build_item(self, i);
+}
+
+static PyObject*
+Completions_to_list(pyvimclang_Completions* self, PyObject* args)
+{
+    PyObject* list = PyList_New(self->size);
+    for (Py_ssize_t i = 0; i < self->size; ++i)
+    {
+        PyList_SET_ITEM(list, i, Completions_build_item(self, i));
+    }
+    return list;
+}
+
+// Slices are returned as lists of complete-items.
+static PyObject*
+Completions_subscript(pyvimclang_Completions* self, PyObject* key)
+{
+    if (!PySlice_Check(key))
+    {
+        Py_ssize_t i = PyNumber_AsSsize_t(key, PyExc_IndexError);
+        if (i == -1 && PyErr_Occurred())
+        {
+            return NULL;
+        }
+        return Completions_item(self, i < 0 ? i + self->size : i);
+    }
+
+    Py_ssize_t start;
+    Py_ssize_t stop;
+    Py_ssize_t step;
+    if (PySlice_Unpack(key, &start, &stop, &step) < 0)
+    {
+        return NULL;
+    }
+
+    Py_ssize_t size = PySlice_AdjustIndices(self->size, &start, &stop, step);
+    PyObject* list = PyList_New(size);
+    for (Py_ssize_t i = 0; i < size; ++i)
+    {
+        PyList_SET_ITEM(
+            list, i, Completions_build_item(self, start + i * step));
+    }
+    return list;
+}
+
+static PyMappingMethods Completions_mapping = {
+    (lenfunc)Completions_length,                /* mp_length */
+    (binaryfunc)Completions_subscript,          /* mp_subscript */
+};
+
+static PySequenceMethods Completions_sequence = {
+    (lenfunc)Completions_length,                /* sq_length */
+    0,                                          /* sq_concat */
+    0,                                          /* sq_repeat */
+    (ssizeargfunc)Completions_item,             /* sq_item */
+};
+
+static PyMethodDef Completions_methods[] =
+{
+    {
+        "to_list",
+        (PyCFunction)Completions_to_list,
+        METH_NOARGS,
+        "Get the completions as a list of vim complete-items."
+    },
+    {
+        NULL
+    }
+};
+
+static PyTypeObject pyvimclang_CompletionsType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "pyvimclang.Completions",                   /* tp_name */
+    sizeof(pyvimclang_Completions),             /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor)Completions_dealloc,            /* tp_dealloc */
+    0,                                          /* tp_print */
+    0,                                          /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_reserved */
+    0,                                          /* tp_repr */
+    0,                                          /* tp_as_number */
+    &Completions_sequence,                      /* tp_as_sequence */
+    &Completions_mapping,                       /* tp_as_mapping */
+    0,                                          /* tp_hash  */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    0,                                          /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                         /* tp_flags */
+    COMPLETIONS_DOC,                            /* tp_doc */
+    0,                                          /* tp_traverse */
+    0,                                          /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    0,                                          /* tp_iter */
+    0,                                          /* tp_iternext */
+    Completions_methods,                        /* tp_methods */
+};
+
+// Completions are collected without the GIL and converted to Python objects
+// once libclang is done, or once a batch is full when streaming.
+typedef struct
+{
+    completion_t* items;
+    size_t size;
+    size_t capacity;
+    arena_t* arena;
+    // Streaming callback receiving lists of batch_size items, NULL collects
+    // all the items.
+    PyObject* onbatch;
+    size_t batch_size;
+    size_t delivered;
+    // Exception raised by the callback, later batches are dropped.
+    PyObject* error_type;
+    PyObject* error_value;
+    PyObject* error_traceback;
+} completions_t;
+
+// Move the collected completions to a new results object. When streaming the
+// arena is still used by libclang conversion, so the strings are copied.
+static PyObject* build_completions(completions_t* completions)
+{
+    pyvimclang_Completions* results = PyObject_New(
+        pyvimclang_Completions, &pyvimclang_CompletionsType);
+    size_t size = completions->size;
+    results->size = (Py_ssize_t)size;
+    results->abbrs = (unsigned*)malloc(sizeof(unsigned) * (size + 1));
+    results->words = (unsigned*)malloc(sizeof(unsigned) * (size + 1));
+    results->kinds = (char*)malloc(size + 1);
+
+    arena_t* arena = completions->arena;
+    if (completions->onbatch)
+    {
+        results->arena = arena_alloc();
+        for (size_t i = 0; i < size; ++i)
+        {
+            completion_t* completion = &completions->items[i];
+            results->abbrs[i] = arena_strdup(
+                results->arena, arena_get(arena, completion->abbr));
+            results->words[i] = arena_strdup(
+                results->arena, arena_get(arena, completion->word));
+        }
+    }
+    else
+    {
+        results->arena = arena;
+        completions->arena = NULL;
+        for (size_t i = 0; i < size; ++i)
+        {
+            results->abbrs[i] = completions->items[i].abbr;
+            results->words[i] = completions->items[i].word;
+        }
+    }
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        results->kinds[i] = completions->items[i].kind;
+    }
+
+    return (PyObject*)results;
+}
+
+// Pass the collected items to the streaming callback, called without the
+// GIL.
+static void deliver_batch(completions_t* completions)
+{
+    PyGILState_STATE gil = PyGILState_Ensure();
+
+    if (!completions->error_type)
+    {
+        PyObject* batch = build_completions(completions);
+        PyObject* result =
+            PyObject_CallFunctionObjArgs(completions->onbatch, batch, NULL);
+        Py_DECREF(batch);
+
+        if (result)
+        {
+            Py_DECREF(result);
+            completions->delivered += completions->size;
+        }
+        else
+        {
+            PyErr_Fetch(
+                &completions->error_type,
+                &completions->error_value,
+                &completions->error_traceback);
+        }
+    }
+
+    PyGILState_Release(gil);
+
+    // Items of the batch are converted, so their strings can be dropped.
+    completions->size = 0;
+    arena_reset(completions->arena);
+}
+
+static void collect_completion(void* ctx, completion_t* completion)
+{
+    completions_t* completions = (completions_t*)ctx;
+
+    if (completions->size == completions->capacity)
+    {
+        completions->capacity =
+            completions->capacity ? completions->capacity * 2 : 64;
+        completions->items = (completion_t*)realloc(
+            completions->items, sizeof(completion_t) * completions->capacity);
+    }
+
+    completions->items[completions->size++] = *completion;
+
+    if (completions->onbatch && completions->size == completions->batch_size)
+    {
+        deliver_batch(completions);
+    }
 }
 
 static PyObject*
@@ -219,47 +726,348 @@ Ide_find_completions(pyvimclang_Ide* self, PyObject* args)
     unsigned line;
     unsigned column;
     char* content;
-    unsigned size;
+    Py_ssize_t size;
+    unsigned timeout = 0;
+    char* query = NULL;
+    unsigned max_results = 0;
 
     if (!PyArg_ParseTuple(
-        args, "siis#", &path, &line, &column, &content, &size))
+        args,
+        "siiz#|IzI",
+        &path,
+        &line,
+        &column,
+        &content,
+        &size,
+        &timeout,
+        &query,
+        &max_results))
     {
         PyErr_SetString(PyExc_TypeError, EARGS_FIND_COMPLETIONS);
+        return NULL;
+    }
+
+    completions_t completions = {
+        .items = NULL,
+        .size = 0,
+        .capacity = 0,
+        .arena = arena_alloc(),
+        .onbatch = NULL};
+
+    Py_BEGIN_ALLOW_THREADS
+    ide_find_completions(
+        self->ide,
+        path,
+        line,
+        column,
+        content,
+        (unsigned)size,
+        timeout,
+        query,
+        max_results,
+        completions.arena,
+        &completions,
+        &collect_completion);
+    Py_END_ALLOW_THREADS
+
+    // The results stay empty if the file is still being parsed, use status()
+    // to find out why.
+    PyObject* res = build_completions(&completions);
+    free(completions.items);
+
+    return res;
+}
+
+static PyObject*
+Ide_stream_completions(pyvimclang_Ide* self, PyObject* args)
+{
+    if (!self->ide)
+    {
         Py_RETURN_NONE;
     }
 
-    PyObject* res = PyList_New(0);
+    char* path;
+    unsigned line;
+    unsigned column;
+    char* content;
+    Py_ssize_t size;
+    unsigned batch_size;
+    PyObject* onbatch;
+    unsigned timeout = 0;
+    char* query = NULL;
+    unsigned max_results = 0;
+
+    if (!PyArg_ParseTuple(
+        args,
+        "siiz#IO|IzI",
+        &path,
+        &line,
+        &column,
+        &content,
+        &size,
+        &batch_size,
+        &onbatch,
+        &timeout,
+        &query,
+        &max_results)
+        || batch_size == 0
+        || !PyCallable_Check(onbatch))
+    {
+        PyErr_SetString(PyExc_TypeError, EARGS_STREAM_COMPLETIONS);
+        return NULL;
+    }
+
+    completions_t completions = {
+        .items = NULL,
+        .size = 0,
+        .capacity = 0,
+        .arena = arena_alloc(),
+        .onbatch = onbatch,
+        .batch_size = batch_size,
+        .delivered = 0,
+        .error_type = NULL,
+        .error_value = NULL,
+        .error_traceback = NULL};
+
+    Py_BEGIN_ALLOW_THREADS
     ide_find_completions(
-        self->ide, path, line, column, content, size, res, &insert_completion);
+        self->ide,
+        path,
+        line,
+        column,
+        content,
+        (unsigned)size,
+        timeout,
+        query,
+        max_results,
+        completions.arena,
+        &completions,
+        &collect_completion);
+    if (completions.size > 0)
+    {
+        deliver_batch(&completions);
+    }
+    Py_END_ALLOW_THREADS
+
+    free(completions.items);
+    arena_free(completions.arena);
+
+    if (completions.error_type)
+    {
+        PyErr_Restore(
+            completions.error_type,
+            completions.error_value,
+            completions.error_traceback);
+        return NULL;
+    }
+
+    return PyLong_FromSize_t(completions.delivered);
+}
+
+static PyObject*
+Ide_index(pyvimclang_Ide* self, PyObject* args)
+{
+    if (!self->ide)
+    {
+        Py_RETURN_NONE;
+    }
+
+    PyObject* files;
+    if (!PyArg_ParseTuple(args, "O!", &PyList_Type, &files))
+    {
+        PyErr_SetString(PyExc_TypeError, EARGS_INDEX);
+        return NULL;
+    }
+
+    Py_ssize_t nfiles = PyList_Size(files);
+    const char** filenames =
+        (const char**)malloc(sizeof(char*) * (nfiles + 1));
+
+    for (Py_ssize_t i = 0; i < nfiles; ++i)
+    {
+        filenames[i] = PyUnicode_AsUTF8(PyList_GetItem(files, i));
+        if (!filenames[i])
+        {
+            free(filenames);
+            return NULL;
+        }
+    }
+
+    ide_index_files(self->ide, filenames, (unsigned)nfiles);
+    free(filenames);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+Ide_index_pending(pyvimclang_Ide* self, PyObject* args)
+{
+    if (!self->ide)
+    {
+        Py_RETURN_NONE;
+    }
+
+    return PyLong_FromUnsignedLong(ide_index_pending(self->ide));
+}
+
+static PyObject*
+Ide_load_index(pyvimclang_Ide* self, PyObject* args)
+{
+    if (!self->ide)
+    {
+        Py_RETURN_NONE;
+    }
+
+    char* path;
+    if (!PyArg_ParseTuple(args, "s", &path))
+    {
+        PyErr_SetString(PyExc_TypeError, EARGS_LOAD_INDEX);
+        return NULL;
+    }
+
+    bool loaded;
+    Py_BEGIN_ALLOW_THREADS
+    loaded = ide_load_index(self->ide, path);
+    Py_END_ALLOW_THREADS
+
+    return PyBool_FromLong(loaded);
+}
+
+static PyObject*
+Ide_save_index(pyvimclang_Ide* self, PyObject* args)
+{
+    if (!self->ide)
+    {
+        Py_RETURN_NONE;
+    }
+
+    char* path;
+    if (!PyArg_ParseTuple(args, "s", &path))
+    {
+        PyErr_SetString(PyExc_TypeError, EARGS_SAVE_INDEX);
+        return NULL;
+    }
+
+    bool saved;
+    Py_BEGIN_ALLOW_THREADS
+    saved = ide_save_index(self->ide, path);
+    Py_END_ALLOW_THREADS
+
+    return PyBool_FromLong(saved);
+}
+
+// Locations are collected without the GIL, file names are copied as they
+// are only valid during the callback.
+typedef struct
+{
+    location_t* items;
+    size_t size;
+    size_t capacity;
+} locations_t;
+
+static void collect_location(void* ctx, location_t* location)
+{
+    locations_t* locations = (locations_t*)ctx;
+
+    if (locations->size == locations->capacity)
+    {
+        locations->capacity =
+            locations->capacity ? locations->capacity * 2 : 8;
+        locations->items = (location_t*)realloc(
+            locations->items, sizeof(location_t) * locations->capacity);
+    }
+
+    location_t* item = &locations->items[locations->size++];
+    item->filename = strdup(location->filename);
+    item->line = location->line;
+    item->column = location->column;
+}
+
+static PyObject* locations_to_list(locations_t* locations)
+{
+    PyObject* res = PyList_New(0);
+
+    for (size_t i = 0; i < locations->size; ++i)
+    {
+        location_t* location = &locations->items[i];
+        PyObject* item = PyDict_New();
+        PyObject* filename = PyUnicode_FromString(location->filename);
+        PyObject* line = PyLong_FromUnsignedLong(location->line);
+        PyObject* column = PyLong_FromUnsignedLong(location->column);
+        PyDict_SetItem(item, TAG_FILENAME, filename);
+        PyDict_SetItem(item, TAG_LINE, line);
+        PyDict_SetItem(item, TAG_COLUMN, column);
+        Py_DECREF(filename);
+        Py_DECREF(line);
+        Py_DECREF(column);
+        PyList_Append(res, item);
+        Py_DECREF(item);
+        free((void*)location->filename);
+    }
+
+    free(locations->items);
+
     return res;
 }
 
+static PyObject*
+_Ide_find_locations(
+    pyvimclang_Ide* self,
+    PyObject* args,
+    ide_status_t (*find)(
+        ide_t*,
+        const char*,
+        unsigned,
+        unsigned,
+        void*,
+        void (*)(void*, location_t*)))
+{
+    if (!self->ide)
+    {
+        Py_RETURN_NONE;
+    }
+
+    char* path;
+    unsigned line;
+    unsigned column;
+
+    if (!PyArg_ParseTuple(args, "sII", &path, &line, &column))
+    {
+        PyErr_SetString(PyExc_TypeError, EARGS_FIND_LOCATION);
+        return NULL;
+    }
+
+    locations_t locations = {.items = NULL, .size = 0, .capacity = 0};
+
+    Py_BEGIN_ALLOW_THREADS
+    (*find)(self->ide, path, line, column, &locations, &collect_location);
+    Py_END_ALLOW_THREADS
+
+    return locations_to_list(&locations);
+}
+
 static PyObject*
 Ide_find_definition(pyvimclang_Ide* self, PyObject* args)
 {
-    // Not implemented.
-    Py_RETURN_NONE;
+    return _Ide_find_locations(self, args, &ide_find_definition);
 }
 
 static PyObject*
 Ide_find_declaration(pyvimclang_Ide* self, PyObject* args)
 {
-    // Not implemented.
-    Py_RETURN_NONE;
+    return _Ide_find_locations(self, args, &ide_find_declaration);
 }
 
 static PyObject*
 Ide_find_assingments(pyvimclang_Ide* self, PyObject* args)
 {
-    // Not implemented.
-    Py_RETURN_NONE;
+    return _Ide_find_locations(self, args, &ide_find_assingments);
 }
 
 static PyObject*
 Ide_find_references(pyvimclang_Ide* self, PyObject* args)
 {
-    // Not implemented.
-    Py_RETURN_NONE;
+    return _Ide_find_locations(self, args, &ide_find_references);
 }
 
 static PyMethodDef Ide_methods[] =
@@ -270,6 +1078,18 @@ static PyMethodDef Ide_methods[] =
         METH_VARARGS,
         "Open file."
     },
+    {
+        "on_file_change",
+        (PyCFunction)Ide_on_file_change,
+        METH_VARARGS,
+        "Change file buffer."
+    },
+    {
+        "on_lines_change",
+        (PyCFunction)Ide_on_lines_change,
+        METH_VARARGS,
+        "Replace lines of the file buffer mirror."
+    },
     {
         "on_file_save",
         (PyCFunction)Ide_on_file_save,
@@ -282,12 +1102,73 @@ static PyMethodDef Ide_methods[] =
         METH_VARARGS,
         "Close file."
     },
+    {
+        "set_memory_budget",
+        (PyCFunction)Ide_set_memory_budget,
+        METH_VARARGS,
+        "Set memory limit for translation units in bytes."
+    },
+    {
+        "set_cache_dir",
+        (PyCFunction)Ide_set_cache_dir,
+        METH_VARARGS,
+        "Enable persistent AST cache in the directory."
+    },
+    {
+        "set_compilation_database",
+        (PyCFunction)Ide_set_compilation_database,
+        METH_VARARGS,
+        "Take per file flags from compile_commands.json in the directory."
+    },
+    {
+        "status",
+        (PyCFunction)Ide_status,
+        METH_VARARGS,
+        "Get file parsing status."
+    },
+    {
+        "warm",
+        (PyCFunction)Ide_warm,
+        METH_VARARGS,
+        "Get milliseconds until the file became warm, None while cold."
+    },
     {
         "find_completions",
         (PyCFunction)Ide_find_completions,
         METH_VARARGS,
         "Find completions."
     },
+    {
+        "stream_completions",
+        (PyCFunction)Ide_stream_completions,
+        METH_VARARGS,
+        "Find completions passing them to the callback in batches, the best "
+        "ones first."
+    },
+    {
+        "index",
+        (PyCFunction)Ide_index,
+        METH_VARARGS,
+        "Index source files in background."
+    },
+    {
+        "index_pending",
+        (PyCFunction)Ide_index_pending,
+        METH_NOARGS,
+        "Get number of files waiting to be indexed."
+    },
+    {
+        "load_index",
+        (PyCFunction)Ide_load_index,
+        METH_VARARGS,
+        "Load project index from a file."
+    },
+    {
+        "save_index",
+        (PyCFunction)Ide_save_index,
+        METH_VARARGS,
+        "Save project index to a file."
+    },
     {
         "find_definition",
         (PyCFunction)Ide_find_definition,
@@ -371,7 +1252,8 @@ PyInit_pyvimclang(void)
 {
     PyObject* module = NULL;
     pyvimclang_IdeType.tp_new = PyType_GenericNew;
-    if (PyType_Ready(&pyvimclang_IdeType) >= 0)
+    if (PyType_Ready(&pyvimclang_IdeType) >= 0
+        && PyType_Ready(&pyvimclang_CompletionsType) >= 0)
     {
         module = PyModule_Create(&pyvimclangmodule);
         if (module != NULL)
@@ -382,6 +1264,12 @@ PyInit_pyvimclang(void)
                 "Ide",
                 (PyObject*)&pyvimclang_IdeType);
 
+            Py_INCREF(&pyvimclang_CompletionsType);
+            PyModule_AddObject(
+                module,
+                "Completions",
+                (PyObject*)&pyvimclang_CompletionsType);
+
             TAG_MENU = PyUnicode_FromString("menu");
             Py_INCREF(TAG_MENU);
             PyModule_AddObject(module, "TAG_MENU", TAG_MENU);
@@ -405,6 +1293,42 @@ PyInit_pyvimclang(void)
             MENU_NAME = PyUnicode_FromString("[clang]");
             Py_INCREF(MENU_NAME);
             PyModule_AddObject(module, "MENU_NAME", MENU_NAME);
+
+            TAG_FILENAME = PyUnicode_FromString("filename");
+            Py_INCREF(TAG_FILENAME);
+            PyModule_AddObject(module, "TAG_FILENAME", TAG_FILENAME);
+
+            TAG_LINE = PyUnicode_FromString("line");
+            Py_INCREF(TAG_LINE);
+            PyModule_AddObject(module, "TAG_LINE", TAG_LINE);
+
+            TAG_COLUMN = PyUnicode_FromString("column");
+            Py_INCREF(TAG_COLUMN);
+            PyModule_AddObject(module, "TAG_COLUMN", TAG_COLUMN);
+
+            STATUS_NAMES[IDE_OK] = PyUnicode_FromString("ok");
+            Py_INCREF(STATUS_NAMES[IDE_OK]);
+            PyModule_AddObject(module, "STATUS_OK", STATUS_NAMES[IDE_OK]);
+
+            STATUS_NAMES[IDE_PARSING] = PyUnicode_FromString("parsing");
+            Py_INCREF(STATUS_NAMES[IDE_PARSING]);
+            PyModule_AddObject(
+                module, "STATUS_PARSING", STATUS_NAMES[IDE_PARSING]);
+
+            STATUS_NAMES[IDE_FAILED] = PyUnicode_FromString("failed");
+            Py_INCREF(STATUS_NAMES[IDE_FAILED]);
+            PyModule_AddObject(
+                module, "STATUS_FAILED", STATUS_NAMES[IDE_FAILED]);
+
+            STATUS_NAMES[IDE_NOT_FOUND] = PyUnicode_FromString("not_found");
+            Py_INCREF(STATUS_NAMES[IDE_NOT_FOUND]);
+            PyModule_AddObject(
+                module, "STATUS_NOT_FOUND", STATUS_NAMES[IDE_NOT_FOUND]);
+
+            STATUS_NAMES[IDE_EVICTED] = PyUnicode_FromString("evicted");
+            Py_INCREF(STATUS_NAMES[IDE_EVICTED]);
+            PyModule_AddObject(
+                module, "STATUS_EVICTED", STATUS_NAMES[IDE_EVICTED]);
         }
     }
     return module;
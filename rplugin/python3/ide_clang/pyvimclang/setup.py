@@ -12,13 +12,30 @@ PREFIX = "pyvimclang"
 
 main_module_kwargs = {
     "sources": [
+        os.path.join(PREFIX, "arena.c"),
+        os.path.join(PREFIX, "astcache.c"),
+        os.path.join(PREFIX, "compdb.c"),
+        os.path.join(PREFIX, "document.c"),
+        os.path.join(PREFIX, "filestate.c"),
+        os.path.join(PREFIX, "fuzzy.c"),
+        os.path.join(PREFIX, "hash.c"),
         os.path.join(PREFIX, "hashmap.c"),
         os.path.join(PREFIX, "ide.c"),
+        os.path.join(PREFIX, "indexer.c"),
         os.path.join(PREFIX, "libclang.c"),
-        os.path.join(PREFIX, "pyvimclang.c")
+        os.path.join(PREFIX, "pool.c"),
+        os.path.join(PREFIX, "pyvimclang.c"),
+        os.path.join(PREFIX, "symfile.c"),
+        os.path.join(PREFIX, "symindex.c")
     ],
     "include_dirs": [
         PREFIX
+    ],
+    "extra_compile_args": [
+        "-pthread"
+    ],
+    "extra_link_args": [
+        "-pthread"
     ]
 }
 
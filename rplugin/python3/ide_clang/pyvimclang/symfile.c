@@ -0,0 +1,861 @@
+#include "symfile.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SYMFILE_MAGIC "IDESYMS"
+#define SYMFILE_VERSION 2
+
+// Kinds of locations stored for every symbol, in the order of symbol_kind_t.
+#define NKINDS 3
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nfiles;
+    uint32_t nsymbols;
+    uint32_t nsources;
+    // Length of the longest USR.
+    uint32_t max_usr;
+    // Section offsets from the beginning of the file.
+    uint32_t files;
+    uint32_t names;
+    uint32_t blocks;
+    uint32_t usrs;
+    uint32_t postings;
+    uint32_t sources;
+    uint32_t dependencies;
+    uint32_t size;
+} header_t;
+
+struct symfile
+{
+    void* data;
+    const header_t* header;
+    const uint32_t* files;
+    const char* names;
+    const uint32_t* blocks;
+    uint32_t nblocks;
+    const uint8_t* usrs;
+    const uint8_t* postings;
+    const uint32_t* sources;
+    const uint8_t* dependencies;
+    const uint8_t* end;
+};
+
+typedef struct
+{
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} buffer_t;
+
+typedef struct
+{
+    symfile_t* file;
+    void* ctx;
+    void (*onlocation)(void*, location_t*);
+    void (*onentry)(void*, const symbol_entry_t*);
+    const char* usr;
+} postings_reader_t;
+
+static uint32_t read_varint(const uint8_t** p, const uint8_t* end)
+{
+    uint32_t value = 0;
+    for (unsigned shift = 0; *p < end && shift < 32; shift += 7)
+    {
+        uint8_t byte = *(*p)++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            break;
+        }
+    }
+    return value;
+}
+
+static uint64_t read_varint64(const uint8_t** p, const uint8_t* end)
+{
+    uint64_t value = 0;
+    for (unsigned shift = 0; *p < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *(*p)++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            break;
+        }
+    }
+    return value;
+}
+
+static bool valid_header(const header_t* header, size_t size)
+{
+    uint32_t nblocks =
+        (header->nsymbols + SYMFILE_BLOCK_SIZE - 1) / SYMFILE_BLOCK_SIZE;
+
+    return memcmp(header->magic, SYMFILE_MAGIC, sizeof(header->magic)) == 0
+        && header->version == SYMFILE_VERSION
+        && header->size == size
+        && header->files == sizeof(header_t)
+        && header->files + (uint64_t)header->nfiles * 4 <= header->names
+        && header->names <= header->blocks
+        && header->blocks % 4 == 0
+        && header->blocks + (uint64_t)nblocks * 4 <= header->usrs
+        && header->usrs <= header->postings
+        && header->postings <= header->sources
+        && header->sources % 4 == 0
+        && header->sources + (uint64_t)header->nsources * 4
+            <= header->dependencies
+        && header->dependencies <= header->size;
+}
+
+symfile_t* symfile_open(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(header_t))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    const header_t* header = (const header_t*)data;
+    const uint8_t* bytes = (const uint8_t*)data;
+    if (!valid_header(header, st.st_size)
+        || (header->nfiles && bytes[header->blocks - 1] != '\0'))
+    {
+        munmap(data, st.st_size);
+        return NULL;
+    }
+
+    symfile_t* file = (symfile_t*)malloc(sizeof(symfile_t));
+    file->data = data;
+    file->header = header;
+    file->files = (const uint32_t*)(bytes + header->files);
+    file->names = (const char*)(bytes + header->names);
+    file->blocks = (const uint32_t*)(bytes + header->blocks);
+    file->nblocks =
+        (header->nsymbols + SYMFILE_BLOCK_SIZE - 1) / SYMFILE_BLOCK_SIZE;
+    file->usrs = bytes + header->usrs;
+    file->postings = bytes + header->postings;
+    file->sources = (const uint32_t*)(bytes + header->sources);
+    file->dependencies = bytes + header->dependencies;
+    file->end = bytes + header->size;
+
+    return file;
+}
+
+void symfile_close(symfile_t* file)
+{
+    munmap(file->data, file->header->size);
+    free(file);
+}
+
+size_t symfile_size(symfile_t* file)
+{
+    return file->header->nsymbols;
+}
+
+// Name of the file with the id provided, NULL if the id is not valid.
+static const char* file_name(symfile_t* file, uint32_t id)
+{
+    if (id >= file->header->nfiles
+        || file->files[id] >= file->header->blocks - file->header->names)
+    {
+        return NULL;
+    }
+
+    return file->names + file->files[id];
+}
+
+// Compare the USR with a stored one, which is not terminated by '\0'.
+static int compare_usr(const char* usr, const uint8_t* stored, uint32_t size)
+{
+    int result = strncmp(usr, (const char*)stored, size);
+    return result ? result : usr[size] != '\0';
+}
+
+// Read the next USR of a block into the buffer, which holds the previous
+// one, returns offset of its postings.
+static bool read_usr(
+    symfile_t* file,
+    const uint8_t** p,
+    char* usr,
+    uint32_t* postings)
+{
+    uint32_t shared = read_varint(p, file->postings);
+    uint32_t rest = read_varint(p, file->postings);
+    if (shared + (uint64_t)rest > file->header->max_usr
+        || rest > (size_t)(file->postings - *p))
+    {
+        return false;
+    }
+
+    memcpy(usr + shared, *p, rest);
+    usr[shared + rest] = '\0';
+    *p += rest;
+    *postings = read_varint(p, file->postings);
+
+    return *postings < (size_t)(file->end - file->postings);
+}
+
+static bool find_postings(
+    symfile_t* file,
+    const char* usr,
+    const uint8_t** postings)
+{
+    // Find the last block starting with a USR not greater than the one
+    // desired.
+    uint32_t low = 0;
+    uint32_t high = file->nblocks;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        const uint8_t* p = file->usrs + file->blocks[middle];
+        if (p >= file->postings)
+        {
+            return false;
+        }
+
+        read_varint(&p, file->postings);
+        uint32_t size = read_varint(&p, file->postings);
+        if (size > (size_t)(file->postings - p))
+        {
+            return false;
+        }
+
+        if (compare_usr(usr, p, size) >= 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    if (low == 0)
+    {
+        return false;
+    }
+
+    uint32_t block = low - 1;
+    uint32_t count = file->header->nsymbols - block * SYMFILE_BLOCK_SIZE;
+    count = count < SYMFILE_BLOCK_SIZE ? count : SYMFILE_BLOCK_SIZE;
+
+    char* current = (char*)malloc(file->header->max_usr + 1);
+    const uint8_t* p = file->usrs + file->blocks[block];
+    bool found = false;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t offset;
+        if (!read_usr(file, &p, current, &offset))
+        {
+            break;
+        }
+
+        int result = strcmp(current, usr);
+        if (result >= 0)
+        {
+            found = result == 0;
+            *postings = file->postings + offset;
+            break;
+        }
+    }
+    free(current);
+
+    return found;
+}
+
+// Decode postings of a symbol, locations of the kind provided or of every
+// kind if the kind is negative.
+static unsigned read_postings(
+    postings_reader_t* reader,
+    const uint8_t* p,
+    int kind)
+{
+    symfile_t* file = reader->file;
+
+    uint32_t counts[NKINDS];
+    for (unsigned k = 0; k < NKINDS; ++k)
+    {
+        counts[k] = read_varint(&p, file->end);
+    }
+
+    unsigned found = 0;
+    for (int k = 0; k < NKINDS && (kind < 0 || k <= kind); ++k)
+    {
+        uint32_t file_id = 0;
+        uint32_t line = 0;
+        for (uint32_t i = 0; i < counts[k] && p < file->end; ++i)
+        {
+            uint32_t delta = read_varint(&p, file->end);
+            uint32_t line_value = read_varint(&p, file->end);
+            uint32_t column = read_varint(&p, file->end);
+            file_id += delta;
+            line = delta ? line_value : line + line_value;
+
+            const char* filename = file_name(file, file_id);
+            if ((kind >= 0 && k != kind) || !filename)
+            {
+                continue;
+            }
+
+            location_t location = {
+                .filename = filename,
+                .line = line,
+                .column = column};
+            if (reader->onentry)
+            {
+                symbol_entry_t entry = {
+                    .usr = reader->usr,
+                    .filename = location.filename,
+                    .line = line,
+                    .column = column,
+                    .kind = (symbol_kind_t)k};
+                (*reader->onentry)(reader->ctx, &entry);
+            }
+            else
+            {
+                (*reader->onlocation)(reader->ctx, &location);
+            }
+            ++found;
+        }
+    }
+
+    return found;
+}
+
+unsigned symfile_find(
+    symfile_t* file,
+    const char* usr,
+    symbol_kind_t kind,
+    void* ctx,
+    void (*onlocation)(void*, location_t*))
+{
+    const uint8_t* postings;
+    if (!find_postings(file, usr, &postings))
+    {
+        return 0;
+    }
+
+    postings_reader_t reader = {
+        .file = file,
+        .ctx = ctx,
+        .onlocation = onlocation,
+        .onentry = NULL,
+        .usr = usr};
+    return read_postings(&reader, postings, (int)kind);
+}
+
+void symfile_each(
+    symfile_t* file,
+    void* ctx,
+    void (*onentry)(void*, const symbol_entry_t*))
+{
+    char* usr = (char*)malloc(file->header->max_usr + 1);
+    postings_reader_t reader = {
+        .file = file,
+        .ctx = ctx,
+        .onlocation = NULL,
+        .onentry = onentry,
+        .usr = usr};
+
+    const uint8_t* p = file->usrs;
+    for (uint32_t i = 0; i < file->header->nsymbols; ++i)
+    {
+        uint32_t offset;
+        if (!read_usr(file, &p, usr, &offset))
+        {
+            break;
+        }
+        read_postings(&reader, file->postings + offset, -1);
+    }
+
+    free(usr);
+}
+
+// Name of the source with the index provided, NULL if the record is not
+// valid.
+static const char* source_name(symfile_t* file, uint32_t i)
+{
+    uint32_t offset = file->sources[i];
+    if (offset >= (size_t)(file->end - file->dependencies))
+    {
+        return NULL;
+    }
+
+    const uint8_t* p = file->dependencies + offset;
+    return file_name(file, read_varint(&p, file->end));
+}
+
+// Decode the record of the source with the index provided, returns false if
+// the record is not valid.
+static bool read_source(
+    symfile_t* file,
+    uint32_t i,
+    void* ctx,
+    void (*onsource)(void*, const source_entry_t*))
+{
+    const char* filename = source_name(file, i);
+    if (!filename)
+    {
+        return false;
+    }
+
+    const uint8_t* p = file->dependencies + file->sources[i];
+    read_varint(&p, file->end);
+    uint32_t ndependencies = read_varint(&p, file->end);
+    // A dependency takes at least 12 bytes.
+    if (ndependencies > (size_t)(file->end - p) / 12)
+    {
+        return false;
+    }
+
+    dependency_t* dependencies =
+        (dependency_t*)malloc(sizeof(dependency_t) * (ndependencies + 1));
+    bool valid = true;
+    for (uint32_t d = 0; d < ndependencies && valid; ++d)
+    {
+        dependency_t* dependency = &dependencies[d];
+        dependency->filename = file_name(file, read_varint(&p, file->end));
+        dependency->state.device = read_varint64(&p, file->end);
+        dependency->state.inode = read_varint64(&p, file->end);
+        dependency->state.mtime = (int64_t)read_varint64(&p, file->end);
+
+        valid = dependency->filename
+            && (size_t)(file->end - p) >= sizeof(dependency->state.hash);
+        if (valid)
+        {
+            memcpy(&dependency->state.hash, p, sizeof(dependency->state.hash));
+            p += sizeof(dependency->state.hash);
+        }
+    }
+
+    if (valid)
+    {
+        source_entry_t source = {
+            .filename = filename,
+            .dependencies = dependencies,
+            .ndependencies = ndependencies};
+        (*onsource)(ctx, &source);
+    }
+    free(dependencies);
+
+    return valid;
+}
+
+bool symfile_find_source(
+    symfile_t* file,
+    const char* filename,
+    void* ctx,
+    void (*onsource)(void*, const source_entry_t*))
+{
+    uint32_t low = 0;
+    uint32_t high = file->header->nsources;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        const char* name = source_name(file, middle);
+        if (!name)
+        {
+            return false;
+        }
+
+        int result = strcmp(filename, name);
+        if (result == 0)
+        {
+            return read_source(file, middle, ctx, onsource);
+        }
+
+        if (result > 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return false;
+}
+
+void symfile_each_source(
+    symfile_t* file,
+    void* ctx,
+    void (*onsource)(void*, const source_entry_t*))
+{
+    for (uint32_t i = 0; i < file->header->nsources; ++i)
+    {
+        read_source(file, i, ctx, onsource);
+    }
+}
+
+static void put(buffer_t* buffer, const void* data, size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    if (buffer->size + size > buffer->capacity)
+    {
+        while (buffer->size + size > buffer->capacity)
+        {
+            buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        }
+        buffer->data = (uint8_t*)realloc(buffer->data, buffer->capacity);
+    }
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+static void put_varint(buffer_t* buffer, uint64_t value)
+{
+    uint8_t bytes[10];
+    unsigned size = 0;
+    do
+    {
+        bytes[size] = value & 0x7f;
+        value >>= 7;
+        bytes[size++] |= value ? 0x80 : 0;
+    } while (value);
+
+    put(buffer, bytes, size);
+}
+
+static void put_u32(buffer_t* buffer, uint32_t value)
+{
+    put(buffer, &value, sizeof(value));
+}
+
+static void put_padding(buffer_t* buffer)
+{
+    static const uint8_t zeros[4] = {0, 0, 0, 0};
+    put(buffer, zeros, (4 - buffer->size % 4) % 4);
+}
+
+static int compare_entries(const void* a, const void* b)
+{
+    const symbol_entry_t* entry1 = (const symbol_entry_t*)a;
+    const symbol_entry_t* entry2 = (const symbol_entry_t*)b;
+
+    int result = strcmp(entry1->usr, entry2->usr);
+    if (result)
+    {
+        return result;
+    }
+    if (entry1->kind != entry2->kind)
+    {
+        return entry1->kind < entry2->kind ? -1 : 1;
+    }
+    result = strcmp(entry1->filename, entry2->filename);
+    if (result)
+    {
+        return result;
+    }
+    if (entry1->line != entry2->line)
+    {
+        return entry1->line < entry2->line ? -1 : 1;
+    }
+    return entry1->column < entry2->column
+        ? -1
+        : entry1->column > entry2->column;
+}
+
+static int compare_strings(const void* a, const void* b)
+{
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+static int compare_sources(const void* a, const void* b)
+{
+    return strcmp(
+        (*(const source_entry_t* const*)a)->filename,
+        (*(const source_entry_t* const*)b)->filename);
+}
+
+static uint32_t file_id(const char** names, size_t nnames, const char* name)
+{
+    const char** found = (const char**)bsearch(
+        &name, names, nnames, sizeof(char*), &compare_strings);
+    return (uint32_t)(found - names);
+}
+
+static size_t common_prefix(const char* a, const char* b)
+{
+    size_t size = 0;
+    while (a[size] && a[size] == b[size])
+    {
+        ++size;
+    }
+    return size;
+}
+
+// Write locations of a symbol, entries are sorted and may repeat.
+static void put_postings(
+    buffer_t* postings,
+    const symbol_entry_t* entries,
+    size_t nentries,
+    const char** names,
+    size_t nnames)
+{
+    uint32_t counts[NKINDS] = {0, 0, 0};
+    for (size_t i = 0; i < nentries; ++i)
+    {
+        if (i == 0 || compare_entries(&entries[i - 1], &entries[i]) != 0)
+        {
+            ++counts[entries[i].kind];
+        }
+    }
+
+    for (unsigned k = 0; k < NKINDS; ++k)
+    {
+        put_varint(postings, counts[k]);
+    }
+
+    uint32_t last_file = 0;
+    uint32_t last_line = 0;
+    for (size_t i = 0; i < nentries; ++i)
+    {
+        const symbol_entry_t* entry = &entries[i];
+        if (i > 0 && compare_entries(&entries[i - 1], entry) == 0)
+        {
+            continue;
+        }
+
+        // Deltas start again with every kind.
+        if (i == 0 || entries[i - 1].kind != entry->kind)
+        {
+            last_file = 0;
+            last_line = 0;
+        }
+
+        uint32_t id = file_id(names, nnames, entry->filename);
+        uint32_t delta = id - last_file;
+        put_varint(postings, delta);
+        put_varint(postings, delta ? entry->line : entry->line - last_line);
+        put_varint(postings, entry->column);
+        last_file = id;
+        last_line = entry->line;
+    }
+}
+
+// Write records of the sources, which are sorted by name, so they are sorted
+// by file id as well.
+static void put_sources(
+    buffer_t* offsets,
+    buffer_t* records,
+    const source_entry_t** sources,
+    size_t nsources,
+    const char** names,
+    size_t nnames)
+{
+    for (size_t i = 0; i < nsources; ++i)
+    {
+        const source_entry_t* source = sources[i];
+        put_u32(offsets, (uint32_t)records->size);
+        put_varint(records, file_id(names, nnames, source->filename));
+        put_varint(records, source->ndependencies);
+
+        for (size_t d = 0; d < source->ndependencies; ++d)
+        {
+            const dependency_t* dependency = &source->dependencies[d];
+            const file_state_t* state = &dependency->state;
+            put_varint(records, file_id(names, nnames, dependency->filename));
+            put_varint(records, state->device);
+            put_varint(records, state->inode);
+            put_varint(records, (uint64_t)state->mtime);
+            put(records, &state->hash, sizeof(state->hash));
+        }
+    }
+}
+
+bool symfile_write(
+    const char* path,
+    symbol_entry_t* entries,
+    size_t nentries,
+    const source_entry_t* sources,
+    size_t nsources)
+{
+    qsort(entries, nentries, sizeof(symbol_entry_t), &compare_entries);
+
+    const source_entry_t** sorted_sources = (const source_entry_t**)malloc(
+        sizeof(source_entry_t*) * (nsources + 1));
+    size_t size = nentries + nsources;
+    for (size_t i = 0; i < nsources; ++i)
+    {
+        sorted_sources[i] = &sources[i];
+        size += sources[i].ndependencies;
+    }
+    qsort(
+        sorted_sources,
+        nsources,
+        sizeof(source_entry_t*),
+        &compare_sources);
+
+    // File names sorted and unique, ids of files are their indices.
+    const char** names = (const char**)malloc(sizeof(char*) * (size + 1));
+    size_t nnames = 0;
+    for (size_t i = 0; i < nentries; ++i)
+    {
+        names[nnames++] = entries[i].filename;
+    }
+    for (size_t i = 0; i < nsources; ++i)
+    {
+        names[nnames++] = sources[i].filename;
+        for (size_t d = 0; d < sources[i].ndependencies; ++d)
+        {
+            names[nnames++] = sources[i].dependencies[d].filename;
+        }
+    }
+    qsort(names, size, sizeof(char*), &compare_strings);
+    nnames = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (nnames == 0 || strcmp(names[nnames - 1], names[i]) != 0)
+        {
+            names[nnames++] = names[i];
+        }
+    }
+
+    header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SYMFILE_MAGIC, sizeof(header.magic));
+    header.version = SYMFILE_VERSION;
+    header.nfiles = (uint32_t)nnames;
+    header.nsources = (uint32_t)nsources;
+
+    buffer_t blocks = {.data = NULL, .size = 0, .capacity = 0};
+    buffer_t usrs = {.data = NULL, .size = 0, .capacity = 0};
+    buffer_t postings = {.data = NULL, .size = 0, .capacity = 0};
+    const char* last_usr = "";
+    for (size_t begin = 0, end; begin < nentries; begin = end)
+    {
+        const char* usr = entries[begin].usr;
+        for (end = begin + 1;
+            end < nentries && strcmp(entries[end].usr, usr) == 0;
+            ++end)
+        {
+        }
+
+        size_t shared = 0;
+        if (header.nsymbols % SYMFILE_BLOCK_SIZE == 0)
+        {
+            put_u32(&blocks, (uint32_t)usrs.size);
+        }
+        else
+        {
+            shared = common_prefix(last_usr, usr);
+        }
+
+        size_t length = strlen(usr);
+        put_varint(&usrs, (uint32_t)shared);
+        put_varint(&usrs, (uint32_t)(length - shared));
+        put(&usrs, usr + shared, length - shared);
+        put_varint(&usrs, (uint32_t)postings.size);
+
+        put_postings(&postings, entries + begin, end - begin, names, nnames);
+
+        if (length > header.max_usr)
+        {
+            header.max_usr = (uint32_t)length;
+        }
+        ++header.nsymbols;
+        last_usr = usr;
+    }
+
+    buffer_t out = {.data = NULL, .size = 0, .capacity = 0};
+    put(&out, &header, sizeof(header));
+
+    header.files = (uint32_t)out.size;
+    uint32_t name_offset = 0;
+    for (size_t i = 0; i < nnames; ++i)
+    {
+        put_u32(&out, name_offset);
+        name_offset += (uint32_t)strlen(names[i]) + 1;
+    }
+
+    header.names = (uint32_t)out.size;
+    for (size_t i = 0; i < nnames; ++i)
+    {
+        put(&out, names[i], strlen(names[i]) + 1);
+    }
+    put_padding(&out);
+
+    header.blocks = (uint32_t)out.size;
+    put(&out, blocks.data, blocks.size);
+    header.usrs = (uint32_t)out.size;
+    put(&out, usrs.data, usrs.size);
+    header.postings = (uint32_t)out.size;
+    put(&out, postings.data, postings.size);
+    put_padding(&out);
+
+    buffer_t offsets = {.data = NULL, .size = 0, .capacity = 0};
+    buffer_t records = {.data = NULL, .size = 0, .capacity = 0};
+    put_sources(
+        &offsets, &records, sorted_sources, nsources, names, nnames);
+    header.sources = (uint32_t)out.size;
+    put(&out, offsets.data, offsets.size);
+    header.dependencies = (uint32_t)out.size;
+    put(&out, records.data, records.size);
+
+    header.size = (uint32_t)out.size;
+    memcpy(out.data, &header, sizeof(header));
+
+    free(names);
+    free(sorted_sources);
+    free(blocks.data);
+    free(usrs.data);
+    free(postings.data);
+    free(offsets.data);
+    free(records.data);
+
+    // Offsets are 32 bit.
+    bool written = out.size <= UINT32_MAX;
+    char* tmp_path = (char*)malloc(strlen(path) + sizeof(".tmp"));
+    sprintf(tmp_path, "%s.tmp", path);
+
+    FILE* file = written ? fopen(tmp_path, "wb") : NULL;
+    if (file)
+    {
+        written = fwrite(out.data, 1, out.size, file) == out.size;
+        written = fclose(file) == 0 && written;
+        written = written && rename(tmp_path, path) == 0;
+        if (!written)
+        {
+            unlink(tmp_path);
+        }
+    }
+    else
+    {
+        written = false;
+    }
+
+    free(tmp_path);
+    free(out.data);
+
+    return written;
+}
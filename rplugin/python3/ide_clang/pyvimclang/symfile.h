@@ -0,0 +1,138 @@
+/**
+ * Symbol index file mapped into memory, read only.
+ *
+ * The file maps USRs to locations of their definitions, declarations and
+ * references, and indexed sources to the files they were indexed from.
+ * Integers are stored in native byte order, the file is a local cache rather
+ * than an exchange format. Sections follow the header:
+ *
+ * files    uint32 offsets of file names in the names section, a file id is
+ *          the index of its name in this table, names are sorted.
+ * names    file names terminated by '\0'.
+ * blocks   uint32 offsets of USR blocks in the USRs section.
+ * usrs     sorted USRs in blocks of SYMFILE_BLOCK_SIZE. A USR is stored as
+ *          varint length of the prefix shared with the previous USR, varint
+ *          length of the rest and the rest, the first USR of a block shares
+ *          nothing. Every USR is followed by varint offset of its postings.
+ * postings per symbol varint numbers of declarations, definitions and
+ *          references followed by their locations, each kind sorted by file,
+ *          line and column. A location is varint file id delta, varint line,
+ *          which is a delta if the file is the same, and varint column.
+ * sources  uint32 offsets of source records in the dependencies section,
+ *          sorted by file id.
+ * dependencies
+ *          per source varint file id, varint number of dependencies and for
+ *          each of them varint file id, varint device, inode and
+ *          modification time and 64 bit content hash.
+ *
+ * Lookups binary search first USRs of blocks and scan a single block, sources
+ * are binary searched by name.
+ */
+#ifndef SYMFILE_H
+#define SYMFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ide.h"
+#include "symindex.h"
+
+#define SYMFILE_BLOCK_SIZE 16
+
+typedef struct symfile symfile_t;
+
+/**
+ * Map the symbol index file provided.
+ * @param  path file path.
+ * @return      the file mapped or NULL if it cannot be read or is not a valid
+ *              symbol index file.
+ */
+symfile_t* symfile_open(const char* path);
+
+/**
+ * Unmap the file provided.
+ * @param file file to be closed.
+ */
+void symfile_close(symfile_t* file);
+
+/**
+ * Get number of symbols in the file provided.
+ * @param  file the file.
+ * @return      number of symbols.
+ */
+size_t symfile_size(symfile_t* file);
+
+/**
+ * Find locations of the symbol provided, file names of locations point into
+ * the mapped file.
+ * @param  file       file to search.
+ * @param  usr        USR of the symbol.
+ * @param  kind       kind of locations desired.
+ * @param  ctx        closure context.
+ * @param  onlocation single location handler.
+ * @return            number of locations found.
+ */
+unsigned symfile_find(
+    symfile_t* file,
+    const char* usr,
+    symbol_kind_t kind,
+    void* ctx,
+    void (*onlocation)(void*, location_t*));
+
+/**
+ * Call the handler for every location in the file, USRs of entries are only
+ * valid during the call.
+ * @param file    the file.
+ * @param ctx     closure context.
+ * @param onentry single entry handler.
+ */
+void symfile_each(
+    symfile_t* file,
+    void* ctx,
+    void (*onentry)(void*, const symbol_entry_t*));
+
+/**
+ * Find the source provided, file names of the source point into the mapped
+ * file and its dependencies are only valid during the call.
+ * @param  file     file to search.
+ * @param  filename source file name.
+ * @param  ctx      closure context.
+ * @param  onsource source handler.
+ * @return          true if the source is found otherwise false.
+ */
+bool symfile_find_source(
+    symfile_t* file,
+    const char* filename,
+    void* ctx,
+    void (*onsource)(void*, const source_entry_t*));
+
+/**
+ * Call the handler for every source in the file, dependencies of sources are
+ * only valid during the call.
+ * @param file     the file.
+ * @param ctx      closure context.
+ * @param onsource single source handler.
+ */
+void symfile_each_source(
+    symfile_t* file,
+    void* ctx,
+    void (*onsource)(void*, const source_entry_t*));
+
+/**
+ * Write entries and sources to a symbol index file. The file is written next
+ * to the path and renamed, so files mapped from the path stay valid.
+ * @param  path     file path.
+ * @param  entries  entries to be written, sorted in place.
+ * @param  nentries number of entries.
+ * @param  sources  sources to be written, names should be unique.
+ * @param  nsources number of sources.
+ * @return          true if the file is written otherwise false.
+ */
+bool symfile_write(
+    const char* path,
+    symbol_entry_t* entries,
+    size_t nentries,
+    const source_entry_t* sources,
+    size_t nsources);
+
+#endif // !SYMFILE_H
@@ -0,0 +1,754 @@
+#include "symindex.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashmap.h"
+#include "symfile.h"
+
+typedef struct symbol symbol_t;
+
+// Occurrences are keys of the occurrences map, so they are allocated one by
+// one and do not move.
+typedef struct
+{
+    symbol_t* symbol;
+    const char* filename;
+    unsigned line;
+    unsigned column;
+    symbol_kind_t kind;
+    // Number of indexed sources the location was found in.
+    unsigned refs;
+    // Index in the items of the symbol.
+    size_t position;
+} occurrence_t;
+
+struct symbol
+{
+    char* usr;
+    occurrence_t** items;
+    size_t size;
+    size_t capacity;
+};
+
+typedef struct
+{
+    char* filename;
+    // Occurrences found in the source.
+    occurrence_t** items;
+    size_t size;
+    // Files the source was indexed from, names are owned.
+    dependency_t* dependencies;
+    size_t ndependencies;
+} source_t;
+
+// Copy of the locations found, made to report them without the index
+// locked.
+typedef struct
+{
+    location_t* items;
+    size_t size;
+    size_t capacity;
+} locations_t;
+
+// Locations of the loaded file in files indexed since it was loaded are out
+// of date.
+typedef struct
+{
+    symindex_t* index;
+    locations_t* locations;
+} base_filter_t;
+
+// Entries of a symbol index file being saved, USRs of the loaded file are
+// copied.
+typedef struct
+{
+    symindex_t* index;
+    symbol_entry_t* items;
+    size_t size;
+    size_t capacity;
+    char** owned;
+    size_t nowned;
+} entries_t;
+
+// Sources of a symbol index file being saved, dependencies are copied.
+typedef struct
+{
+    symindex_t* index;
+    source_entry_t* items;
+    size_t size;
+    size_t capacity;
+} sources_t;
+
+// Copy of the dependencies of a source, made to check them without the
+// index locked.
+typedef struct
+{
+    dependency_t* items;
+    size_t size;
+} dependencies_t;
+
+// Names of sources which depend on a file.
+typedef struct
+{
+    symindex_t* index;
+    const char* filename;
+    char** items;
+    size_t size;
+    size_t capacity;
+} dependents_t;
+
+struct symindex
+{
+    pthread_rwlock_t lock;
+    hashmap_t* files;
+    hashmap_t* symbols;
+    hashmap_t* sources;
+    // Every occurrence by its symbol and location, symbols referenced from
+    // many files have too many occurrences to be searched linearly.
+    hashmap_t* occurrences;
+    // Symbol index file loaded, NULL if none.
+    symfile_t* base;
+};
+
+static uint64_t occurrence_hash(const void* key)
+{
+    const occurrence_t* occurrence = (const occurrence_t*)key;
+    uint64_t hash = (uintptr_t)occurrence->symbol;
+    hash = hash * 31 + (uintptr_t)occurrence->filename;
+    hash = hash * 31 + occurrence->line;
+    hash = hash * 31 + occurrence->column;
+    hash = hash * 31 + occurrence->kind;
+
+    // Finalizer of splitmix64 spreads the bits.
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+// Symbols and file names are unique, so they are compared by pointers.
+static bool occurrence_equals(const void* a, const void* b)
+{
+    const occurrence_t* occurrence1 = (const occurrence_t*)a;
+    const occurrence_t* occurrence2 = (const occurrence_t*)b;
+    return occurrence1->symbol == occurrence2->symbol
+        && occurrence1->filename == occurrence2->filename
+        && occurrence1->line == occurrence2->line
+        && occurrence1->column == occurrence2->column
+        && occurrence1->kind == occurrence2->kind;
+}
+
+symindex_t* symindex_alloc(void)
+{
+    symindex_t* index = (symindex_t*)malloc(sizeof(symindex_t));
+    pthread_rwlock_init(&index->lock, NULL);
+    index->files = hashmap_alloc(&string_hash, &string_equals);
+    index->symbols = hashmap_alloc(&string_hash, &string_equals);
+    index->sources = hashmap_alloc(&string_hash, &string_equals);
+    index->occurrences = hashmap_alloc(&occurrence_hash, &occurrence_equals);
+    index->base = NULL;
+    return index;
+}
+
+static void free_file(void* ctx, const void* filename, void* data)
+{
+    free(data);
+}
+
+static void free_symbol(void* ctx, const void* usr, void* data)
+{
+    symbol_t* symbol = (symbol_t*)data;
+    for (size_t i = 0; i < symbol->size; ++i)
+    {
+        free(symbol->items[i]);
+    }
+    free(symbol->items);
+    free(symbol->usr);
+    free(symbol);
+}
+
+static void free_source(void* ctx, const void* filename, void* data)
+{
+    source_t* source = (source_t*)data;
+    for (size_t i = 0; i < source->ndependencies; ++i)
+    {
+        free((void*)source->dependencies[i].filename);
+    }
+    free(source->dependencies);
+    free(source->items);
+    free(source->filename);
+    free(source);
+}
+
+void symindex_free(symindex_t* index)
+{
+    hashmap_each(index->sources, NULL, &free_source);
+    hashmap_free(index->sources);
+    hashmap_free(index->occurrences);
+    hashmap_each(index->symbols, NULL, &free_symbol);
+    hashmap_free(index->symbols);
+    hashmap_each(index->files, NULL, &free_file);
+    hashmap_free(index->files);
+    if (index->base)
+    {
+        symfile_close(index->base);
+    }
+    pthread_rwlock_destroy(&index->lock);
+    free(index);
+}
+
+static const char* intern_file(symindex_t* index, const char* filename)
+{
+    void* interned;
+    if (!hashmap_get(index->files, filename, &interned))
+    {
+        interned = strdup(filename);
+        hashmap_set(index->files, interned, interned);
+    }
+
+    return (const char*)interned;
+}
+
+static symbol_t* get_symbol(symindex_t* index, const char* usr)
+{
+    void* symbol;
+    if (!hashmap_get(index->symbols, usr, &symbol))
+    {
+        symbol_t* created = (symbol_t*)malloc(sizeof(symbol_t));
+        created->usr = strdup(usr);
+        created->items = NULL;
+        created->size = 0;
+        created->capacity = 0;
+        hashmap_set(index->symbols, created->usr, created);
+        symbol = created;
+    }
+
+    return (symbol_t*)symbol;
+}
+
+static occurrence_t* add_occurrence(
+    symindex_t* index,
+    symbol_t* symbol,
+    const char* filename,
+    unsigned line,
+    unsigned column,
+    symbol_kind_t kind)
+{
+    occurrence_t key = {
+        .symbol = symbol,
+        .filename = filename,
+        .line = line,
+        .column = column,
+        .kind = kind};
+
+    void* found;
+    if (hashmap_get(index->occurrences, &key, &found))
+    {
+        ++((occurrence_t*)found)->refs;
+        return (occurrence_t*)found;
+    }
+
+    if (symbol->size == symbol->capacity)
+    {
+        symbol->capacity = symbol->capacity ? symbol->capacity * 2 : 2;
+        symbol->items = (occurrence_t**)realloc(
+            symbol->items, sizeof(occurrence_t*) * symbol->capacity);
+    }
+
+    occurrence_t* item = (occurrence_t*)malloc(sizeof(occurrence_t));
+    *item = key;
+    item->refs = 1;
+    item->position = symbol->size;
+    symbol->items[symbol->size++] = item;
+    hashmap_set(index->occurrences, item, item);
+
+    return item;
+}
+
+// Remove the location contributed by a source, returns true if the symbol
+// has no locations left.
+static bool remove_occurrence(symindex_t* index, occurrence_t* item)
+{
+    if (--item->refs > 0)
+    {
+        return false;
+    }
+
+    symbol_t* symbol = item->symbol;
+    hashmap_remove(index->occurrences, item);
+    symbol->items[item->position] = symbol->items[--symbol->size];
+    symbol->items[item->position]->position = item->position;
+    free(item);
+
+    return symbol->size == 0;
+}
+
+static void remove_source(symindex_t* index, const char* filename)
+{
+    void* found;
+    if (!hashmap_get(index->sources, filename, &found))
+    {
+        return;
+    }
+
+    source_t* source = (source_t*)found;
+    hashmap_remove(index->sources, filename);
+
+    // Several contributions can point to the same symbol, so empty symbols
+    // are freed once all contributions are removed.
+    symbol_t** empty =
+        (symbol_t**)malloc(sizeof(symbol_t*) * (source->size + 1));
+    size_t nempty = 0;
+
+    for (size_t i = 0; i < source->size; ++i)
+    {
+        symbol_t* symbol = source->items[i]->symbol;
+        if (remove_occurrence(index, source->items[i]))
+        {
+            empty[nempty++] = symbol;
+        }
+    }
+
+    for (size_t i = 0; i < nempty; ++i)
+    {
+        hashmap_remove(index->symbols, empty[i]->usr);
+        free_symbol(NULL, empty[i]->usr, empty[i]);
+    }
+
+    free(empty);
+    free_source(NULL, source->filename, source);
+}
+
+void symindex_update(
+    symindex_t* index,
+    const char* filename,
+    const symbol_entry_t* entries,
+    size_t nentries,
+    const dependency_t* dependencies,
+    size_t ndependencies)
+{
+    pthread_rwlock_wrlock(&index->lock);
+
+    remove_source(index, filename);
+    // The source may have no locations, but it still replaces the ones of
+    // the loaded file.
+    intern_file(index, filename);
+
+    source_t* source = (source_t*)malloc(sizeof(source_t));
+    source->filename = strdup(filename);
+    source->items =
+        (occurrence_t**)malloc(sizeof(occurrence_t*) * (nentries + 1));
+    source->size = nentries;
+    source->dependencies = (dependency_t*)malloc(
+        sizeof(dependency_t) * (ndependencies + 1));
+    source->ndependencies = ndependencies;
+    for (size_t i = 0; i < ndependencies; ++i)
+    {
+        source->dependencies[i] = dependencies[i];
+        source->dependencies[i].filename = strdup(dependencies[i].filename);
+    }
+
+    for (size_t i = 0; i < nentries; ++i)
+    {
+        const symbol_entry_t* entry = &entries[i];
+        symbol_t* symbol = get_symbol(index, entry->usr);
+        const char* file = intern_file(index, entry->filename);
+
+        source->items[i] = add_occurrence(
+            index, symbol, file, entry->line, entry->column, entry->kind);
+    }
+
+    hashmap_set(index->sources, source->filename, source);
+
+    pthread_rwlock_unlock(&index->lock);
+}
+
+static void copy_dependencies(
+    dependencies_t* copy,
+    const dependency_t* dependencies,
+    size_t ndependencies)
+{
+    copy->items = (dependency_t*)malloc(
+        sizeof(dependency_t) * (ndependencies + 1));
+    copy->size = ndependencies;
+    for (size_t i = 0; i < ndependencies; ++i)
+    {
+        copy->items[i] = dependencies[i];
+        copy->items[i].filename = strdup(dependencies[i].filename);
+    }
+}
+
+static void copy_base_dependencies(void* ctx, const source_entry_t* source)
+{
+    copy_dependencies(
+        (dependencies_t*)ctx, source->dependencies, source->ndependencies);
+}
+
+bool symindex_is_current(
+    symindex_t* index,
+    const char* filename,
+    filestates_t* states)
+{
+    dependencies_t dependencies = {.items = NULL, .size = 0};
+
+    pthread_rwlock_rdlock(&index->lock);
+    void* found;
+    if (hashmap_get(index->sources, filename, &found))
+    {
+        source_t* source = (source_t*)found;
+        copy_dependencies(
+            &dependencies, source->dependencies, source->ndependencies);
+    }
+    else if (index->base)
+    {
+        symfile_find_source(
+            index->base, filename, &dependencies, &copy_base_dependencies);
+    }
+    pthread_rwlock_unlock(&index->lock);
+
+    // Files may be read to check them, which is not done with the index
+    // locked. A source without dependencies was indexed by an older version.
+    bool current = dependencies.size > 0;
+    for (size_t i = 0; current && i < dependencies.size; ++i)
+    {
+        const dependency_t* dependency = &dependencies.items[i];
+        current = !filestates_changed(
+            states, dependency->filename, &dependency->state);
+    }
+
+    for (size_t i = 0; i < dependencies.size; ++i)
+    {
+        free((void*)dependencies.items[i].filename);
+    }
+    free(dependencies.items);
+
+    return current;
+}
+
+static void add_dependent(
+    dependents_t* dependents,
+    const char* source,
+    const dependency_t* dependencies,
+    size_t ndependencies)
+{
+    size_t i = 0;
+    while (i < ndependencies
+        && strcmp(dependencies[i].filename, dependents->filename) != 0)
+    {
+        ++i;
+    }
+
+    if (i == ndependencies)
+    {
+        return;
+    }
+
+    if (dependents->size == dependents->capacity)
+    {
+        dependents->capacity =
+            dependents->capacity ? dependents->capacity * 2 : 16;
+        dependents->items = (char**)realloc(
+            dependents->items, sizeof(char*) * dependents->capacity);
+    }
+
+    dependents->items[dependents->size++] = strdup(source);
+}
+
+static void add_source_dependent(void* ctx, const void* filename, void* data)
+{
+    source_t* source = (source_t*)data;
+    add_dependent(
+        (dependents_t*)ctx,
+        source->filename,
+        source->dependencies,
+        source->ndependencies);
+}
+
+static void add_base_dependent(void* ctx, const source_entry_t* source)
+{
+    dependents_t* dependents = (dependents_t*)ctx;
+    void* found;
+    if (!hashmap_get(dependents->index->sources, source->filename, &found))
+    {
+        add_dependent(
+            dependents,
+            source->filename,
+            source->dependencies,
+            source->ndependencies);
+    }
+}
+
+void symindex_dependents(
+    symindex_t* index,
+    const char* filename,
+    void* ctx,
+    void (*ondependent)(void*, const char*))
+{
+    dependents_t dependents = {
+        .index = index,
+        .filename = filename,
+        .items = NULL,
+        .size = 0,
+        .capacity = 0};
+
+    pthread_rwlock_rdlock(&index->lock);
+    hashmap_each(index->sources, &dependents, &add_source_dependent);
+    if (index->base)
+    {
+        symfile_each_source(index->base, &dependents, &add_base_dependent);
+    }
+    pthread_rwlock_unlock(&index->lock);
+
+    for (size_t i = 0; i < dependents.size; ++i)
+    {
+        (*ondependent)(ctx, dependents.items[i]);
+        free(dependents.items[i]);
+    }
+    free(dependents.items);
+}
+
+static void add_location(locations_t* locations, const location_t* location)
+{
+    if (locations->size == locations->capacity)
+    {
+        locations->capacity =
+            locations->capacity ? locations->capacity * 2 : 16;
+        locations->items = (location_t*)realloc(
+            locations->items, sizeof(location_t) * locations->capacity);
+    }
+
+    locations->items[locations->size++] = (location_t){
+        .filename = strdup(location->filename),
+        .line = location->line,
+        .column = location->column};
+}
+
+static void filter_base_location(void* ctx, location_t* location)
+{
+    base_filter_t* filter = (base_filter_t*)ctx;
+    void* interned;
+    if (!hashmap_get(filter->index->files, location->filename, &interned))
+    {
+        add_location(filter->locations, location);
+    }
+}
+
+unsigned symindex_find(
+    symindex_t* index,
+    const char* usr,
+    symbol_kind_t kind,
+    void* ctx,
+    void (*onlocation)(void*, location_t*))
+{
+    locations_t locations = {.items = NULL, .size = 0, .capacity = 0};
+
+    pthread_rwlock_rdlock(&index->lock);
+
+    void* symbol;
+    if (hashmap_get(index->symbols, usr, &symbol))
+    {
+        for (size_t i = 0; i < ((symbol_t*)symbol)->size; ++i)
+        {
+            occurrence_t* item = ((symbol_t*)symbol)->items[i];
+            if (item->kind == kind)
+            {
+                location_t location = {
+                    .filename = item->filename,
+                    .line = item->line,
+                    .column = item->column};
+                add_location(&locations, &location);
+            }
+        }
+    }
+
+    if (index->base)
+    {
+        base_filter_t filter = {.index = index, .locations = &locations};
+        symfile_find(index->base, usr, kind, &filter, &filter_base_location);
+    }
+
+    pthread_rwlock_unlock(&index->lock);
+
+    for (size_t i = 0; i < locations.size; ++i)
+    {
+        (*onlocation)(ctx, &locations.items[i]);
+        free((void*)locations.items[i].filename);
+    }
+    free(locations.items);
+
+    return (unsigned)locations.size;
+}
+
+size_t symindex_size(symindex_t* index)
+{
+    pthread_rwlock_rdlock(&index->lock);
+    size_t size = hashmap_size(index->symbols);
+    if (index->base)
+    {
+        size += symfile_size(index->base);
+    }
+    pthread_rwlock_unlock(&index->lock);
+
+    return size;
+}
+
+bool symindex_load(symindex_t* index, const char* path)
+{
+    symfile_t* base = symfile_open(path);
+    if (!base)
+    {
+        return false;
+    }
+
+    pthread_rwlock_wrlock(&index->lock);
+    symfile_t* old_base = index->base;
+    index->base = base;
+    pthread_rwlock_unlock(&index->lock);
+
+    if (old_base)
+    {
+        symfile_close(old_base);
+    }
+
+    return true;
+}
+
+static void add_entry(entries_t* entries, const symbol_entry_t* entry)
+{
+    if (entries->size == entries->capacity)
+    {
+        entries->capacity = entries->capacity ? entries->capacity * 2 : 256;
+        entries->items = (symbol_entry_t*)realloc(
+            entries->items, sizeof(symbol_entry_t) * entries->capacity);
+        entries->owned = (char**)realloc(
+            entries->owned, sizeof(char*) * entries->capacity);
+    }
+
+    entries->items[entries->size++] = *entry;
+}
+
+static void add_base_entry(void* ctx, const symbol_entry_t* entry)
+{
+    entries_t* entries = (entries_t*)ctx;
+    void* interned;
+    if (hashmap_get(entries->index->files, entry->filename, &interned))
+    {
+        return;
+    }
+
+    // File names point into the loaded file, which stays mapped while the
+    // index is locked.
+    add_entry(entries, entry);
+    char* usr = strdup(entry->usr);
+    entries->items[entries->size - 1].usr = usr;
+    entries->owned[entries->nowned++] = usr;
+}
+
+static void add_symbol_entries(void* ctx, const void* usr, void* data)
+{
+    entries_t* entries = (entries_t*)ctx;
+    symbol_t* symbol = (symbol_t*)data;
+
+    for (size_t i = 0; i < symbol->size; ++i)
+    {
+        occurrence_t* item = symbol->items[i];
+        symbol_entry_t entry = {
+            .usr = symbol->usr,
+            .filename = item->filename,
+            .line = item->line,
+            .column = item->column,
+            .kind = item->kind};
+        add_entry(entries, &entry);
+    }
+}
+
+static void add_source(sources_t* sources, const source_entry_t* source)
+{
+    if (sources->size == sources->capacity)
+    {
+        sources->capacity = sources->capacity ? sources->capacity * 2 : 64;
+        sources->items = (source_entry_t*)realloc(
+            sources->items, sizeof(source_entry_t) * sources->capacity);
+    }
+
+    dependency_t* dependencies = (dependency_t*)malloc(
+        sizeof(dependency_t) * (source->ndependencies + 1));
+    memcpy(
+        dependencies,
+        source->dependencies,
+        sizeof(dependency_t) * source->ndependencies);
+
+    sources->items[sources->size++] = (source_entry_t){
+        .filename = source->filename,
+        .dependencies = dependencies,
+        .ndependencies = source->ndependencies};
+}
+
+static void add_base_source(void* ctx, const source_entry_t* source)
+{
+    sources_t* sources = (sources_t*)ctx;
+    void* found;
+    if (!hashmap_get(sources->index->sources, source->filename, &found))
+    {
+        // File names point into the loaded file, dependencies are copied.
+        add_source(sources, source);
+    }
+}
+
+static void add_indexed_source(void* ctx, const void* filename, void* data)
+{
+    source_t* source = (source_t*)data;
+    source_entry_t entry = {
+        .filename = source->filename,
+        .dependencies = source->dependencies,
+        .ndependencies = source->ndependencies};
+    add_source((sources_t*)ctx, &entry);
+}
+
+bool symindex_save(symindex_t* index, const char* path)
+{
+    entries_t entries = {
+        .index = index,
+        .items = NULL,
+        .size = 0,
+        .capacity = 0,
+        .owned = NULL,
+        .nowned = 0};
+    sources_t sources = {
+        .index = index,
+        .items = NULL,
+        .size = 0,
+        .capacity = 0};
+
+    pthread_rwlock_rdlock(&index->lock);
+
+    if (index->base)
+    {
+        symfile_each(index->base, &entries, &add_base_entry);
+        symfile_each_source(index->base, &sources, &add_base_source);
+    }
+    hashmap_each(index->symbols, &entries, &add_symbol_entries);
+    hashmap_each(index->sources, &sources, &add_indexed_source);
+
+    bool saved = symfile_write(
+        path, entries.items, entries.size, sources.items, sources.size);
+
+    pthread_rwlock_unlock(&index->lock);
+
+    for (size_t i = 0; i < sources.size; ++i)
+    {
+        free((void*)sources.items[i].dependencies);
+    }
+    free(sources.items);
+
+    for (size_t i = 0; i < entries.nowned; ++i)
+    {
+        free(entries.owned[i]);
+    }
+    free(entries.owned);
+    free(entries.items);
+
+    return saved;
+}
@@ -0,0 +1,158 @@
+/**
+ * Thread safe in-memory index of symbol locations keyed by USR.
+ *
+ * Locations are added per indexed source file. Headers included by several
+ * sources are stored once and kept while any of those sources is indexed.
+ *
+ * The index can be saved to a symbol index file and loaded back mapped into
+ * memory, see symfile.h. Locations of the loaded file are used for files
+ * without locations added since, so the file does not need to be rewritten
+ * when sources are indexed again.
+ *
+ * Every indexed source keeps the states of the files it was indexed from,
+ * the source itself and the headers it includes, so sources which none of
+ * these files changed since are not indexed again, see filestate.h.
+ */
+#ifndef SYMINDEX_H
+#define SYMINDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "filestate.h"
+#include "ide.h"
+
+typedef enum
+{
+    SYMBOL_DECLARATION,
+    SYMBOL_DEFINITION,
+    SYMBOL_REFERENCE
+} symbol_kind_t;
+
+typedef struct
+{
+    const char* usr;
+    const char* filename;
+    unsigned line;
+    unsigned column;
+    symbol_kind_t kind;
+} symbol_entry_t;
+
+// File an indexed source depends on in the state it was indexed in, the
+// name is canonical.
+typedef struct
+{
+    const char* filename;
+    file_state_t state;
+} dependency_t;
+
+typedef struct
+{
+    const char* filename;
+    const dependency_t* dependencies;
+    size_t ndependencies;
+} source_entry_t;
+
+typedef struct symindex symindex_t;
+
+/**
+ * Allocate a new empty index.
+ * @return the new index allocated.
+ */
+symindex_t* symindex_alloc(void);
+
+/**
+ * Deallocate the index provided.
+ * @param index index to be deallocated.
+ */
+void symindex_free(symindex_t* index);
+
+/**
+ * Replace locations found when indexing the source file provided.
+ * @param index         index to be updated.
+ * @param source        indexed source file.
+ * @param entries       locations found, strings are copied.
+ * @param nentries      number of locations found.
+ * @param dependencies  files the source was indexed from, strings are
+ *                      copied.
+ * @param ndependencies number of files the source was indexed from.
+ */
+void symindex_update(
+    symindex_t* index,
+    const char* source,
+    const symbol_entry_t* entries,
+    size_t nentries,
+    const dependency_t* dependencies,
+    size_t ndependencies);
+
+/**
+ * Check if the source is indexed and none of the files it was indexed from
+ * changed since.
+ * @param  index  the index.
+ * @param  source source file.
+ * @param  states cache of file states.
+ * @return        true if the source does not need to be indexed again.
+ */
+bool symindex_is_current(
+    symindex_t* index,
+    const char* source,
+    filestates_t* states);
+
+/**
+ * Find indexed sources which depend on the file provided, the file itself
+ * if it is an indexed source or sources including it.
+ * @param index       the index.
+ * @param filename    canonical file name, see filestates_canonical_name.
+ * @param ctx         closure context.
+ * @param ondependent single source handler, called without the index locked.
+ */
+void symindex_dependents(
+    symindex_t* index,
+    const char* filename,
+    void* ctx,
+    void (*ondependent)(void*, const char*));
+
+/**
+ * Find locations of the symbol provided.
+ * @param  index      index to search.
+ * @param  usr        USR of the symbol.
+ * @param  kind       kind of locations desired.
+ * @param  ctx        closure context.
+ * @param  onlocation single location handler, called without the index
+ *                    locked.
+ * @return            number of locations found.
+ */
+unsigned symindex_find(
+    symindex_t* index,
+    const char* usr,
+    symbol_kind_t kind,
+    void* ctx,
+    void (*onlocation)(void*, location_t*));
+
+/**
+ * Map the symbol index file provided as the base of the index, replacing the
+ * file loaded before.
+ * @param  index the index.
+ * @param  path  symbol index file.
+ * @return       true if the file is loaded otherwise false.
+ */
+bool symindex_load(symindex_t* index, const char* path);
+
+/**
+ * Save locations and sources of the index along with the ones of the loaded
+ * file it still uses to a symbol index file.
+ * @param  index the index.
+ * @param  path  symbol index file, can be the loaded one.
+ * @return       true if the file is saved otherwise false.
+ */
+bool symindex_save(symindex_t* index, const char* path);
+
+/**
+ * Get number of symbols in the index provided, symbols of the loaded file
+ * are counted whether or not they are indexed again.
+ * @param  index the index.
+ * @return       number of symbols.
+ */
+size_t symindex_size(symindex_t* index);
+
+#endif // !SYMINDEX_H
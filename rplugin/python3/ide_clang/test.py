@@ -1,4 +1,10 @@
 import datetime
+import os
+import shutil
+import tempfile
+import threading
+import time
+
 import pyvimclang
 
 LIBCLANG_PATH = r"/Applications/Xcode.app/Contents/Developer/Toolchains/XcodeDefault.xctoolchain/usr/lib/libclang.dylib"
@@ -48,10 +54,16 @@ ide = pyvimclang.Ide(LIBCLANG_PATH, ["-I/Users/vova/ports/usr/include"])
 t0 = datetime.datetime.now()
 ide.on_file_open(FILE)
 t1 = datetime.datetime.now()
-print("parsed in", t1 - t0)
+print("opened in", t1 - t0, ide.status(FILE))
+
+# The first completion is fast once the preamble is built in background.
+while (ide.warm(FILE) is None
+        and ide.status(FILE) != pyvimclang.STATUS_FAILED):
+    time.sleep(0.01)
+print("warm in", ide.warm(FILE), "ms")
 
 t0 = datetime.datetime.now()
-completions = ide.find_completions(FILE, 33, 5, CONTENT)
+completions = ide.find_completions(FILE, 33, 5, CONTENT, 60000)
 t1 = datetime.datetime.now()
 print("completed in", t1 - t0)
 
@@ -69,3 +81,225 @@ ide.on_file_save(FILE)
 #     print(c)
 
 ide.on_file_close(FILE)
+
+
+# Completion throughput when several threads complete different files, it
+# should grow with the number of threads as the GIL is released in libclang.
+COMPLETIONS_PER_THREAD = 20
+
+tmpdir = tempfile.mkdtemp()
+files = []
+for i in range(8):
+    filename = os.path.join(tmpdir, "main{}.cpp".format(i))
+    with open(filename, "w") as f:
+        f.write(CONTENT)
+    files.append(filename)
+    ide.on_file_open(filename)
+
+
+def complete(filename):
+    for _ in range(COMPLETIONS_PER_THREAD):
+        ide.find_completions(filename, 33, 5, CONTENT, 60000)
+
+
+for nthreads in (1, 2, 4, 8):
+    threads = [
+        threading.Thread(target=complete, args=(files[i],))
+        for i in range(nthreads)]
+    t0 = datetime.datetime.now()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    t1 = datetime.datetime.now()
+    total = nthreads * COMPLETIONS_PER_THREAD
+    print(nthreads, "threads:", total / (t1 - t0).total_seconds(), "req/s")
+
+for filename in files:
+    ide.on_file_close(filename)
+    os.remove(filename)
+
+
+# Results computed where the identifier starts are filtered while more of it
+# is typed, until the file is parsed again.
+def complete_words(filename, line, column, content):
+    return [c["word"] for c in ide.find_completions(
+        filename, line, column, content, 60000)]
+
+
+cached_file = os.path.join(tmpdir, "cached.cpp")
+with open(cached_file, "w") as f:
+    f.write(CONTENT)
+ide.on_file_open(cached_file)
+while (ide.warm(cached_file) is None
+        and ide.status(cached_file) != pyvimclang.STATUS_FAILED):
+    time.sleep(0.01)
+
+typed_p = complete_words(cached_file, 33, 6, CONTENT)
+typed_per = complete_words(cached_file, 33, 8, CONTENT)
+print("typed p", len(typed_p), "typed per", len(typed_per))
+assert "person" in typed_per
+assert set(typed_per) < set(typed_p)
+
+# A column past the end of the line completes the identifier the line ends
+# with.
+assert complete_words(cached_file, 33, 40, CONTENT) == typed_per
+
+# The variable added is only seen once the change is reparsed.
+CHANGED = CONTENT.replace("Person person;", "Person person; int perimeter;")
+assert "perimeter" not in complete_words(cached_file, 33, 8, CHANGED)
+ide.on_file_change(cached_file, CHANGED)
+deadline = time.time() + 10
+while ("perimeter" not in complete_words(cached_file, 33, 8, CHANGED)
+        and time.time() < deadline):
+    time.sleep(0.05)
+assert "perimeter" in complete_words(cached_file, 33, 8, CHANGED)
+ide.on_file_close(cached_file)
+os.remove(cached_file)
+os.rmdir(tmpdir)
+
+
+# A header missing in compile_commands.json gets flags of the project
+# sources, its include paths and macros are needed to parse it.
+def wait_parsed(ide, filename):
+    while ide.status(filename) == pyvimclang.STATUS_PARSING:
+        time.sleep(0.01)
+    return ide.status(filename)
+
+
+project = tempfile.mkdtemp()
+os.mkdir(os.path.join(project, "inc"))
+PROJECT_FILES = {
+    "compile_commands.json": """[{{
+        "directory": "{0}",
+        "command": "clang++ -Iinc -DWITH_WIDGET -std=c++17 -c a.cpp -o a.o",
+        "file": "a.cpp"
+    }}]""".format(project),
+    "a.cpp": '#include "widget.h"\nint f() { return widget(); }\n',
+    "a.h": '#include "widget.h"\ninline int g() { return widget(); }\n',
+    "inc/widget.h": "#ifdef WITH_WIDGET\ninline int widget() { return 1; }\n"
+                    "#endif\n",
+}
+for name, content in PROJECT_FILES.items():
+    with open(os.path.join(project, name), "w") as f:
+        f.write(content)
+
+compdb_ide = pyvimclang.Ide(LIBCLANG_PATH, [])
+compdb_ide.set_compilation_database(project)
+header = os.path.join(project, "a.h")
+compdb_ide.on_file_open(header)
+status = wait_parsed(compdb_ide, header)
+print("unlisted header", status)
+assert status == pyvimclang.STATUS_OK
+compdb_ide.on_file_close(header)
+
+
+# Write sites of a variable: assignments, increments and decrements, and
+# addresses taken to non-const pointers only.
+WRITES = """void take(int* p);
+void look(const int* p);
+
+int main(void)
+{
+    int x = 0;
+    x = 1;
+    x += 2;
+    ++x;
+    x--;
+    int* p = &x;
+    take(&x);
+    look(&x);
+    const int* cp = &x;
+    int* q;
+    q = &x;
+    const int* cq;
+    cq = &x;
+    return x + *p + *cp + *q + *cq;
+}
+"""
+
+writes_file = os.path.join(project, "writes.c")
+with open(writes_file, "w") as f:
+    f.write(WRITES)
+ide.on_file_open(writes_file)
+wait_parsed(ide, writes_file)
+writes = sorted(
+    (w["line"], w["column"])
+    for w in ide.find_assingments(writes_file, 6, 9))
+print("write sites", writes)
+assert writes == [
+    (7, 5), (8, 5), (9, 7), (10, 5), (11, 15), (12, 11), (16, 10)]
+ide.on_file_close(writes_file)
+
+
+# Candidates are ranked by how well they match the query, prefix matches
+# ahead of scattered ones and matching case ahead of other case, then by
+# clang priority, locals ahead of globals, and cut to the results wanted.
+RANKING = """int perch(void);
+
+int main(void)
+{
+    int spare_entry_row = 0;
+    int permit_count = 0;
+    int Person_ptr = 0;
+    int person_ptr = 0;
+    int percy = 0;
+
+    return 0;
+}
+"""
+
+ranking_file = os.path.join(project, "ranking.c")
+with open(ranking_file, "w") as f:
+    f.write(RANKING)
+ide.on_file_open(ranking_file)
+wait_parsed(ide, ranking_file)
+
+
+def ranked_words(query, max_results=0):
+    return [c["word"] for c in ide.find_completions(
+        ranking_file, 10, 5, RANKING, 60000, query, max_results)]
+
+
+ranked = ranked_words("per")
+print("ranked", ranked[:8])
+assert ranked.index("permit_count") < ranked.index("spare_entry_row")
+assert ranked.index("person_ptr") < ranked.index("Person_ptr")
+assert ranked.index("percy") < ranked.index("perch")
+upper = ranked_words("Per")
+assert upper.index("Person_ptr") < upper.index("person_ptr")
+assert ranked_words("per", 2) == ranked[:2]
+assert "main" not in ranked
+ide.on_file_close(ranking_file)
+
+
+# A source failing to parse after its tu is loaded from the AST cache fails,
+# as the loaded tu can be used neither for completion nor reparsing. The
+# pragma crashes the parser, it replaces the source keeping its size and
+# modification time so the cache entry stays valid.
+BROKEN = "#pragma clang __debug crash\n"
+broken_file = os.path.join(project, "broken.c")
+with open(broken_file, "w") as f:
+    f.write("int value;".ljust(len(BROKEN) - 1) + "\n")
+
+cache_dir = os.path.join(project, "cache")
+for run in range(2):
+    cache_ide = pyvimclang.Ide(LIBCLANG_PATH, [])
+    cache_ide.set_cache_dir(cache_dir)
+    cache_ide.on_file_open(broken_file)
+    status = wait_parsed(cache_ide, broken_file)
+    print("cached source", run, status)
+    if run == 0:
+        assert status == pyvimclang.STATUS_OK
+        st = os.stat(broken_file)
+        with open(broken_file, "w") as f:
+            f.write(BROKEN)
+        os.utime(broken_file, ns=(st.st_atime_ns, st.st_mtime_ns))
+    else:
+        assert status == pyvimclang.STATUS_FAILED
+        assert not cache_ide.find_completions(
+            broken_file, 1, 1, BROKEN, 0).to_list()
+    cache_ide.on_file_close(broken_file)
+    del cache_ide
+
+shutil.rmtree(project)